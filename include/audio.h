@@ -1,7 +1,13 @@
 #ifndef AUDIO_H
 #define AUDIO_H
 
+#include "eq.h"
+#include "resampler.h"
+
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 typedef struct AudioEngine AudioEngine;
 
@@ -12,9 +18,91 @@ bool audio_load_file(AudioEngine *engine, const char *filename);
 void audio_play(AudioEngine *engine);
 void audio_pause(AudioEngine *engine);
 void audio_stop(AudioEngine *engine);
+void audio_seek(AudioEngine *engine, double seconds);
 void audio_set_volume(AudioEngine *engine, float volume);
+// Loudness normalisation for the current track, on top of the volume
+void audio_set_track_gain(AudioEngine *engine, float gain);
+// Equaliser on the output, per eq_set_bands; no bands for flat. Changes
+// while playing are crossfaded in within a few milliseconds.
+void audio_set_eq(AudioEngine *engine, const EqBand *bands, int count);
 double audio_get_position(AudioEngine *engine);
 double audio_get_duration(AudioEngine *engine);
 bool audio_is_playing(AudioEngine *engine);
+bool audio_is_finished(AudioEngine *engine);
+size_t audio_get_alloc_bytes(AudioEngine *engine);
+// Playback decoding has fallen behind; safe to call from any thread
+bool audio_decode_is_behind(AudioEngine *engine);
+// Output used from the next load on: NULL/"" for the sound card, "null"
+// or a .wav/raw file path to render headless and faster than real time.
+// `rate` fixes the offline sinks' rate; 0 runs at the first track's rate.
+bool audio_set_output(AudioEngine *engine, const char *target, long rate);
+// Output buffering: `frames` per callback (0 lets the host choose) and
+// `latency` in seconds (0 for the device's low-latency default). Applies
+// the next time the output opens, i.e. the next load that cannot reuse it.
+void audio_set_buffering(AudioEngine *engine, unsigned frames,
+                         double latency);
+// Double the buffering after device underflows and step it back down
+// after a stable stretch of playback. Steps are logged in AudioStats.
+void audio_set_adaptive_latency(AudioEngine *engine, bool enabled);
+// Control thread, called regularly while playing (e.g. with position
+// updates); applies the adaptive mode's decisions
+void audio_tune_latency(AudioEngine *engine);
+// Takes effect from the next track that needs resampling
+void audio_set_resampler_quality(AudioEngine *engine,
+                                 ResamplerQuality quality);
+
+// Output callback instrumentation, counted from audio_init on. Gathered
+// with lock-free counters; reading them never stalls the callback.
+#define AUDIO_STATS_BUCKETS 16
+#define AUDIO_LATENCY_LOG 16
+
+// One change of the output buffering, logged when the output reopened
+typedef struct {
+  double at;       // seconds since audio_init
+  int level;       // adaptive step; 0 is the configured buffering
+  unsigned frames; // per callback, 0 if the host varies it
+  double latency_ms;
+  double wakeups; // callbacks per second, 0 if the host varies it
+  const char *reason;
+} AudioLatencyChange;
+
+typedef struct {
+  uint64_t callbacks;
+  uint64_t underflows; // the device ran dry (xrun), as it reported
+  uint64_t overflows;
+  uint64_t starved; // callbacks padded with silence mid-track
+  // Callback run time: bucket 0 is under 1 us, bucket i covers
+  // [2^(i-1), 2^i) us and the last one everything longer
+  uint64_t time_hist[AUDIO_STATS_BUCKETS];
+  double time_mean_us;
+  double time_max_us;
+  double budget_us; // length of the last buffer, which a callback must beat
+  // Decoded samples waiting in the ring, after the last callback and the
+  // lowest seen since playback last started
+  size_t ring_fill;
+  size_t ring_fill_min;
+  size_t ring_capacity;
+  // Output buffering as opened, and the latest changes to it, oldest first
+  unsigned buffer_frames; // 0 if the host varies it
+  double latency_ms;
+  int latency_level;
+  size_t latency_changes; // in total; the last AUDIO_LATENCY_LOG are kept
+  AudioLatencyChange latency_log[AUDIO_LATENCY_LOG];
+} AudioStats;
+
+void audio_get_stats(AudioEngine *engine, AudioStats *out);
+// The latest `frames` stereo frames sent to the output, after volume, at
+// the stream rate (*rate). Lock-free; false when none are available, e.g.
+// because the callback overwrote them while they were being copied.
+bool audio_tap_read(AudioEngine *engine, float *dst, size_t frames,
+                    long *rate);
+void audio_stats_write_json(const AudioStats *stats, FILE *f);
+
+// Gapless playback
+bool audio_queue_next(AudioEngine *engine, const char *filename, float gain);
+void audio_clear_next(AudioEngine *engine);
+bool audio_take_track_change(AudioEngine *engine);
+// Blend into the queued next track over this many seconds (0-12, 0 = off)
+void audio_set_crossfade(AudioEngine *engine, double seconds);
 
 #endif
@@ -0,0 +1,7 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Micro-benchmarks, run with `musicplayer bench [name]`
+int bench_main(int argc, char *argv[]);
+
+#endif
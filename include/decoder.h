@@ -0,0 +1,89 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define DECODER_PATH_MAX 1024
+
+typedef enum { DECODER_OK, DECODER_DONE, DECODER_ERROR } DecoderResult;
+
+typedef struct {
+  char title[256];
+  char artist[256];
+  char album[256];
+} DecoderTags;
+
+typedef struct Decoder Decoder;
+
+// decoder_open_ex flags
+#define DECODER_OPEN_BACKGROUND 1u // not the control thread: skip its caches
+
+// One backend per codec library. Every backend produces interleaved
+// float32 stereo at the file's native rate (mono is duplicated, extra
+// channels are dropped).
+typedef struct {
+  const char *name;
+  // does the start of the file (after any ID3v2 tag) look like ours?
+  bool (*probe)(const unsigned char *head, size_t len, bool after_id3);
+  Decoder *(*open)(const char *filepath, unsigned flags);
+  DecoderResult (*read)(Decoder *dec, float *dst, size_t max_samples,
+                        size_t *done);
+  int64_t (*seek)(Decoder *dec, int64_t frame); // landed frame, or -1
+  double (*duration)(Decoder *dec);             // seconds, 0 if unknown
+  bool (*tags)(Decoder *dec, DecoderTags *out);
+  // tags from the file's bytes alone, cheaper than opening a decoder;
+  // NULL if the backend has no such shortcut
+  bool (*file_tags)(const unsigned char *data, size_t size,
+                    DecoderTags *out);
+  // length from the file's bytes alone (see decoder_set_exact_durations
+  // for `exact`), 0 if unknown; NULL to open a decoder for it instead
+  double (*file_duration)(const unsigned char *data, size_t size,
+                          bool exact);
+  void (*close)(Decoder *dec);
+} DecoderVTable;
+
+// Common header; backends embed it as their first member
+struct Decoder {
+  const DecoderVTable *vt;
+  char path[DECODER_PATH_MAX];
+  long rate;
+  int channels; // always 2
+};
+
+// Decoder functions
+Decoder *decoder_open(const char *filepath); // picks backend by magic bytes
+Decoder *decoder_open_ex(const char *filepath, unsigned flags);
+void decoder_close(Decoder *dec);
+DecoderResult decoder_read(Decoder *dec, float *dst, size_t max_samples,
+                           size_t *done);
+int64_t decoder_seek(Decoder *dec, int64_t frame);
+double decoder_duration(Decoder *dec);
+bool decoder_tags(Decoder *dec, DecoderTags *out);
+
+bool decoder_supports_file(const char *filepath);
+// Tags alone, without a decoder where the backend can; any thread
+bool decoder_read_tags(const char *filepath, DecoderTags *out);
+// The same plus the length in seconds (0 if unknown), for adding a track
+// to the library without playing it
+bool decoder_read_info(const char *filepath, DecoderTags *out,
+                       double *duration);
+// Lengths from counting every frame rather than from header estimates,
+// where a backend distinguishes the two. Set once at startup.
+void decoder_set_exact_durations(bool exact);
+
+// Shared helpers for backends
+void decoder_init_base(Decoder *dec, const DecoderVTable *vt,
+                       const char *filepath);
+void decoder_copy_tag(char *dst, size_t dst_size, const char *src,
+                      size_t src_len);
+bool decoder_parse_comment(DecoderTags *out, const char *entry, size_t len);
+
+// Backends
+extern const DecoderVTable decoder_flac_vtable;
+extern const DecoderVTable decoder_vorbis_vtable;
+extern const DecoderVTable decoder_mpg123_vtable;
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Effects on the output, run by the audio callback on interleaved stereo
+// float. The chain cuts every callback buffer into blocks of at most
+// DSP_BLOCK_FRAMES, so a stage can keep fixed-size scratch and its cost
+// per block does not depend on the device's buffer size.
+
+#define DSP_BLOCK_FRAMES 256
+#define DSP_MAX_STAGES 8
+
+typedef struct DspStage DspStage;
+
+typedef struct {
+  const char *name;
+  // Control thread, while nothing is processing: the stream (re)opens at
+  // `rate`. Clears filter memory.
+  void (*prepare)(DspStage *stage, long rate);
+  // Audio thread: `frames` (1..DSP_BLOCK_FRAMES) stereo frames in place.
+  // Never blocks or allocates.
+  void (*process)(DspStage *stage, float *buf, size_t frames);
+  void (*destroy)(DspStage *stage);
+} DspStageVTable;
+
+struct DspStage {
+  const DspStageVTable *vt;
+};
+
+typedef struct {
+  DspStage *stages[DSP_MAX_STAGES]; // in processing order
+  int count;
+} DspChain;
+
+void dsp_chain_init(DspChain *chain);
+// Appends `stage`, which the chain then owns. Only while not processing.
+bool dsp_chain_add(DspChain *chain, DspStage *stage);
+void dsp_chain_prepare(DspChain *chain, long rate);
+void dsp_chain_process(DspChain *chain, float *buf, size_t frames);
+void dsp_chain_free(DspChain *chain);
+
+#endif
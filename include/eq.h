@@ -0,0 +1,32 @@
+#ifndef EQ_H
+#define EQ_H
+
+#include "dsp.h"
+
+// Parametric equaliser: a cascade of biquad filters (RBJ cookbook
+// shapes), one per band, as a DSP chain stage. Bands at 0 dB cost
+// nothing; with none left the stage passes audio through untouched.
+
+#define EQ_MAX_BANDS 16
+
+typedef enum { EQ_PEAK, EQ_LOW_SHELF, EQ_HIGH_SHELF } EqBandType;
+
+typedef struct {
+  EqBandType type;
+  double freq;    // Hz: centre, or corner of a shelf
+  double gain_db; // boost or cut
+  double q;       // bandwidth; 0.707 gives a shelf without overshoot
+} EqBand;
+
+DspStage *eq_create(void);
+// Control thread, also while the stream plays: the new settings take
+// over at the next block, crossfaded from the old ones over that block.
+// Extra bands beyond EQ_MAX_BANDS are ignored.
+void eq_set_bands(DspStage *stage, const EqBand *bands, int count);
+
+// Built-in settings for the UI to cycle through; preset 0 is flat
+int eq_preset_count(void);
+const char *eq_preset_name(int preset);
+int eq_preset_bands(int preset, EqBand *out); // up to EQ_MAX_BANDS
+
+#endif
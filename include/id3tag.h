@@ -0,0 +1,18 @@
+#ifndef ID3TAG_H
+#define ID3TAG_H
+
+#include "decoder.h"
+
+// ID3 tags straight from a file's bytes: the ID3v2 tag at the start
+// (versions 2.2 to 2.4) and the 128-byte ID3v1 tag at the end. Reading an
+// MP3's tags touches a few KB instead of every frame of the file.
+
+// Length of the ID3v2 tag at the start of `data`, header and footer
+// included; 0 if there is none
+size_t id3_v2_size(const unsigned char *data, size_t size);
+
+// Title, artist and album as UTF-8, from ID3v2 where it has them and
+// ID3v1 otherwise. False if the file carries neither tag.
+bool id3_read_tags(const unsigned char *data, size_t size, DecoderTags *out);
+
+#endif
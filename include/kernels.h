@@ -0,0 +1,34 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Block-processing kernels for the audio path. Every variant computes the
+// same result (up to float rounding in sums); kernels_init() picks the
+// fastest one the CPU supports.
+
+typedef void (*GainCopyFn)(float *dst, const float *src, size_t count,
+                           float gain);
+typedef float (*DotFn)(const float *a, const float *b, size_t count);
+typedef void (*S16ToFloatFn)(float *dst, const int16_t *src, size_t count,
+                             float scale);
+typedef void (*FloatToS16Fn)(int16_t *dst, const float *src, size_t count,
+                             float scale);
+
+typedef struct {
+  const char *name;
+  GainCopyFn gain_copy;      // dst[i] = src[i] * gain
+  DotFn dot;                 // sum of a[i] * b[i] (FIR filters)
+  S16ToFloatFn s16_to_float; // dst[i] = src[i] * scale
+  FloatToS16Fn float_to_s16; // dst[i] = src[i] * scale, rounded, clamped
+} AudioKernels;
+
+void kernels_init(void);
+const AudioKernels *kernels_active(void);
+
+// All variants usable on this CPU, best last (for benchmarks)
+int kernels_available(const AudioKernels **out, int max);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "player.h"
+#include "trackstore.h"
+
+#include <stdbool.h>
+
+// On-disk index of the playlist, so that it is back the moment the app
+// starts instead of after re-adding folders. A versioned binary file of
+// fixed-size records (path, tags, duration, file size and mtime) and one
+// block of shared strings, memory-mapped at startup.
+//
+// Loaded entries are trusted at first and checked afterwards by a
+// low-priority thread: changed files get their tags re-read, missing ones
+// are reported so the playlist can drop them.
+
+#define LIBRARY_MAX_ROOTS 64
+
+typedef struct {
+  int index;   // into the tracks library_load filled in
+  Track track; // with fresh tags, size and mtime
+} LibraryChange;
+
+// Control thread. The index as of the last save into `tracks`, which must
+// be empty; false and left empty when there is none.
+bool library_load(TrackStore *tracks);
+// Check the loaded entries against the files in the background; false if
+// there is nothing to check or the check could not start
+bool library_validate_start(void);
+// Next entry that turned out to have changed on disk
+bool library_poll_change(LibraryChange *out);
+// Once the check has finished (true at most once): entries whose file is
+// gone, `*missing` (free()) marks them by index
+bool library_take_missing(bool **missing, int *count);
+// Stops the check, then writes `tracks` and the roots as the new index
+bool library_save(const TrackStore *tracks);
+void library_shutdown(void);
+
+// A file's tags and length into `t`, defaults where it has none; any thread
+void library_read_track(const char *path, uint64_t size, uint64_t mtime,
+                        Track *t);
+
+// Folders added to the library, kept in the index
+void library_add_root(const char *folder);
+int library_root_count(void);
+const char *library_root(int index);
+
+#endif
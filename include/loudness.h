@@ -0,0 +1,57 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include "kernels.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// EBU R128 / ITU-R BS.1770 meter for interleaved stereo float: integrated
+// loudness over K-weighted, gated 400 ms blocks, and true peak from 4x
+// oversampling. Memory is fixed; block loudness goes into a histogram.
+
+#define LOUDNESS_HIST_BINS 1000 // 0.1 LU bins from -70 to +30 LUFS
+#define LOUDNESS_TP_TAPS 16     // per oversampling phase
+#define LOUDNESS_CHUNK 4096     // frames filtered per pass
+
+typedef struct {
+  double b0, b1, b2, a1, a2;
+  double z1[2], z2[2]; // per channel
+} LoudnessBiquad;
+
+typedef struct {
+  long rate;
+  LoudnessBiquad shelf; // K-weighting stage 1: high shelf
+  LoudnessBiquad hpf;   // stage 2: RLB high-pass
+
+  // Gating blocks are 400 ms, stepped every 100 ms
+  size_t sub_len;      // frames per 100 ms
+  size_t sub_pos;      // frames in the current sub-block
+  double sub_sum;      // weighted energy of the current sub-block
+  double sub_ring[4];  // the last four sub-blocks
+  unsigned sub_filled; // up to 4
+
+  uint32_t hist_count[LOUDNESS_HIST_BINS];
+  double hist_energy[LOUDNESS_HIST_BINS];
+
+  // True peak: planar input with LOUDNESS_TP_TAPS - 1 frames of history
+  float tp_coeffs[3][LOUDNESS_TP_TAPS]; // phases 1..3; phase 0 is the input
+  float *tp_hist[2];
+  float peak;
+  const AudioKernels *kernels;
+
+  uint64_t frames;
+} LoudnessMeter;
+
+bool loudness_init(LoudnessMeter *m, long rate);
+void loudness_free(LoudnessMeter *m);
+void loudness_add(LoudnessMeter *m, const float *stereo, size_t frames);
+
+// Gated integrated loudness in LUFS; LOUDNESS_SILENT if nothing passed
+// the absolute gate
+#define LOUDNESS_SILENT (-70.0)
+double loudness_integrated(const LoudnessMeter *m);
+double loudness_true_peak(const LoudnessMeter *m); // linear, 1.0 = 0 dBTP
+
+#endif
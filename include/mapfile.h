@@ -0,0 +1,39 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only whole-file memory mappings, shared per path: probing, tag
+// parsing and decoding of a file all read the same pages instead of each
+// going through its own buffered reads. The last few released mappings
+// stay open, so reading tags and then loading the file maps it once.
+// Safe from any thread.
+
+typedef struct MappedFile MappedFile;
+
+struct MappedFile {
+  const unsigned char *data;
+  size_t size;
+  uint64_t mtime; // as mapped; with the size, tells whether the file changed
+};
+
+// NULL if the file cannot be opened or is empty
+MappedFile *mapfile_open(const char *filepath);
+void mapfile_release(MappedFile *mf);
+// Ask the OS to start reading a range in now (a hint; may do nothing)
+void mapfile_prefetch(MappedFile *mf, size_t offset, size_t len);
+
+// Sequential reader over a mapping for callback-style decoder IO. Reads
+// prefetch ahead of themselves.
+typedef struct {
+  MappedFile *map;
+  size_t pos;
+  size_t prefetched; // end of the range already hinted
+} MapReader;
+
+size_t mapreader_read(MapReader *r, void *dst, size_t len);
+int64_t mapreader_seek(MapReader *r, int64_t offset, int whence); // or -1
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef MPEGAUDIO_H
+#define MPEGAUDIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// MPEG audio (MP1/MP2/MP3) length from frame headers alone, so a track's
+// duration is known when it is added rather than once it has played.
+
+// Seconds of audio in a whole file's bytes. Uses the frame count of a
+// Xing/Info or VBRI header in the first frame (less the LAME encoder
+// delay and padding), otherwise bitrate and size, which is exact for CBR.
+// `exact` walks every frame header instead: no decoding, but it reads
+// the whole file. 0 if no frames are found.
+double mpeg_audio_duration(const unsigned char *data, size_t size,
+                           bool exact);
+
+#endif
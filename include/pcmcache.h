@@ -0,0 +1,35 @@
+#ifndef PCMCACHE_H
+#define PCMCACHE_H
+
+#include "decoder.h"
+
+#include <stddef.h>
+
+// Decoded PCM of recently played tracks, kept so that replaying one
+// (repeat, "previous", play again after the end) reads memory instead of
+// the file and the codec. A track is recorded while it is first decoded
+// from the start and kept only once it has been decoded to the end. The
+// least recently used tracks go first when the memory limit is reached.
+//
+// Not thread-safe: only call from the control thread. Decoders it hands
+// out are read from the decoder thread as usual.
+
+#define PCMCACHE_DEFAULT_LIMIT ((size_t)128 << 20) // about 12 min of 44.1k
+
+// How tracks are held. int16 takes half the memory of float32 and is
+// converted back with the SIMD kernels as it is read; float32 replays
+// exactly what the codec produced.
+typedef enum { PCMCACHE_INT16, PCMCACHE_FLOAT32 } PcmCacheFormat;
+
+// Cached playback when the whole track is held and the file has not
+// changed since; otherwise the regular backend, recording into the cache
+// if the track fits. Close with decoder_close on the control thread.
+Decoder *pcmcache_open(const char *filepath);
+// 0 turns caching off; tracks over the new limit are dropped right away
+void pcmcache_set_limit(size_t bytes);
+// For tracks recorded from now on; the default is PCMCACHE_INT16
+void pcmcache_set_format(PcmCacheFormat format);
+size_t pcmcache_bytes(void); // held, including recordings in progress
+void pcmcache_clear(void);   // drops every track not in use
+
+#endif
@@ -1,27 +1,43 @@
 #ifndef PLAYER_H
 #define PLAYER_H
 
+#include "audio.h"
+#include "replaygain.h"
+
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum { PLAYER_STOPPED, PLAYER_PLAYING, PLAYER_PAUSED } PlayerState;
 
 typedef enum { REPEAT_NONE = 0, REPEAT_ONE, REPEAT_ALL } RepeatMode;
 
+typedef enum {
+  PLAYER_EVENT_NONE,
+  PLAYER_EVENT_FINISHED, // track ended with nothing spliced after it
+  PLAYER_EVENT_ADVANCED  // playback moved on to next_track without a gap
+} PlayerEvent;
+
 typedef struct {
   char title[256];
   char artist[256];
   char album[256];
   double duration;
   char filepath[1024];
+  uint64_t size, mtime; // of the file when the tags were read; 0 unknown
 } Track;
 
 typedef struct {
   PlayerState state;
   Track current_track;
+  Track next_track; // primed for gapless hand-over, valid if has_next
+  bool has_next;
   double position;
   double volume;
   RepeatMode repeat_mode;
   bool shuffle;
+  double crossfade; // seconds, 0 = gapless
+  ReplayGainMode gain_mode;
+  int eq_preset; // see eq_preset_name
 } Player;
 
 // Player control functions
@@ -32,8 +48,24 @@ void player_pause(Player *player);
 void player_stop(Player *player);
 void player_seek(Player *player, double position);
 void player_set_volume(Player *player, double volume);
-bool player_update(Player *player);
+void player_set_crossfade(Player *player, double seconds);
+void player_set_gain_mode(Player *player, ReplayGainMode mode);
+// Wraps around past the last preset
+void player_set_eq_preset(Player *player, int preset);
+PlayerEvent player_update(Player *player);
 void player_cleanup(void);
+// Output buffering per audio_set_buffering/audio_set_adaptive_latency
+void player_set_output_buffering(unsigned frames, double latency,
+                                 bool adaptive);
+// Latest output for visualizers, per audio_tap_read
+bool player_tap_read(float *dst, size_t frames, long *rate);
+// Output callback statistics of the engine
+void player_get_audio_stats(AudioStats *out);
+// Write the statistics as JSON to `path` in player_cleanup (NULL: don't)
+void player_set_stats_dump(const char *path);
+
+bool player_queue_next(Player *player, const char *filepath);
+void player_clear_next(Player *player);
 
 void player_fill_metadata_from_file(const char *filepath, Track *track);
 
@@ -0,0 +1,8 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+// Headless playback through an offline sink, run with
+// `musicplayer render [options] <null|out.wav|out.raw> <files...>`
+int render_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef REPLAYGAIN_H
+#define REPLAYGAIN_H
+
+#include <stdbool.h>
+
+// Background loudness analysis. A small pool of low-priority workers runs
+// every requested file through the EBU R128 meter; results persist in an
+// on-disk cache keyed by path, size and mtime, so each file is only ever
+// analysed once.
+
+#define REPLAYGAIN_REFERENCE_LUFS (-18.0) // ReplayGain 2.0 target
+
+typedef enum {
+  REPLAYGAIN_OFF,
+  REPLAYGAIN_TRACK,
+  REPLAYGAIN_ALBUM, // falls back to track gain until the album is complete
+  REPLAYGAIN_MODE_COUNT
+} ReplayGainMode;
+
+typedef struct {
+  double lufs;    // integrated loudness
+  double peak;    // true peak, linear
+  double seconds; // analysed length
+} LoudnessInfo;
+
+typedef struct {
+  int pending;          // queued or being analysed
+  int done;             // analysed since the queue last ran empty
+  double files_per_sec; // over the same period
+} ReplayGainProgress;
+
+// Workers call this between chunks and back off while it returns true,
+// so playback decoding is never short of CPU
+typedef bool (*ReplayGainYieldFn)(void *ctx);
+
+// Load the cache and start `workers` threads (0 = pick from core count)
+bool replaygain_init(int workers, ReplayGainYieldFn should_yield, void *ctx);
+void replaygain_shutdown(void); // stops the workers, saves the cache
+
+// Queue a file unless its cached result is still current. `album` groups
+// tracks for album gain together with the folder.
+void replaygain_request(const char *filepath, const char *album);
+bool replaygain_lookup(const char *filepath, LoudnessInfo *out);
+bool replaygain_lookup_album(const char *filepath, LoudnessInfo *out);
+void replaygain_get_progress(ReplayGainProgress *out);
+
+// Linear playback gain for a file under `mode`, clip-safe; 1.0 when the
+// file has not been analysed yet
+float replaygain_gain_for(const char *filepath, ReplayGainMode mode);
+const char *replaygain_mode_name(ReplayGainMode mode);
+
+#endif
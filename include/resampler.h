@@ -0,0 +1,55 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "kernels.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Band-limited polyphase resampler for interleaved stereo float. The rate
+// ratio is reduced to up/down; each of the `up` phases is a windowed-sinc
+// FIR evaluated with the active dot-product kernel.
+
+typedef enum {
+  RESAMPLER_FAST,   // 16 taps, for weak CPUs
+  RESAMPLER_MEDIUM, // 32 taps, transparent for most material
+  RESAMPLER_BEST,   // 64 taps, steep filter with high stopband attenuation
+  RESAMPLER_QUALITY_COUNT
+} ResamplerQuality;
+
+typedef struct {
+  long in_rate;
+  long out_rate;
+  ResamplerQuality quality;
+  unsigned up, down; // out_rate / in_rate == up / down
+  unsigned taps;     // per phase, multiple of 8
+  float *coeffs;     // up * taps, phase-major
+
+  // Planar input history; the next output reads hist[c][pos .. pos+taps)
+  float *hist[2];
+  size_t hist_cap; // frames
+  size_t hist_len;
+  size_t pos;
+  unsigned phase;
+
+  uint64_t in_total;  // real input frames since the last reset
+  uint64_t out_total; // output frames since the last reset
+  const AudioKernels *kernels;
+} Resampler;
+
+bool resampler_init(Resampler *rs, long in_rate, long out_rate,
+                    ResamplerQuality quality);
+void resampler_free(Resampler *rs);
+void resampler_reset(Resampler *rs); // drop history, keep the filter
+
+// Consume up to in_frames, produce up to out_frames; returns frames written
+size_t resampler_process(Resampler *rs, const float *in, size_t in_frames,
+                         size_t *in_used, float *out, size_t out_frames);
+// After the last input: emit the filter tail, returns 0 once complete
+size_t resampler_drain(Resampler *rs, float *out, size_t out_frames);
+
+size_t resampler_alloc_bytes(const Resampler *rs);
+const char *resampler_quality_name(ResamplerQuality quality);
+
+#endif
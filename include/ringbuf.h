@@ -0,0 +1,40 @@
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Single-producer / single-consumer ring of interleaved float samples.
+// One thread writes, one thread reads; neither side ever blocks.
+typedef struct {
+  float *data;
+  size_t capacity; // in samples, always a power of two
+  size_t mask;
+
+  atomic_size_t read_pos;  // total samples consumed (owned by reader)
+  atomic_size_t write_pos; // total samples produced (owned by writer)
+} RingBuffer;
+
+// Ring buffer functions
+bool ringbuf_init(RingBuffer *rb, size_t min_capacity);
+void ringbuf_free(RingBuffer *rb);
+void ringbuf_reset(RingBuffer *rb); // only while neither side is running
+size_t ringbuf_available(RingBuffer *rb);
+size_t ringbuf_space(RingBuffer *rb);
+size_t ringbuf_write(RingBuffer *rb, const float *src, size_t count);
+size_t ringbuf_read(RingBuffer *rb, float *dst, size_t count);
+
+// Zero-copy writing: fill up to the returned count at *dst, then commit
+size_t ringbuf_write_span(RingBuffer *rb, float **dst);
+void ringbuf_commit(RingBuffer *rb, size_t count);
+
+// Zero-copy reading: use up to the returned count at *src, then consume
+size_t ringbuf_read_span(RingBuffer *rb, const float **src);
+void ringbuf_consume(RingBuffer *rb, size_t count);
+
+size_t ringbuf_produced(RingBuffer *rb);                // writer position
+size_t ringbuf_consumed(RingBuffer *rb);                // reader position
+void ringbuf_discard_until(RingBuffer *rb, size_t pos); // reader side
+
+#endif
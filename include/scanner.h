@@ -0,0 +1,44 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include "player.h"
+#include "trackstore.h"
+
+#include <stdbool.h>
+
+// Adding folders in the background. One thread walks the directories and
+// feeds a bounded window of files to a pool of tag readers; finished
+// tracks come back in directory order for the playlist to take in
+// batches, so a slow disk or share never blocks the UI.
+
+#define SCANNER_MAX_WORKERS 8
+#define SCANNER_WINDOW 1024 // files between the walker and the playlist
+
+typedef struct {
+  bool active;          // walking or reading
+  int found;            // files the walker has listed this scan
+  int done;             // of those, read so far
+  double files_per_sec; // reading rate this scan
+} ScannerProgress;
+
+// Control thread. Queues a folder to walk, or a single file to read;
+// starts the threads on first use (0 workers = pick from the core count).
+// A path queued during a scan waits its turn.
+bool scanner_start(const char *path, int workers);
+// Control thread. Walk `folder` again as a diff against the playlist:
+// files `tracks` has with the same size and mtime are not read again, and
+// entries under the folder that the walk does not find are reported by
+// scanner_poll_gone once it is done.
+bool scanner_rescan(const char *folder, const TrackStore *tracks);
+// Next file a finished rescan expected but did not find
+bool scanner_poll_gone(char *path, size_t size);
+// Tracks ready to take, in the order the walker found them
+int scanner_ready(void);
+// Move up to `max` ready tracks into `out`; how many were moved
+int scanner_take(Track *out, int max);
+// Drop everything not read yet; tracks already read stay ready
+void scanner_cancel(void);
+void scanner_get_progress(ScannerProgress *out);
+void scanner_shutdown(void);
+
+#endif
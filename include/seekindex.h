@@ -0,0 +1,25 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include "mapfile.h"
+
+#include <mpg123.h>
+#include <stdbool.h>
+
+// Per-file cache of mpg123 frame indexes. Once a file has been decoded,
+// reopening it restores the index so seeks land directly on the right
+// frame, VBR included, without scanning from the start.
+//
+// The offsets are byte positions in the file, so an entry is tied to the
+// size and mtime of the mapping it was built from; once the file changes
+// (retagged, replaced) it is dropped instead of applied.
+//
+// Not thread-safe: only call from the control thread.
+
+void seekindex_store(const char *filepath, const MappedFile *map,
+                     mpg123_handle *mh);
+bool seekindex_apply(const char *filepath, const MappedFile *map,
+                     mpg123_handle *mh);
+void seekindex_clear(void);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Where the engine's mix goes. A sink pulls interleaved float32 from the
+// engine on a thread of its own: the sound card's, or for the offline
+// sinks one that runs as fast as the decoder can keep up.
+
+// render() status bits: what the device reported since the last call
+#define AUDIO_SINK_UNDERFLOW 1u // it ran dry and played a gap
+#define AUDIO_SINK_OVERFLOW 2u
+
+typedef struct {
+  // Fill `frames` frames. Never blocks; pads with silence on underrun.
+  void (*render)(float *out, size_t frames, unsigned status, void *user);
+  // Offline sinks only: false while render would underrun or has nothing
+  // to play, so their output does not depend on timing
+  bool (*ready)(size_t frames, void *user);
+  void *user;
+} AudioSinkCallbacks;
+
+// Buffering asked of a sink; zero fields leave the choice to it
+typedef struct {
+  unsigned frames; // per render call
+  double latency;  // seconds queued ahead of the speaker (devices only)
+} AudioSinkBuffering;
+
+typedef struct AudioSink AudioSink;
+
+typedef struct {
+  const char *name;
+  // Rate the sink runs at, 0 if it cannot run. Devices pick their own
+  // native rate; `fallback` is used when they have none and by offline
+  // sinks.
+  long (*native_rate)(const char *target, long fallback);
+  // Open and start pulling from `cb`
+  AudioSink *(*open)(const char *target, long rate, int channels,
+                     const AudioSinkBuffering *buffering,
+                     const AudioSinkCallbacks *cb);
+  // Does `target` still resolve to the device this sink is playing on?
+  bool (*is_current)(AudioSink *sink, const char *target);
+  void (*close)(AudioSink *sink); // stops pulling first
+} AudioSinkVTable;
+
+// Common header; sinks embed it as their first member
+struct AudioSink {
+  const AudioSinkVTable *vt;
+  long rate;
+  int channels;
+  unsigned frames; // per render call as opened, 0 if it varies
+  double latency;  // seconds, as reported once open
+};
+
+// Sinks. The target is ignored by the device and null sinks; the file
+// sinks write to it.
+extern const AudioSinkVTable sink_portaudio_vtable;
+extern const AudioSinkVTable sink_null_vtable; // simulated clock, no output
+extern const AudioSinkVTable sink_wav_vtable;  // 32-bit float WAV
+extern const AudioSinkVTable sink_raw_vtable;  // headerless float32
+
+// Sink for a user-given output: none or "" is the sound card, then
+// "null", a *.wav path, or any other path for raw float32
+const AudioSinkVTable *sink_for_target(const char *target);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <stddef.h>
+
+// Spectrum and level analysis of a short window of output, for display.
+// Hann-windowed real FFT, binned onto logarithmically spaced bands.
+
+#define SPECTRUM_FFT_SIZE 2048 // frames per analysis (~43 ms at 48 kHz)
+#define SPECTRUM_MAX_BANDS 128
+
+typedef struct Spectrum Spectrum;
+
+typedef struct {
+  int bands;
+  float band_db[SPECTRUM_MAX_BANDS]; // per band, dBFS-ish, about -90..0
+  float peak_db;                     // of the window, both channels
+  float rms_db;
+} SpectrumFrame;
+
+Spectrum *spectrum_create(void);
+void spectrum_free(Spectrum *sp);
+// `stereo` holds SPECTRUM_FFT_SIZE interleaved stereo frames at `rate`
+void spectrum_compute(Spectrum *sp, const float *stereo, long rate, int bands,
+                      SpectrumFrame *out);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef TAP_H
+#define TAP_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lock-free "last few milliseconds" buffer of interleaved float samples.
+// The writer never waits and simply overwrites the oldest samples; a
+// reader copies the newest ones out and finds out afterwards whether the
+// writer lapped it meanwhile. For meters and visualizers, which only ever
+// want recent audio and can skip a frame.
+typedef struct {
+  float *data;
+  size_t capacity; // in samples, always a power of two
+  size_t mask;
+  atomic_size_t write_pos; // total samples written
+  atomic_size_t claim_pos; // and the end of a write still in progress
+} AudioTap;
+
+bool tap_init(AudioTap *tap, size_t min_capacity);
+void tap_free(AudioTap *tap);
+void tap_write(AudioTap *tap, const float *src, size_t count);
+// Copy the newest `count` samples, oldest first. Returns false when fewer
+// have been written yet or the writer overwrote them while copying.
+bool tap_read_latest(AudioTap *tap, float *dst, size_t count);
+
+#endif
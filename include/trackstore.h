@@ -0,0 +1,77 @@
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+
+#include "player.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The playlist's tracks in compact form. Track, with its fixed arrays, is
+// nearly 2 KB; here each entry is a 32-byte record and its strings live in
+// one arena. Folder, artist and album repeat across an album's tracks, so
+// they are interned and shared as one group; file names and titles are
+// stored as they come. Lookup by full path is built in.
+//
+// Offsets into the arena stay valid as it grows, pointers into it only
+// until the next change to the store.
+
+typedef struct {
+  uint64_t size, mtime; // of the file when the tags were read; 0 unknown
+  uint32_t name;        // file name, in the arena
+  uint32_t title;       // in the arena
+  uint32_t group;       // folder, artist and album
+  float duration;       // seconds, 0 unknown
+} TrackRecord;
+
+typedef struct {
+  uint32_t folder; // up to and including the last separator
+  uint32_t artist, album;
+} TrackGroup;
+
+// Zero-initialized is empty. Fields past `count` are the store's own.
+typedef struct {
+  TrackRecord *records;
+  int count, cap;
+
+  char *strings; // arena; offset 0 is ""
+  size_t strings_len, strings_cap;
+  size_t strings_dead; // left behind by removed or retitled tracks
+
+  uint32_t *intern; // offset + 1 of each interned string, 0 = empty
+  size_t intern_cap, intern_used;
+
+  TrackGroup *groups;
+  uint32_t group_count, group_cap;
+  uint32_t *group_slots; // group + 1, 0 = empty
+  size_t group_slot_cap;
+
+  int *path_slots; // record + 1 by full path, 0 = empty
+  size_t path_cap;
+} TrackStore;
+
+void trackstore_free(TrackStore *s);
+// Room for `count` records in all, so a batch appends without regrowing
+bool trackstore_reserve(TrackStore *s, int count);
+// Append a track; its position, or -1 when out of memory. A path already
+// in the store keeps finding the first entry.
+int trackstore_add(TrackStore *s, const Track *t);
+// New tags, duration, size and mtime for the file at `index`; the path in
+// `t` is not looked at
+bool trackstore_set(TrackStore *s, int index, const Track *t);
+// Drop the entries flagged in `remove` (the first `count` of the store)
+void trackstore_remove(TrackStore *s, const bool *remove, int count);
+
+// Position of the track with this path, or -1
+int trackstore_find(const TrackStore *s, const char *path);
+// The whole track at `index` into `out`
+void trackstore_get(const TrackStore *s, int index, Track *out);
+// Full path into `out`; false if it does not fit
+bool trackstore_path(const TrackStore *s, int index, char *out, size_t size);
+const char *trackstore_title(const TrackStore *s, int index);
+const char *trackstore_artist(const TrackStore *s, int index);
+const char *trackstore_album(const TrackStore *s, int index);
+// Heap the store holds, spare capacity included
+size_t trackstore_bytes(const TrackStore *s);
+
+#endif
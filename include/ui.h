@@ -6,6 +6,7 @@
 #endif
 
 #include "player.h"
+#include "trackstore.h"
 #include <minwindef.h>
 
 typedef enum { UI_MODE_FULL, UI_MODE_COMPACT } UiMode;
@@ -67,10 +68,11 @@ struct UIState {
   int height;
   bool should_quit;
 
-  Track *tracks;
-  int track_count;
+  TrackStore tracks; // the playlist
   int selected_index;
   int track_offset;
+  int next_index; // playlist index primed for gapless playback, or -1
+  double total_duration; // seconds over the playlist
 
   bool has_update;
   char latest_version[32];
@@ -94,6 +96,16 @@ void ui_draw(const Player *player, UIState *ui_state);
 void ui_handle_input(Player *player, UIState *ui_state);
 void ui_get_terminal_size(int *width, int *height);
 void ui_handle_track_end(Player *player, UIState *ui_state);
+void ui_handle_track_advanced(Player *player, UIState *ui_state);
+// Playlist from the library index at startup, checked in the background;
+// ui_library_update applies what the check finds, ui_library_close saves
+void ui_library_open(UIState *ui_state);
+void ui_library_update(Player *player, UIState *ui_state);
+void ui_library_close(const UIState *ui_state);
+// Take tracks the folder scanner has read into the playlist
+void ui_scan_update(Player *player, UIState *ui_state);
+// Apply what changed in the library folders since the last call
+void ui_watch_update(Player *player, UIState *ui_state);
 
 void ui_init_state(UIState *ui, UiMode mode);
 void ui_compute_layout(UIState *ui);
@@ -0,0 +1,39 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "decoder.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Keeping the playlist in step with the library folders while the app
+// runs. One thread waits on change notifications for every root; bursts
+// (a copy, an unzip, a tagger saving a whole album) are collected until
+// the folders go quiet and then reported once per path, already checked
+// against the disk.
+
+#define WATCHER_QUIET_MS 1000     // report once nothing changed for this long
+#define WATCHER_MAX_DELAY_MS 10000 // or at the latest this long after the first
+#define WATCHER_MAX_PENDING 4096   // more paths than this: rescan the root
+
+typedef enum {
+  WATCH_FILE,   // created or changed; size and mtime as on disk now
+  WATCH_FOLDER, // a folder appeared (created, moved or renamed in)
+  WATCH_GONE,   // a file or folder is no longer there
+  WATCH_RESCAN, // too much happened to follow; read the root again
+} WatchKind;
+
+typedef struct {
+  WatchKind kind;
+  char path[DECODER_PATH_MAX]; // UTF-8, full
+  uint64_t size, mtime;        // WATCH_FILE only
+} WatchEvent;
+
+// Control thread. Starts the watcher on first use; a folder already
+// watched, or inside one that is, is ignored.
+bool watcher_add_root(const char *folder);
+// Next change, in path order within each batch
+bool watcher_poll(WatchEvent *out);
+void watcher_shutdown(void);
+
+#endif
@@ -1,73 +1,1066 @@
 #include "audio.h"
-
-#include <mpg123.h>
-#include <portaudio.h>
+#include "decoder.h"
+#include "dsp.h"
+#include "kernels.h"
+#include "pcmcache.h"
+#include "resampler.h"
+#include "ringbuf.h"
+#include "seekindex.h"
+#include "sink.h"
+#include "tap.h"
 
 #include "windows.h"
+#include <math.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define AUDIO_RING_SAMPLES (1 << 16) // ~0.7 s of 48 kHz stereo decode-ahead
+#define AUDIO_DECODE_CHUNK 2048      // float samples per decoder_read
+#define AUDIO_CMD_QUEUE_SIZE 64      // power of two
+#define AUDIO_TAP_SAMPLES (1 << 14)  // recent output kept for visualizers
+#define AUDIO_NO_BOUNDARY ((size_t)-1)
+#define AUDIO_MAX_CROSSFADE_MS 12000
+#define AUDIO_SINK_TARGET_MAX 1024
+#define AUDIO_MAX_LATENCY_LEVEL 4 // adaptive: up to 16x the configured buffer
+#define AUDIO_MAX_LATENCY 0.5     // seconds; well inside the ring
+#define AUDIO_MAX_BUFFER_FRAMES 8192
+#define AUDIO_TUNE_SETTLE_S 2.0  // between two steps up
+#define AUDIO_TUNE_STABLE_S 60.0 // played without underflows per step down
+
+// Control thread -> callback messages. The callback never blocks or
+// allocates; everything it needs to change arrives through this queue.
+typedef enum {
+  AUDIO_CMD_PLAY,
+  AUDIO_CMD_PAUSE,
+  AUDIO_CMD_SET_VOLUME,
+  AUDIO_CMD_SET_GAIN, // loudness gain of the current track
+  AUDIO_CMD_FLUSH, // play from `ring`, drop PCM up to ring_pos, restart at
+                   // cursor, cancel any crossfade
+} AudioCommandType;
+
+typedef struct {
+  AudioCommandType type;
+  float volume;
+  float gain;
+  int ring;
+  size_t ring_pos;
+  size_t cursor;
+  size_t seq;
+} AudioCommand;
+
+// Lock-free single-producer / single-consumer command ring
+typedef struct {
+  AudioCommand items[AUDIO_CMD_QUEUE_SIZE];
+  atomic_size_t head; // next slot to pop (owned by the callback)
+  atomic_size_t tail; // next slot to push (owned by the control thread)
+} AudioCommandQueue;
+
+// Decoded input waiting for the resampler, one per decode stream
+typedef struct {
+  float *buf; // AUDIO_DECODE_CHUNK samples
+  size_t len;
+  size_t pos;
+  bool done; // decoder reached the end; drain the filter tail
+} DecodeStage;
+
+// A decoder opened ahead of time for gapless hand-over. Passed between the
+// control and decoder threads by atomic pointer exchange.
+typedef struct {
+  Decoder *dec;        // next track; after the splice, the finished one
+  Resampler resampler; // built on the control thread, swapped in with dec
+  double duration;     // estimate for the next track
+  float gain;          // its loudness gain; stays with the track it was
+                       // queued for, not with `dec`
+  size_t prev_samples; // exact length of the track it replaced
+} PrimedTrack;
+
+// Callback instrumentation. The callback is the only writer, so counters
+// are bumped with a relaxed load and store rather than a locked add.
+typedef struct {
+  _Atomic(uint64_t) callbacks;
+  _Atomic(uint64_t) underflows;
+  _Atomic(uint64_t) overflows;
+  _Atomic(uint64_t) starved;
+  _Atomic(uint64_t) time_hist[AUDIO_STATS_BUCKETS];
+  _Atomic(uint64_t) time_total; // performance counter ticks
+  _Atomic(uint64_t) time_max;
+  atomic_size_t frames; // of the last buffer
+  atomic_size_t fill;
+  atomic_size_t fill_min; // SIZE_MAX until the first primed callback
+} AudioStatCounters;
+
 struct AudioEngine {
-  PaStream *stream;
-  float *samples;      // interleaved float32 samples
-  size_t sample_count; // total float samples (frames * channels)
-  size_t play_cursor;  // current sample index
-  long sample_rate;
+  AudioSink *sink;
+  bool stream_running; // control thread only
+  const AudioSinkVTable *sink_vt; // used from the next stream (re)open
+  char sink_target[AUDIO_SINK_TARGET_MAX];
+  long sink_rate; // offline sinks; 0 = the first track's rate
+
+  // Output buffering (control thread). The adaptive mode asks for 2^level
+  // times the configured buffering.
+  AudioSinkBuffering buffering; // configured
+  AudioSinkBuffering opened;    // asked of the sink that is open
+  double base_latency;          // the device's, at level 0
+  bool adaptive_latency;
+  int latency_level;
+  const char *latency_reason; // of a change not applied yet
+  uint64_t tune_underflows;   // seen at the last tuning step
+  double tune_last;
+  double tune_stable; // seconds played since the last underflow
+  double tune_changed_at;
+  AudioLatencyChange latency_log[AUDIO_LATENCY_LOG];
+  size_t latency_changes;
+  // Decoded float32 samples, filled ahead of the callback. One ring holds
+  // the current track; the other only carries the incoming track of a
+  // crossfade, after which the two swap roles.
+  RingBuffer rings[2];
+  AudioCommandQueue commands;
+  long sample_rate; // stream rate; every track is resampled to it
   int channels;
 
+  // Owned by the callback while the stream runs; only changed via commands
+  float cb_volume;
+  float cb_gain;      // loudness gain of the current track
+  float cb_fade_gain; // and of the incoming one during a crossfade
+  bool cb_playing;
+  int cb_main; // ring being played
+  bool cb_fading;
+  size_t cb_fade_pos; // samples of the incoming track mixed so far
+  size_t cb_fade_len;
+
+  // Published by the callback for the control thread
+  atomic_size_t play_cursor; // samples handed to the device so far
+  atomic_bool finished;      // decoder hit EOF and the ring has drained
+  atomic_size_t flush_ack;   // seq of the last flush the callback applied
+  AudioStatCounters stats;
+  DspChain dsp; // effects on the output; prepared before the stream opens
+  DspStage *eq; // in `dsp`, set from the control thread
+  AudioTap tap; // what went out, after volume and effects
+  bool cb_primed;   // has played a full buffer since the last play/flush
+  int64_t qpc_freq; // performance counter ticks per second
+  int64_t qpc_start;
+
+  // Control thread view
   float volume;
-  bool playing;
+  bool play_requested;
+  bool loaded; // a track is open; `dec` is the decoder thread's to swap
+  size_t flush_seq;
 
-  double duration; // seconds
+  // Decoder thread: keeps the ring topped up from the open decoder
+  Decoder *dec;
+  ResamplerQuality resample_quality; // control thread; used on next setup
+  Resampler resampler; // in use when the track rate differs from the stream
+  DecodeStage stage;
+  int dec_main; // ring the current track is written to
+  HANDLE decoder_thread;
+  HANDLE decoder_wake;
+  atomic_bool decoder_quit;
+  atomic_bool decoder_eof;
+  atomic_size_t decoded_samples;
+  atomic_bool decode_behind; // current ring under half full, for throttling
+
+  // Gapless: at EOF the decoder splices `next` into the same ring and
+  // marks the ring position where it starts; the callback switches tracks
+  // exactly there.
+  _Atomic(PrimedTrack *) next;      // primed by the control thread
+  _Atomic(PrimedTrack *) spliced;   // handed back by the decoder thread
+  atomic_size_t boundary;           // ring position of the splice
+  _Atomic(float) splice_gain;       // gain from the boundary on
+  atomic_size_t track_changes;      // bumped by the callback at a boundary
+  atomic_size_t track_changes_seen; // written by the control thread
+
+  // Crossfade: shortly before the end of a track the decoder starts `next`
+  // in the other ring. The callback mixes both from fade_at on and makes
+  // the other ring current once the fade is complete; the decoder then
+  // hands the finished track back through `spliced`.
+  atomic_int crossfade_ms; // 0 = gapless splice instead
+  PrimedTrack *fading;     // decoder thread: the incoming track
+  DecodeStage fade_stage;
+  size_t fade_decoded; // decoder thread: incoming samples so far
+  bool fade_src_eof;
+  atomic_size_t fade_at;    // outgoing-ring position where the fade begins
+  atomic_size_t fade_start; // incoming-ring position of its first sample
+  atomic_size_t fade_len;   // samples
+  _Atomic(float) fade_gain; // of the incoming track
+  atomic_bool fade_eof;     // the incoming track already ended
+  atomic_bool fade_done;    // set by the callback, taken by the decoder
+
+  double duration; // seconds, estimate until the decoder reaches EOF
 };
 
 static bool g_audio_libs_initialized = false;
 
-static int pa_callback(const void *input, void *output,
-                       unsigned long frameCount,
-                       const PaStreamCallbackTimeInfo *timeInfo,
-                       PaStreamCallbackFlags statusFlags, void *userData) {
-  (void)input;
-  (void)timeInfo;
-  (void)statusFlags;
+static bool cmdqueue_push(AudioCommandQueue *q, const AudioCommand *cmd) {
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  if (tail - head >= AUDIO_CMD_QUEUE_SIZE)
+    return false;
+
+  q->items[tail & (AUDIO_CMD_QUEUE_SIZE - 1)] = *cmd;
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+static bool cmdqueue_pop(AudioCommandQueue *q, AudioCommand *cmd) {
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head == tail)
+    return false;
+
+  *cmd = q->items[head & (AUDIO_CMD_QUEUE_SIZE - 1)];
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return true;
+}
+
+// Runs on the audio thread (or on the control thread while no stream runs)
+static void apply_command(AudioEngine *engine, const AudioCommand *cmd) {
+  switch (cmd->type) {
+  case AUDIO_CMD_PLAY:
+    engine->cb_playing = true;
+    engine->cb_primed = false;
+    atomic_store_explicit(&engine->stats.fill_min, SIZE_MAX,
+                          memory_order_relaxed);
+    break;
+  case AUDIO_CMD_PAUSE:
+    engine->cb_playing = false;
+    break;
+  case AUDIO_CMD_SET_VOLUME:
+    engine->cb_volume = cmd->volume;
+    break;
+  case AUDIO_CMD_SET_GAIN:
+    engine->cb_gain = cmd->gain;
+    break;
+  case AUDIO_CMD_FLUSH:
+    engine->cb_main = cmd->ring;
+    engine->cb_fading = false;
+    atomic_store(&engine->fade_at, AUDIO_NO_BOUNDARY);
+    atomic_store(&engine->fade_done, false);
+    ringbuf_discard_until(&engine->rings[cmd->ring], cmd->ring_pos);
+    atomic_store_explicit(&engine->play_cursor, cmd->cursor,
+                          memory_order_relaxed);
+    atomic_store(&engine->boundary, AUDIO_NO_BOUNDARY);
+    atomic_store(&engine->finished, false);
+    atomic_store(&engine->flush_ack, cmd->seq);
+    engine->cb_primed = false;
+    atomic_store_explicit(&engine->stats.fill_min, SIZE_MAX,
+                          memory_order_relaxed);
+    break;
+  }
+}
+
+static void drain_commands(AudioEngine *engine) {
+  AudioCommand cmd;
+  while (cmdqueue_pop(&engine->commands, &cmd)) {
+    apply_command(engine, &cmd);
+  }
+}
+
+// Control thread only
+static void post_command(AudioEngine *engine, AudioCommand cmd) {
+  if (!engine->stream_running) {
+    // nobody else is consuming: apply in place
+    drain_commands(engine);
+    apply_command(engine, &cmd);
+    return;
+  }
+
+  // The callback drains the queue every buffer, so this only waits if
+  // more than AUDIO_CMD_QUEUE_SIZE commands were issued within one buffer.
+  while (!cmdqueue_push(&engine->commands, &cmd)) {
+    Sleep(1);
+  }
+}
+
+// Copy `count` samples out of the ring with the gain applied, using the
+// SIMD kernel on at most two contiguous spans.
+static size_t ring_read_gain(RingBuffer *rb, float *out, size_t count,
+                             float gain) {
+  GainCopyFn gain_copy = kernels_active()->gain_copy;
+  size_t done = 0;
+  while (done < count) {
+    const float *src;
+    size_t span = ringbuf_read_span(rb, &src);
+    if (span == 0)
+      break;
+    if (span > count - done)
+      span = count - done;
+    gain_copy(out + done, src, span, gain);
+    ringbuf_consume(rb, span);
+    done += span;
+  }
+  return done;
+}
+
+// Play the current ring, stopping at a pending crossfade. Handles the
+// gapless splice boundary.
+static size_t read_main(AudioEngine *engine, float *out, size_t count) {
+  RingBuffer *rb = &engine->rings[engine->cb_main];
+
+  // One bounds computation for the whole buffer
+  size_t avail = ringbuf_available(rb);
+  size_t want = count < avail ? count : avail;
+
+  size_t fade_at = atomic_load(&engine->fade_at);
+  if (fade_at != AUDIO_NO_BOUNDARY) {
+    size_t left = fade_at - ringbuf_consumed(rb);
+    if (want > left)
+      want = left;
+  }
+
+  // A splice point inside this buffer switches to the next track there
+  size_t until = want + 1;
+  size_t boundary = atomic_load(&engine->boundary);
+  if (boundary != AUDIO_NO_BOUNDARY)
+    until = boundary - ringbuf_consumed(rb);
 
-  AudioEngine *engine = (AudioEngine *)userData;
-  float *out = (float *)output;
+  size_t got = ring_read_gain(rb, out, until < want ? until : want,
+                              engine->cb_volume * engine->cb_gain);
 
-  unsigned long samples_requested =
-      frameCount * (unsigned long)engine->channels;
+  if (until <= want) {
+    // the rest of the buffer belongs to the next track, at its own gain
+    engine->cb_gain = atomic_load(&engine->splice_gain);
+    size_t rest = ring_read_gain(rb, out + got, want - got,
+                                 engine->cb_volume * engine->cb_gain);
+    atomic_store_explicit(&engine->play_cursor, rest, memory_order_relaxed);
+    atomic_store(&engine->boundary, AUDIO_NO_BOUNDARY);
+    atomic_fetch_add(&engine->track_changes, 1);
+    got += rest;
+  } else {
+    atomic_fetch_add_explicit(&engine->play_cursor, got,
+                              memory_order_relaxed);
+  }
+  return got;
+}
+
+// Has playback reached the point where the decoder started a crossfade?
+static bool fade_begin(AudioEngine *engine) {
+  size_t fade_at = atomic_load(&engine->fade_at);
+  RingBuffer *rb = &engine->rings[engine->cb_main];
+  if (fade_at == AUDIO_NO_BOUNDARY || ringbuf_consumed(rb) != fade_at)
+    return false;
+
+  ringbuf_discard_until(&engine->rings[engine->cb_main ^ 1],
+                        atomic_load(&engine->fade_start));
+  engine->cb_fading = true;
+  engine->cb_fade_pos = 0;
+  engine->cb_fade_len = atomic_load(&engine->fade_len);
+  engine->cb_fade_gain = atomic_load(&engine->fade_gain);
+  return true;
+}
+
+// Mix outgoing and incoming track with equal-power gains. The curve is
+// evaluated at both ends of the block and ramped linearly in between.
+static size_t mix_fade(AudioEngine *engine, float *out, size_t count) {
+  RingBuffer *from = &engine->rings[engine->cb_main];
+  RingBuffer *to = &engine->rings[engine->cb_main ^ 1];
+  size_t channels = (size_t)engine->channels;
+
+  size_t n = engine->cb_fade_len - engine->cb_fade_pos;
+  if (n > count)
+    n = count;
+  bool to_done = atomic_load(&engine->fade_eof); // before reading avail
+  size_t to_avail = ringbuf_available(to);
+  bool to_ended = to_done && to_avail < n;
+  if (n > to_avail)
+    n = to_avail;
+  n -= n % channels;
+
+  // outgoing track first (silence once it has ended)
+  size_t got = ring_read_gain(from, out, n, engine->cb_gain);
+  memset(out + got, 0, (n - got) * sizeof(float));
+
+  const float half_pi = 1.57079632679f;
+  float p0 = (float)engine->cb_fade_pos / (float)engine->cb_fade_len;
+  float p1 = (float)(engine->cb_fade_pos + n) / (float)engine->cb_fade_len;
+  float out0 = cosf(p0 * half_pi), out1 = cosf(p1 * half_pi);
+  float in0 = sinf(p0 * half_pi), in1 = sinf(p1 * half_pi);
+  size_t frames = n / channels;
+  float step = frames ? 1.0f / (float)frames : 0.0f;
+  float vol = engine->cb_volume;
+  float in_gain = engine->cb_fade_gain;
+
+  size_t done = 0;
+  while (done < n) {
+    const float *src;
+    size_t span = ringbuf_read_span(to, &src);
+    if (span > n - done)
+      span = n - done;
+    for (size_t i = 0; i < span; ++i) {
+      float t = (float)((done + i) / channels) * step;
+      float g_out = out0 + (out1 - out0) * t;
+      float g_in = in0 + (in1 - in0) * t;
+      out[done + i] = (out[done + i] * g_out + src[i] * g_in * in_gain) * vol;
+    }
+    ringbuf_consume(to, span);
+    done += span;
+  }
+
+  engine->cb_fade_pos += n;
+  if (engine->cb_fade_pos >= engine->cb_fade_len || to_ended) {
+    // The incoming track is now the current one
+    engine->cb_fading = false;
+    engine->cb_main ^= 1;
+    engine->cb_gain = engine->cb_fade_gain;
+    atomic_store_explicit(&engine->play_cursor, engine->cb_fade_pos,
+                          memory_order_relaxed);
+    atomic_store(&engine->fade_done, true);
+    atomic_store(&engine->fade_at, AUDIO_NO_BOUNDARY);
+    atomic_fetch_add(&engine->track_changes, 1);
+  } else {
+    atomic_fetch_add_explicit(&engine->play_cursor, n, memory_order_relaxed);
+  }
+  return n;
+}
+
+static void stat_add(_Atomic(uint64_t) *counter, uint64_t n) {
+  atomic_store_explicit(
+      counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+      memory_order_relaxed);
+}
+
+// Log2 bucket of a callback run time in microseconds
+static int stat_bucket(uint64_t us) {
+  int bucket = 0;
+  while (us > 0 && bucket < AUDIO_STATS_BUCKETS - 1) {
+    us >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
 
-  for (unsigned long i = 0; i < samples_requested; ++i) {
-    if (engine->playing && engine->play_cursor < engine->sample_count) {
-      out[i] = engine->samples[engine->play_cursor++] * engine->volume;
+// Account for one callback that started at performance counter `t0`
+static void stats_record(AudioEngine *engine, unsigned status, size_t frames,
+                         bool short_block, int64_t t0) {
+  AudioStatCounters *st = &engine->stats;
+  stat_add(&st->callbacks, 1);
+  if (status & AUDIO_SINK_UNDERFLOW)
+    stat_add(&st->underflows, 1);
+  if (status & AUDIO_SINK_OVERFLOW)
+    stat_add(&st->overflows, 1);
+
+  // Running dry while the ring refills after a play or seek is expected;
+  // only count it once a full buffer has been played
+  if (!engine->cb_playing || !short_block) {
+    engine->cb_primed = engine->cb_playing;
+  } else if (engine->cb_primed) {
+    stat_add(&st->starved, 1);
+  }
+
+  size_t fill = ringbuf_available(&engine->rings[engine->cb_main]);
+  atomic_store_explicit(&st->fill, fill, memory_order_relaxed);
+  atomic_store_explicit(&st->frames, frames, memory_order_relaxed);
+  if (engine->cb_primed &&
+      fill < atomic_load_explicit(&st->fill_min, memory_order_relaxed))
+    atomic_store_explicit(&st->fill_min, fill, memory_order_relaxed);
+
+  LARGE_INTEGER t1;
+  QueryPerformanceCounter(&t1);
+  uint64_t ticks = (uint64_t)(t1.QuadPart - t0);
+  stat_add(&st->time_total, ticks);
+  if (ticks > atomic_load_explicit(&st->time_max, memory_order_relaxed))
+    atomic_store_explicit(&st->time_max, ticks, memory_order_relaxed);
+  uint64_t us = ticks * 1000000u / (uint64_t)engine->qpc_freq;
+  stat_add(&st->time_hist[stat_bucket(us)], 1);
+}
+
+// The sink's render callback, on its audio thread
+static void audio_render(float *out, size_t frames, unsigned status,
+                         void *user) {
+  AudioEngine *engine = (AudioEngine *)user;
+  size_t samples_requested = frames * (size_t)engine->channels;
+  LARGE_INTEGER t0;
+  QueryPerformanceCounter(&t0);
+
+  drain_commands(engine);
+
+  // Outside a crossfade the other ring only holds leftovers of a finished
+  // or cancelled fade. Read its end before fade_at: the decoder publishes
+  // a new fade before writing to it.
+  RingBuffer *other = &engine->rings[engine->cb_main ^ 1];
+  size_t other_end = ringbuf_produced(other);
+  if (atomic_load(&engine->fade_at) == AUDIO_NO_BOUNDARY)
+    ringbuf_discard_until(other, other_end);
+
+  size_t got = 0;
+  if (engine->cb_playing) {
+    if (!engine->cb_fading)
+      got = read_main(engine, out, samples_requested);
+    if (!engine->cb_fading && got < samples_requested)
+      fade_begin(engine);
+    if (engine->cb_fading) {
+      got += mix_fade(engine, out + got, samples_requested - got);
+      // the fade may have completed inside this buffer
+      if (!engine->cb_fading)
+        got += read_main(engine, out + got, samples_requested - got);
+    }
+  }
+
+  // Underrun or paused: pad with silence
+  if (got < samples_requested)
+    memset(out + got, 0, (samples_requested - got) * sizeof(float));
+
+  // When the decoder is done and the ring is empty, mark as finished
+  if (engine->cb_playing && !engine->cb_fading &&
+      atomic_load(&engine->fade_at) == AUDIO_NO_BOUNDARY &&
+      !atomic_load(&engine->fade_done) &&
+      atomic_load(&engine->decoder_eof) &&
+      ringbuf_available(&engine->rings[engine->cb_main]) == 0) {
+    engine->cb_playing = false;
+    atomic_store(&engine->finished, true);
+  }
+
+  if (engine->channels == 2)
+    dsp_chain_process(&engine->dsp, out, frames);
+
+  // Visualizers read this on their own time; here it is only a copy
+  tap_write(&engine->tap, out, samples_requested);
+
+  stats_record(engine, status, frames, got < samples_requested, t0.QuadPart);
+}
+
+// Offline sinks ask before every block, on the same thread as
+// audio_render: only render once every ring in use holds the whole block
+// or has ended, so the output never contains an underrun.
+static bool audio_render_ready(size_t frames, void *user) {
+  AudioEngine *engine = (AudioEngine *)user;
+  size_t need = frames * (size_t)engine->channels;
+
+  drain_commands(engine);
+  if (!engine->cb_playing)
+    return false;
+  // a finished crossfade is being handed over; EOF state is in flux
+  if (atomic_load(&engine->fade_done))
+    return false;
+  // Let the control thread take each track change (and queue the track
+  // after it) before playing on, as it would in real time
+  if (atomic_load(&engine->track_changes) !=
+      atomic_load(&engine->track_changes_seen))
+    return false;
+
+  // EOF flags before ring levels, as in mix_fade
+  bool main_ended = atomic_load(&engine->decoder_eof);
+  bool ready = main_ended ||
+               ringbuf_available(&engine->rings[engine->cb_main]) >= need;
+  if (ready && (engine->cb_fading ||
+                atomic_load(&engine->fade_at) != AUDIO_NO_BOUNDARY)) {
+    bool in_ended = atomic_load(&engine->fade_eof);
+    ready = in_ended ||
+            ringbuf_available(&engine->rings[engine->cb_main ^ 1]) >= need;
+  }
+
+  if (!ready)
+    SetEvent(engine->decoder_wake);
+  return ready;
+}
+
+static void primed_track_free(PrimedTrack *pt) {
+  if (!pt)
+    return;
+  decoder_close(pt->dec);
+  resampler_free(&pt->resampler);
+  free(pt);
+}
+
+// Exchange the engine's decoder and resampler with the primed ones
+static void swap_decoder(AudioEngine *engine, PrimedTrack *pt) {
+  Decoder *dec = engine->dec;
+  engine->dec = pt->dec;
+  pt->dec = dec;
+
+  Resampler rs = engine->resampler;
+  engine->resampler = pt->resampler;
+  pt->resampler = rs;
+}
+
+// Build (or reuse) a filter from in_rate to the stream rate. No filter is
+// kept when the rates already match. Control thread only: allocates.
+static bool resampler_prepare(AudioEngine *engine, Resampler *rs,
+                              long in_rate) {
+  if (in_rate == engine->sample_rate) {
+    resampler_free(rs);
+    return true;
+  }
+
+  if (rs->coeffs && rs->in_rate == in_rate &&
+      rs->out_rate == engine->sample_rate &&
+      rs->quality == engine->resample_quality) {
+    resampler_reset(rs);
+    return true;
+  }
+
+  resampler_free(rs);
+  if (!resampler_init(rs, in_rate, engine->sample_rate,
+                      engine->resample_quality)) {
+    fprintf(stderr, "[audio] resampler setup failed (%ld -> %ld Hz)\n",
+            in_rate, engine->sample_rate);
+    return false;
+  }
+  fprintf(stderr, "[audio] resampling %ld -> %ld Hz (%s, %u taps)\n",
+          in_rate, engine->sample_rate,
+          resampler_quality_name(engine->resample_quality), rs->taps);
+  return true;
+}
+
+// Start a decode stream from a clean stage and filter history
+static void stage_reset(DecodeStage *st, Resampler *rs) {
+  st->len = st->pos = 0;
+  st->done = false;
+  if (rs->coeffs)
+    resampler_reset(rs);
+}
+
+// Decoder thread: decode into the stage, resample into dst. Reports
+// DECODER_DONE only after the filter tail has been written out.
+static DecoderResult decode_resampled(Decoder *dec, Resampler *rs,
+                                      DecodeStage *st, float *dst,
+                                      size_t max_samples, size_t *done) {
+  *done = 0;
+
+  if (st->pos == st->len && !st->done) {
+    size_t got = 0;
+    DecoderResult res = decoder_read(dec, st->buf, AUDIO_DECODE_CHUNK, &got);
+    if (res == DECODER_ERROR)
+      return res;
+    st->len = got;
+    st->pos = 0;
+    st->done = res == DECODER_DONE;
+  }
+
+  if (st->pos < st->len) {
+    size_t used = 0;
+    size_t frames = resampler_process(rs, st->buf + st->pos,
+                                      (st->len - st->pos) / 2, &used, dst,
+                                      max_samples / 2);
+    st->pos += used * 2;
+    *done = frames * 2;
+    return DECODER_OK;
+  }
+
+  if (!st->done)
+    return DECODER_OK;
+
+  size_t frames = resampler_drain(rs, dst, max_samples / 2);
+  *done = frames * 2;
+  return frames > 0 ? DECODER_OK : DECODER_DONE;
+}
+
+// Decoder thread: decode one chunk of a stream straight into its ring
+static DecoderResult decode_chunk(RingBuffer *rb, Decoder *dec, Resampler *rs,
+                                  DecodeStage *st, size_t *n) {
+  float *dst;
+  size_t span = ringbuf_write_span(rb, &dst);
+  if (span > AUDIO_DECODE_CHUNK)
+    span = AUDIO_DECODE_CHUNK;
+
+  *n = 0;
+  DecoderResult res = rs->coeffs
+                          ? decode_resampled(dec, rs, st, dst, span, n)
+                          : decoder_read(dec, dst, span, n);
+  ringbuf_commit(rb, *n);
+  return res;
+}
+
+// Decoder thread: continue with the primed next track in the same ring.
+// Fails (and the track simply ends) if nothing is primed or the previous
+// splice is still pending. The format was checked when it was primed.
+static bool decoder_splice_next(AudioEngine *engine) {
+  if (engine->fading || atomic_load(&engine->finished) ||
+      atomic_load(&engine->flush_ack) != engine->flush_seq ||
+      atomic_load(&engine->boundary) != AUDIO_NO_BOUNDARY ||
+      atomic_load(&engine->spliced) != NULL)
+    return false;
+
+  PrimedTrack *pt = atomic_exchange(&engine->next, NULL);
+  if (!pt)
+    return false;
+
+  atomic_store(&engine->splice_gain, pt->gain);
+  swap_decoder(engine, pt);
+  pt->prev_samples = atomic_load(&engine->decoded_samples);
+  stage_reset(&engine->stage, &engine->resampler);
+
+  atomic_store(&engine->decoded_samples, 0);
+  atomic_store(&engine->spliced, pt);
+  atomic_store(&engine->boundary,
+               ringbuf_produced(&engine->rings[engine->dec_main]));
+  atomic_store(&engine->decoder_eof, false);
+  return true;
+}
+
+// Decoder thread: start the primed next track in the other ring once the
+// current one is within the crossfade length of its end.
+static void fade_try_start(AudioEngine *engine) {
+  int ms = atomic_load(&engine->crossfade_ms);
+  if (ms <= 0 || engine->fading || atomic_load(&engine->decoder_eof) ||
+      atomic_load(&engine->finished) ||
+      atomic_load(&engine->flush_ack) != engine->flush_seq ||
+      atomic_load(&engine->boundary) != AUDIO_NO_BOUNDARY ||
+      atomic_load(&engine->spliced) != NULL ||
+      atomic_load(&engine->next) == NULL)
+    return;
+
+  // The callback clears leftovers from the last fade first
+  RingBuffer *in_ring = &engine->rings[engine->dec_main ^ 1];
+  if (ringbuf_available(in_ring) != 0)
+    return;
+
+  size_t channels = (size_t)engine->channels;
+  double duration = decoder_duration(engine->dec);
+  if (duration <= 0.0)
+    return; // unknown length: splice at EOF instead
+
+  size_t total = (size_t)(duration * (double)engine->sample_rate) * channels;
+  size_t len =
+      (size_t)((double)ms / 1000.0 * (double)engine->sample_rate) * channels;
+  if (len > total / 2)
+    len = total / 2; // short track: fade over its second half at most
+  len -= len % channels;
+  if (len == 0 || atomic_load(&engine->decoded_samples) + len < total)
+    return;
+
+  PrimedTrack *pt = atomic_exchange(&engine->next, NULL);
+  if (!pt)
+    return;
+
+  size_t in_total =
+      (size_t)(pt->duration * (double)engine->sample_rate) * channels;
+  if (in_total > 0 && len > in_total / 2) {
+    len = in_total / 2;
+    len -= len % channels;
+  }
+
+  engine->fading = pt;
+  engine->fade_decoded = 0;
+  engine->fade_src_eof = false;
+  stage_reset(&engine->fade_stage, &pt->resampler);
+
+  // Everything the callback needs goes out before fade_at, and fade_at
+  // before the first incoming sample
+  atomic_store(&engine->fade_eof, false);
+  atomic_store(&engine->fade_start, ringbuf_produced(in_ring));
+  atomic_store(&engine->fade_len, len);
+  atomic_store(&engine->fade_gain, pt->gain);
+  atomic_store(&engine->fade_at,
+               ringbuf_produced(&engine->rings[engine->dec_main]));
+}
+
+// The callback completed the fade: the incoming track becomes current and
+// the outgoing decoder goes back to the control thread. Decoder thread,
+// or control thread while the decoder thread is stopped.
+static void fade_finish(AudioEngine *engine) {
+  PrimedTrack *pt = engine->fading;
+  engine->fading = NULL;
+
+  swap_decoder(engine, pt);
+  DecodeStage st = engine->stage;
+  engine->stage = engine->fade_stage;
+  engine->fade_stage = st;
+  engine->dec_main ^= 1;
+
+  pt->prev_samples = atomic_load(&engine->decoded_samples);
+  atomic_store(&engine->decoded_samples, engine->fade_decoded);
+  atomic_store(&engine->decoder_eof, engine->fade_src_eof);
+  atomic_store(&engine->spliced, pt);
+}
+
+static DWORD WINAPI decoder_thread_main(LPVOID arg) {
+  AudioEngine *engine = (AudioEngine *)arg;
+
+  while (!atomic_load(&engine->decoder_quit)) {
+    // The callback finished a crossfade; the flag stays set until the
+    // hand-over is complete, so it never sees the old track's EOF state
+    if (engine->fading && atomic_load(&engine->fade_done)) {
+      fade_finish(engine);
+      atomic_store(&engine->fade_done, false);
+      continue;
+    }
+
+    // A next track may be primed after we already hit the end
+    if (atomic_load(&engine->decoder_eof) && decoder_splice_next(engine))
+      continue;
+
+    fade_try_start(engine);
+
+    // During a fade both streams are decoded; serve the emptier ring.
+    // The incoming one was filled up well before the fade became audible.
+    RingBuffer *main_ring = &engine->rings[engine->dec_main];
+    RingBuffer *in_ring = &engine->rings[engine->dec_main ^ 1];
+    size_t main_space =
+        atomic_load(&engine->decoder_eof) ? 0 : ringbuf_space(main_ring);
+    size_t in_space = engine->fading && !engine->fade_src_eof
+                          ? ringbuf_space(in_ring)
+                          : 0;
+    atomic_store_explicit(&engine->decode_behind,
+                          main_space > main_ring->capacity / 2,
+                          memory_order_relaxed);
+
+    // Nothing to do until the callback has drained some space
+    if (main_space < AUDIO_DECODE_CHUNK && in_space < AUDIO_DECODE_CHUNK) {
+      WaitForSingleObject(engine->decoder_wake, 10);
+      continue;
+    }
+
+    size_t n = 0;
+    if (main_space >= in_space) {
+      // Backends write float32 straight into the ring: no staging copy
+      DecoderResult res = decode_chunk(main_ring, engine->dec,
+                                       &engine->resampler, &engine->stage, &n);
+      atomic_fetch_add(&engine->decoded_samples, n);
+
+      if (res == DECODER_DONE) {
+        if (!decoder_splice_next(engine))
+          atomic_store(&engine->decoder_eof, true);
+      } else if (res == DECODER_ERROR) {
+        atomic_store(&engine->decoder_eof, true);
+      }
     } else {
-      out[i] = 0.0f;
+      PrimedTrack *pt = engine->fading;
+      DecoderResult res = decode_chunk(in_ring, pt->dec, &pt->resampler,
+                                       &engine->fade_stage, &n);
+      engine->fade_decoded += n;
+
+      if (res != DECODER_OK) {
+        engine->fade_src_eof = true;
+        atomic_store(&engine->fade_eof, true);
+      }
+    }
+  }
+
+  return 0;
+}
+
+static bool decoder_start(AudioEngine *engine) {
+  atomic_store(&engine->decoder_quit, false);
+  engine->decoder_thread =
+      CreateThread(NULL, 0, decoder_thread_main, engine, 0, NULL);
+  if (!engine->decoder_thread) {
+    fprintf(stderr, "[audio] failed to start decoder thread\n");
+    return false;
+  }
+  return true;
+}
+
+static void decoder_stop(AudioEngine *engine) {
+  if (!engine->decoder_thread)
+    return;
+  atomic_store(&engine->decoder_quit, true);
+  SetEvent(engine->decoder_wake);
+  WaitForSingleObject(engine->decoder_thread, INFINITE);
+  CloseHandle(engine->decoder_thread);
+  engine->decoder_thread = NULL;
+  atomic_store(&engine->decode_behind, false);
+}
+
+// Re-position the decoder at `seconds` while the stream keeps running. The
+// callback drops whatever was decoded before this point when it sees the
+// flush, so it never observes a half-reset ring.
+static void decoder_restart_at(AudioEngine *engine, double seconds) {
+  decoder_stop(engine);
+
+  // A crossfade the callback already completed is handed over as usual;
+  // one still in progress is cancelled and its track primed again.
+  if (engine->fading) {
+    if (atomic_load(&engine->fade_done)) {
+      fade_finish(engine);
+      atomic_store(&engine->fade_done, false);
+    } else {
+      PrimedTrack *pt = engine->fading;
+      engine->fading = NULL;
+      decoder_seek(pt->dec, 0);
+      primed_track_free(atomic_exchange(&engine->next, pt));
     }
   }
 
-  // When we reach the end of buffer, mark as done
-  if (engine->play_cursor >= engine->sample_count) {
-    engine->playing = false;
-    return paComplete;
+  // Undo a splice the callback has not reached yet: the track being
+  // repositioned is still the one before the boundary.
+  PrimedTrack *pt = atomic_load(&engine->spliced);
+  if (pt && atomic_load(&engine->track_changes) ==
+                atomic_load(&engine->track_changes_seen)) {
+    atomic_store(&engine->spliced, NULL);
+    swap_decoder(engine, pt);
+    decoder_seek(pt->dec, 0);
+    primed_track_free(atomic_exchange(&engine->next, pt));
+  }
+
+  // Seek in the track's own frames; the cursor counts stream frames
+  long in_rate = engine->dec->rate;
+  int64_t frame = (int64_t)(seconds * (double)in_rate);
+  int64_t landed = decoder_seek(engine->dec, frame);
+  if (landed >= 0)
+    frame = landed;
+  stage_reset(&engine->stage, &engine->resampler);
+
+  size_t out_frame =
+      (size_t)((double)frame * (double)engine->sample_rate / (double)in_rate);
+  size_t cursor = out_frame * (size_t)engine->channels;
+  atomic_store(&engine->decoder_eof, false);
+  atomic_store(&engine->decoded_samples, cursor);
+
+  AudioCommand cmd = {.type = AUDIO_CMD_FLUSH,
+                      .ring = engine->dec_main,
+                      .ring_pos =
+                          ringbuf_produced(&engine->rings[engine->dec_main]),
+                      .cursor = cursor,
+                      .seq = ++engine->flush_seq};
+  post_command(engine, cmd);
+
+  decoder_start(engine);
+}
+
+// Rewind the stream state; decoder thread and callback must be stopped
+static void reset_playback_state(AudioEngine *engine) {
+  drain_commands(engine);
+  ringbuf_reset(&engine->rings[0]);
+  ringbuf_reset(&engine->rings[1]);
+  engine->cb_main = engine->dec_main = 0;
+  engine->cb_fading = false;
+  atomic_store(&engine->fade_at, AUDIO_NO_BOUNDARY);
+  atomic_store(&engine->fade_done, false);
+  atomic_store(&engine->play_cursor, 0);
+  engine->cb_playing = false;
+  engine->cb_gain = 1.0f;
+  engine->play_requested = false;
+  atomic_store(&engine->finished, false);
+  atomic_store(&engine->flush_ack, engine->flush_seq);
+  atomic_store(&engine->decoder_eof, false);
+  atomic_store(&engine->decoded_samples, 0);
+  atomic_store(&engine->boundary, AUDIO_NO_BOUNDARY);
+  atomic_store(&engine->track_changes_seen,
+               atomic_load(&engine->track_changes));
+}
+
+static void stream_close(AudioEngine *engine) {
+  if (engine->sink) {
+    engine->sink->vt->close(engine->sink);
+    engine->sink = NULL;
+  }
+  engine->stream_running = false;
+}
+
+static double engine_now(AudioEngine *engine) {
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (double)(t.QuadPart - engine->qpc_start) / (double)engine->qpc_freq;
+}
+
+// What to ask of the sink at the current adaptive level
+static AudioSinkBuffering wanted_buffering(AudioEngine *engine) {
+  AudioSinkBuffering b = engine->buffering;
+  int level = engine->latency_level;
+  if (level > 0) {
+    double base = b.latency > 0.0 ? b.latency : engine->base_latency;
+    b.frames <<= level;
+    b.latency = base * (double)(1 << level);
+    if (b.frames > AUDIO_MAX_BUFFER_FRAMES)
+      b.frames = AUDIO_MAX_BUFFER_FRAMES;
+    if (b.latency > AUDIO_MAX_LATENCY)
+      b.latency = AUDIO_MAX_LATENCY;
+  }
+  return b;
+}
+
+static bool buffering_equal(AudioSinkBuffering a, AudioSinkBuffering b) {
+  return a.frames == b.frames && a.latency == b.latency;
+}
+
+static void log_latency_change(AudioEngine *engine) {
+  AudioSink *sink = engine->sink;
+  AudioLatencyChange *c =
+      &engine->latency_log[engine->latency_changes++ % AUDIO_LATENCY_LOG];
+  c->at = engine_now(engine);
+  c->level = engine->latency_level;
+  c->frames = sink->frames;
+  c->latency_ms = sink->latency * 1000.0;
+  c->wakeups = sink->frames ? (double)sink->rate / (double)sink->frames : 0.0;
+  c->reason = engine->latency_reason;
+  engine->latency_reason = NULL;
+
+  fprintf(stderr, "[audio] output latency %.1f ms, %u frames/buffer "
+                  "(level %d): %s\n",
+          c->latency_ms, c->frames, c->level, c->reason);
+}
+
+static bool stream_open(AudioEngine *engine, long rate, int channels) {
+  AudioSinkCallbacks cb = {
+      .render = audio_render, .ready = audio_render_ready, .user = engine};
+  AudioSinkBuffering buffering = wanted_buffering(engine);
+  dsp_chain_prepare(&engine->dsp, rate);
+  engine->sink = engine->sink_vt->open(engine->sink_target, rate, channels,
+                                       &buffering, &cb);
+  if (!engine->sink)
+    return false;
+  engine->stream_running = true;
+  engine->opened = buffering;
+  if (engine->latency_level == 0)
+    engine->base_latency = engine->sink->latency;
+  if (engine->latency_reason)
+    log_latency_change(engine);
+  return true;
+}
+
+// Reopen the output with the buffering wanted now. The rings and the
+// callback state carry over, so playback goes on where it was; only what
+// the device had queued is lost.
+static bool stream_reopen(AudioEngine *engine) {
+  stream_close(engine);
+  if (stream_open(engine, engine->sample_rate, engine->channels))
+    return true;
+  fprintf(stderr, "[audio] cannot reopen the output\n");
+  return false;
+}
+
+// Stop the decoder thread and close every decoder the engine holds
+static void release_decoders(AudioEngine *engine) {
+  decoder_stop(engine);
+
+  decoder_close(engine->dec);
+  engine->dec = NULL;
+  engine->loaded = false;
+  primed_track_free(engine->fading);
+  engine->fading = NULL;
+  primed_track_free(atomic_exchange(&engine->next, NULL));
+  primed_track_free(atomic_exchange(&engine->spliced, NULL));
+}
+
+static void close_current(AudioEngine *engine) {
+  stream_close(engine);
+  release_decoders(engine);
+  reset_playback_state(engine);
+  engine->duration = 0.0;
+}
+
+// Block until the callback has applied the latest flush (or give up after
+// a few buffers' worth of time if the device has stalled).
+static bool wait_for_flush(AudioEngine *engine) {
+  for (int i = 0; i < 200; ++i) {
+    if (atomic_load(&engine->flush_ack) == engine->flush_seq)
+      return true;
+    Sleep(1);
   }
+  return false;
+}
 
-  return paContinue;
+static void stats_init(AudioStatCounters *st) {
+  atomic_init(&st->callbacks, 0);
+  atomic_init(&st->underflows, 0);
+  atomic_init(&st->overflows, 0);
+  atomic_init(&st->starved, 0);
+  for (int i = 0; i < AUDIO_STATS_BUCKETS; ++i)
+    atomic_init(&st->time_hist[i], 0);
+  atomic_init(&st->time_total, 0);
+  atomic_init(&st->time_max, 0);
+  atomic_init(&st->frames, 0);
+  atomic_init(&st->fill, 0);
+  atomic_init(&st->fill_min, SIZE_MAX);
 }
 
 AudioEngine *audio_init(void) {
   if (!g_audio_libs_initialized) {
-    if (Pa_Initialize() != paNoError) {
-      fprintf(stderr, "PortAudio init failed\n");
-      return NULL;
-    }
-    if (mpg123_init() != MPG123_OK) {
-      fprintf(stderr, "mpg123 init failed\n");
-      Pa_Terminate();
-      return NULL;
-    }
     g_audio_libs_initialized = true;
+    kernels_init();
   }
 
   AudioEngine *engine = calloc(1, sizeof(AudioEngine));
@@ -76,7 +1069,85 @@ AudioEngine *audio_init(void) {
     return NULL;
   }
 
+  // Fixed-size decode-ahead buffers: memory does not depend on track length
+  if (!ringbuf_init(&engine->rings[0], AUDIO_RING_SAMPLES) ||
+      !ringbuf_init(&engine->rings[1], AUDIO_RING_SAMPLES)) {
+    fprintf(stderr, "Failed to allocate audio ring buffer\n");
+    ringbuf_free(&engine->rings[0]);
+    free(engine);
+    return NULL;
+  }
+
+  engine->stage.buf = malloc(AUDIO_DECODE_CHUNK * sizeof(float));
+  engine->fade_stage.buf = malloc(AUDIO_DECODE_CHUNK * sizeof(float));
+  if (!engine->stage.buf || !engine->fade_stage.buf) {
+    fprintf(stderr, "Failed to allocate resampler input buffer\n");
+    free(engine->stage.buf);
+    free(engine->fade_stage.buf);
+    ringbuf_free(&engine->rings[0]);
+    ringbuf_free(&engine->rings[1]);
+    free(engine);
+    return NULL;
+  }
+
+  // Optional: without it visualizers just have nothing to show
+  tap_init(&engine->tap, AUDIO_TAP_SAMPLES);
+  // Likewise the equaliser
+  dsp_chain_init(&engine->dsp);
+  engine->eq = eq_create();
+  if (!dsp_chain_add(&engine->dsp, engine->eq))
+    engine->eq = NULL;
+
+  engine->decoder_wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!engine->decoder_wake) {
+    tap_free(&engine->tap);
+    dsp_chain_free(&engine->dsp);
+    fprintf(stderr, "Failed to create decoder event\n");
+    free(engine->stage.buf);
+    free(engine->fade_stage.buf);
+    ringbuf_free(&engine->rings[0]);
+    ringbuf_free(&engine->rings[1]);
+    free(engine);
+    return NULL;
+  }
+
+  atomic_init(&engine->commands.head, 0);
+  atomic_init(&engine->commands.tail, 0);
+  atomic_init(&engine->play_cursor, 0);
+  atomic_init(&engine->finished, false);
+  atomic_init(&engine->flush_ack, 0);
+  atomic_init(&engine->decoder_quit, false);
+  atomic_init(&engine->decoder_eof, false);
+  atomic_init(&engine->decoded_samples, 0);
+  atomic_init(&engine->decode_behind, false);
+  atomic_init(&engine->next, NULL);
+  atomic_init(&engine->spliced, NULL);
+  atomic_init(&engine->boundary, AUDIO_NO_BOUNDARY);
+  atomic_init(&engine->splice_gain, 1.0f);
+  atomic_init(&engine->track_changes, 0);
+  atomic_init(&engine->track_changes_seen, 0);
+  atomic_init(&engine->crossfade_ms, 0);
+  atomic_init(&engine->fade_at, AUDIO_NO_BOUNDARY);
+  atomic_init(&engine->fade_start, 0);
+  atomic_init(&engine->fade_len, 0);
+  atomic_init(&engine->fade_gain, 1.0f);
+  atomic_init(&engine->fade_eof, false);
+  atomic_init(&engine->fade_done, false);
+  stats_init(&engine->stats);
+
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  engine->qpc_freq = freq.QuadPart;
+  LARGE_INTEGER start;
+  QueryPerformanceCounter(&start);
+  engine->qpc_start = start.QuadPart;
+
+  engine->sink_vt = &sink_portaudio_vtable;
+  engine->latency_reason = "initial";
+  engine->resample_quality = RESAMPLER_MEDIUM;
   engine->volume = 0.7f;
+  engine->cb_volume = engine->volume;
+  engine->cb_gain = 1.0f;
   return engine;
 }
 
@@ -84,187 +1155,146 @@ void audio_cleanup(AudioEngine *engine) {
   if (!engine)
     return;
 
-  if (engine->stream) {
-    Pa_StopStream(engine->stream);
-    Pa_CloseStream(engine->stream);
-    engine->stream = NULL;
-  }
+  close_current(engine);
 
-  free(engine->samples);
+  ringbuf_free(&engine->rings[0]);
+  ringbuf_free(&engine->rings[1]);
+  tap_free(&engine->tap);
+  dsp_chain_free(&engine->dsp);
+  resampler_free(&engine->resampler);
+  free(engine->stage.buf);
+  free(engine->fade_stage.buf);
+  CloseHandle(engine->decoder_wake);
   free(engine);
+  seekindex_clear();
+  pcmcache_clear();
 
   // For a small CLI app, we can skip Pa_Terminate/mpg123_exit here,
   // OS will clean on exit. If you want to be fancy, you can track
   // engine count and call Pa_Terminate/mpg123_exit when last is freed.
 }
 
-bool audio_load_file(AudioEngine *engine, const char *filename) {
-  if (!engine)
+// Loading the track that is already loaded rewinds it in place: decoder,
+// resampler and output all stay, nothing is reopened. Declines (and the
+// caller does a full load) mid-crossfade, mid-splice or when the output
+// would be opened differently now.
+static bool rewind_current(AudioEngine *engine, const char *filename) {
+  if (!engine->loaded || !engine->stream_running)
     return false;
 
-  // Stop current playback & reset state
-  if (engine->stream) {
-    Pa_StopStream(engine->stream);
-    Pa_CloseStream(engine->stream);
-    engine->stream = NULL;
-  }
-  free(engine->samples);
-  engine->samples = NULL;
-  engine->sample_count = 0;
-  engine->play_cursor = 0;
-  engine->duration = 0.0;
-  engine->playing = false;
-
-  // ---- Open and configure mpg123 ----
-  int err = 0;
-  mpg123_handle *mh = mpg123_new(NULL, &err);
-  if (!mh) {
-    fprintf(stderr, "[audio] mpg123_new failed: %s\n",
-            mpg123_plain_strerror(err));
+  // With the decoder thread stopped nothing is spliced behind our back,
+  // and engine->dec can be read
+  decoder_stop(engine);
+  AudioSink *sink = engine->sink;
+  long fallback = engine->sink_rate > 0 ? engine->sink_rate : engine->dec->rate;
+  if (strcmp(engine->dec->path, filename) != 0 ||
+      sink->vt != engine->sink_vt ||
+      !sink->vt->is_current(sink, engine->sink_target) ||
+      !buffering_equal(engine->opened, wanted_buffering(engine)) ||
+      sink->vt->native_rate(engine->sink_target, fallback) != sink->rate ||
+      engine->fading || atomic_load(&engine->spliced) != NULL) {
+    decoder_start(engine);
     return false;
   }
 
-  if (mpg123_open(mh, filename) != MPG123_OK) {
-    fprintf(stderr, "[audio] mpg123_open failed for %s\n", filename);
-    mpg123_delete(mh);
-    return false;
-  }
+  engine->play_requested = false;
+  post_command(engine, (AudioCommand){.type = AUDIO_CMD_PAUSE});
+  primed_track_free(atomic_exchange(&engine->next, NULL));
+  decoder_restart_at(engine, 0.0);
+  wait_for_flush(engine);
+  atomic_store(&engine->track_changes_seen,
+               atomic_load(&engine->track_changes));
 
-  long rate;
-  int channels, encoding;
-  if (mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK) {
-    fprintf(stderr, "[audio] mpg123_getformat failed\n");
-    mpg123_close(mh);
-    mpg123_delete(mh);
-    return false;
-  }
+  fprintf(stderr, "[audio] %s: rewound in place\n", filename);
+  return true;
+}
 
-  // Ask for 16-bit signed output, keep the same rate/channels
-  mpg123_format_none(mh);
-  if (mpg123_format(mh, rate, channels, MPG123_ENC_SIGNED_16) != MPG123_OK) {
-    fprintf(stderr, "[audio] mpg123_format failed\n");
-    mpg123_close(mh);
-    mpg123_delete(mh);
+bool audio_load_file(AudioEngine *engine, const char *filename) {
+  if (!engine)
     return false;
-  }
+  if (rewind_current(engine, filename))
+    return true;
 
-  // Re-query actual output format (mpg123 can adjust it)
-  if (mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK) {
-    fprintf(stderr, "[audio] mpg123_getformat (after format) failed\n");
-    mpg123_close(mh);
-    mpg123_delete(mh);
+  Decoder *dec = pcmcache_open(filename);
+  if (!dec)
     return false;
-  }
-
-  engine->sample_rate = rate;
-  engine->channels = channels;
 
-  // ---- Decode whole file to 16-bit buffer ----
-  unsigned char *buffer = NULL;
-  size_t buffer_size = 0;
-  size_t capacity = 0;
-  size_t done = 0;
-  const size_t chunk = 4096;
-
-  while (1) {
-    if (capacity - buffer_size < chunk) {
-      size_t new_capacity = capacity ? capacity * 2 : 65536;
-      unsigned char *new_buf = realloc(buffer, new_capacity);
-      if (!new_buf) {
-        fprintf(stderr, "[audio] Out of memory while decoding\n");
-        free(buffer);
-        mpg123_close(mh);
-        mpg123_delete(mh);
-        return false;
-      }
-      buffer = new_buf;
-      capacity = new_capacity;
-    }
+  int channels = dec->channels;
+  double duration = decoder_duration(dec);
 
-    err = mpg123_read(mh, buffer + buffer_size, chunk, &done);
-    buffer_size += done;
+  fprintf(stderr, "[audio] %s: rate=%ld, channels=%d, est. duration=%.2f s\n",
+          dec->vt->name, dec->rate, channels, duration);
 
-    if (err == MPG123_DONE)
-      break;
-    if (err != MPG123_OK && err != MPG123_NEW_FORMAT) {
-      fprintf(stderr, "[audio] mpg123_read error: %s\n", mpg123_strerror(mh));
-      free(buffer);
-      mpg123_close(mh);
-      mpg123_delete(mh);
-      return false;
-    }
+  // Run the output at its own native rate and resample tracks to it, so
+  // neither we nor the host API reopen or convert per track
+  long fallback = engine->sink_rate > 0 ? engine->sink_rate : dec->rate;
+  long rate = engine->sink_vt->native_rate(engine->sink_target, fallback);
+  if (rate <= 0) {
+    decoder_close(dec);
+    return false;
   }
 
-  mpg123_close(mh);
-  mpg123_delete(mh);
+  // The output stream outlives tracks; it is only rebuilt when the
+  // device, the sample format or the buffering actually changes.
+  AudioSink *sink = engine->sink;
+  bool reuse_stream =
+      engine->stream_running && sink->vt == engine->sink_vt &&
+      sink->rate == rate && sink->channels == channels &&
+      sink->vt->is_current(sink, engine->sink_target) &&
+      buffering_equal(engine->opened, wanted_buffering(engine));
 
-  // buffer now has 16-bit signed samples (all channels, interleaved)
-  size_t sample_count_int16 = buffer_size / sizeof(short);
-  short *sbuf = (short *)buffer;
+  if (reuse_stream) {
+    release_decoders(engine);
 
-  // Convert to float in [-1, 1]
-  engine->samples = malloc(sample_count_int16 * sizeof(float));
-  if (!engine->samples) {
-    fprintf(stderr, "[audio] Out of memory for float samples\n");
-    free(buffer);
-    return false;
-  }
+    // Drop the old track's PCM in the callback and start silent
+    engine->play_requested = false;
+    post_command(engine, (AudioCommand){.type = AUDIO_CMD_PAUSE});
+    atomic_store(&engine->decoder_eof, false);
+    atomic_store(&engine->decoded_samples, 0);
+    AudioCommand cmd = {.type = AUDIO_CMD_FLUSH,
+                        .ring = engine->dec_main,
+                        .ring_pos =
+                            ringbuf_produced(&engine->rings[engine->dec_main]),
+                        .cursor = 0,
+                        .seq = ++engine->flush_seq};
+    post_command(engine, cmd);
 
-  for (size_t i = 0; i < sample_count_int16; ++i) {
-    engine->samples[i] = (float)sbuf[i] / 32768.0f;
+    // Any boundary crossed before the flush belonged to the old track
+    wait_for_flush(engine);
+    atomic_store(&engine->track_changes_seen,
+               atomic_load(&engine->track_changes));
+  } else {
+    close_current(engine);
   }
-  free(buffer);
 
-  engine->sample_count =
-      sample_count_int16; // float samples (frames * channels)
-  engine->play_cursor = 0;
-
-  // ---- Duration from decoded buffer (single source of truth) ----
-  size_t frames = sample_count_int16 / (size_t)channels; // samples per channel
-  double dur_from_buffer = 0.0;
-  if (frames > 0 && rate > 0) {
-    dur_from_buffer = (double)frames / (double)rate;
+  engine->dec = dec;
+  engine->loaded = true;
+  engine->duration = duration;
+  // A reused stream has them already, and its callback reads them
+  if (!reuse_stream) {
+    engine->sample_rate = rate;
+    engine->channels = channels;
   }
-  engine->duration = dur_from_buffer;
-
-  fprintf(stderr,
-          "[audio] rate=%ld, channels=%d, total_samples=%zu, frames=%zu, "
-          "duration=%.2f s\n",
-          rate, channels, sample_count_int16, frames, engine->duration);
 
-  // ---- Setup PortAudio stream ----
-  PaStreamParameters outParams;
-  memset(&outParams, 0, sizeof(outParams));
-  outParams.device = Pa_GetDefaultOutputDevice();
-  if (outParams.device == paNoDevice) {
-    fprintf(stderr, "[audio] No default output device.\n");
+  if (!resampler_prepare(engine, &engine->resampler, dec->rate)) {
+    close_current(engine);
     return false;
   }
+  stage_reset(&engine->stage, &engine->resampler);
 
-  const PaDeviceInfo *info = Pa_GetDeviceInfo(outParams.device);
-  fprintf(stderr, "[audio] using device: %s\n", info ? info->name : "(null)");
-
-  outParams.channelCount = channels;
-  outParams.sampleFormat = paFloat32;
-  outParams.suggestedLatency = info->defaultLowOutputLatency;
-  outParams.hostApiSpecificStreamInfo = NULL;
+  fprintf(stderr, "[audio] PCM buffers: %zu bytes (fixed, independent of "
+                  "track length)\n",
+          audio_get_alloc_bytes(engine));
 
-  PaError paErr = Pa_OpenStream(&engine->stream, NULL, &outParams, (double)rate,
-                                paFramesPerBufferUnspecified, paClipOff,
-                                pa_callback, engine);
-  if (paErr != paNoError) {
-    fprintf(stderr, "[audio] Pa_OpenStream failed: %s\n",
-            Pa_GetErrorText(paErr));
-    engine->stream = NULL;
+  // ---- Start decoding ahead into the ring ----
+  if (!decoder_start(engine)) {
+    close_current(engine);
     return false;
   }
 
-  paErr = Pa_StartStream(engine->stream);
-  if (paErr != paNoError) {
-    fprintf(stderr, "[audio] Pa_StartStream failed: %s\n",
-            Pa_GetErrorText(paErr));
-    Pa_CloseStream(engine->stream);
-    engine->stream = NULL;
+  // ---- Open the output ----
+  if (!reuse_stream && !stream_open(engine, rate, channels)) {
+    close_current(engine);
     return false;
   }
 
@@ -272,22 +1302,50 @@ bool audio_load_file(AudioEngine *engine, const char *filename) {
 }
 
 void audio_play(AudioEngine *engine) {
-  if (!engine || !engine->stream)
+  if (!engine || !engine->sink)
     return;
-  engine->playing = true;
+  engine->play_requested = true;
+  post_command(engine, (AudioCommand){.type = AUDIO_CMD_PLAY});
 }
 
 void audio_pause(AudioEngine *engine) {
-  if (!engine || !engine->stream)
+  if (!engine || !engine->sink)
     return;
-  engine->playing = false;
+  engine->play_requested = false;
+  post_command(engine, (AudioCommand){.type = AUDIO_CMD_PAUSE});
 }
 
 void audio_stop(AudioEngine *engine) {
   if (!engine)
     return;
-  engine->playing = false;
-  engine->play_cursor = 0;
+  engine->play_requested = false;
+  post_command(engine, (AudioCommand){.type = AUDIO_CMD_PAUSE});
+
+  // Rewind to the start; the next play refills from there
+  if (engine->loaded)
+    decoder_restart_at(engine, 0.0);
+}
+
+void audio_seek(AudioEngine *engine, double seconds) {
+  if (!engine || !engine->loaded || engine->sample_rate <= 0)
+    return;
+
+  double duration = audio_get_duration(engine);
+  if (duration > 0.0 && seconds > duration)
+    seconds = duration;
+  if (seconds < 0.0)
+    seconds = 0.0;
+
+  LARGE_INTEGER freq, t0, t1;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t0);
+
+  decoder_restart_at(engine, seconds);
+
+  QueryPerformanceCounter(&t1);
+  fprintf(stderr, "[audio] seek to %.2f s took %.3f ms\n", seconds,
+          (double)(t1.QuadPart - t0.QuadPart) * 1000.0 /
+              (double)freq.QuadPart);
 }
 
 void audio_set_volume(AudioEngine *engine, float volume) {
@@ -298,24 +1356,350 @@ void audio_set_volume(AudioEngine *engine, float volume) {
   if (volume > 1.0f)
     volume = 1.0f;
   engine->volume = volume;
+  post_command(engine,
+               (AudioCommand){.type = AUDIO_CMD_SET_VOLUME, .volume = volume});
+}
+
+void audio_set_track_gain(AudioEngine *engine, float gain) {
+  if (!engine)
+    return;
+  if (gain < 0.0f)
+    gain = 0.0f;
+  post_command(engine,
+               (AudioCommand){.type = AUDIO_CMD_SET_GAIN, .gain = gain});
+}
+
+void audio_set_eq(AudioEngine *engine, const EqBand *bands, int count) {
+  if (!engine || !engine->eq)
+    return;
+  eq_set_bands(engine->eq, bands, count);
+}
+
+void audio_set_crossfade(AudioEngine *engine, double seconds) {
+  if (!engine)
+    return;
+  int ms = (int)(seconds * 1000.0 + 0.5);
+  if (ms < 0)
+    ms = 0;
+  if (ms > AUDIO_MAX_CROSSFADE_MS)
+    ms = AUDIO_MAX_CROSSFADE_MS;
+  atomic_store(&engine->crossfade_ms, ms);
+}
+
+bool audio_set_output(AudioEngine *engine, const char *target, long rate) {
+  if (!engine)
+    return false;
+  if (target && strlen(target) >= sizeof(engine->sink_target)) {
+    fprintf(stderr, "[audio] output path too long\n");
+    return false;
+  }
+
+  // The current track keeps playing where it was; the new output is used
+  // from the next load on
+  engine->sink_vt = sink_for_target(target);
+  snprintf(engine->sink_target, sizeof(engine->sink_target), "%s",
+           target ? target : "");
+  engine->sink_rate = rate > 0 ? rate : 0;
+  return true;
+}
+
+static void set_latency_level(AudioEngine *engine, int level,
+                              const char *reason) {
+  engine->latency_level = level;
+  engine->latency_reason = reason;
+  engine->tune_changed_at = engine_now(engine);
+  engine->tune_stable = 0.0;
+}
+
+void audio_set_buffering(AudioEngine *engine, unsigned frames,
+                         double latency) {
+  if (!engine)
+    return;
+  if (frames > AUDIO_MAX_BUFFER_FRAMES)
+    frames = AUDIO_MAX_BUFFER_FRAMES;
+  if (latency < 0.0)
+    latency = 0.0;
+  if (latency > AUDIO_MAX_LATENCY)
+    latency = AUDIO_MAX_LATENCY;
+  engine->buffering.frames = frames;
+  engine->buffering.latency = latency;
+  set_latency_level(engine, 0, "configured");
+}
+
+void audio_set_adaptive_latency(AudioEngine *engine, bool enabled) {
+  if (!engine)
+    return;
+  engine->adaptive_latency = enabled;
+  engine->tune_underflows = atomic_load(&engine->stats.underflows);
+  engine->tune_last = engine_now(engine);
+  if (!enabled && engine->latency_level > 0)
+    set_latency_level(engine, 0, "adaptive off");
+}
+
+void audio_tune_latency(AudioEngine *engine) {
+  if (!engine || !engine->stream_running)
+    return;
+  double now = engine_now(engine);
+  double dt = now - engine->tune_last;
+  engine->tune_last = now;
+  bool playing = audio_is_playing(engine);
+
+  if (engine->adaptive_latency) {
+    uint64_t underflows = atomic_load(&engine->stats.underflows);
+    if (underflows != engine->tune_underflows) {
+      engine->tune_underflows = underflows;
+      engine->tune_stable = 0.0;
+      // Step up at once, as playback is glitching anyway, but give each
+      // step time to take effect before judging it
+      if (engine->latency_level < AUDIO_MAX_LATENCY_LEVEL &&
+          now - engine->tune_changed_at >= AUDIO_TUNE_SETTLE_S) {
+        set_latency_level(engine, engine->latency_level + 1, "underflow");
+        stream_reopen(engine);
+      }
+      return;
+    }
+
+    if (playing && dt < 1.0) // a longer gap means we were not called
+      engine->tune_stable += dt;
+    if (engine->latency_level > 0 &&
+        engine->tune_stable >= AUDIO_TUNE_STABLE_S)
+      set_latency_level(engine, engine->latency_level - 1, "stable");
+  }
+
+  // Anything else waits for a pause: reopening mid-track is audible
+  if (!playing && !buffering_equal(engine->opened, wanted_buffering(engine)))
+    stream_reopen(engine);
+}
+
+void audio_set_resampler_quality(AudioEngine *engine,
+                                 ResamplerQuality quality) {
+  if (!engine || quality >= RESAMPLER_QUALITY_COUNT)
+    return;
+  engine->resample_quality = quality;
 }
 
 double audio_get_position(AudioEngine *engine) {
   if (!engine || engine->sample_rate == 0 || engine->channels == 0)
     return 0.0;
 
-  size_t frames_played = engine->play_cursor / (size_t)engine->channels;
+  size_t cursor =
+      atomic_load_explicit(&engine->play_cursor, memory_order_relaxed);
+  size_t frames_played = cursor / (size_t)engine->channels;
   return (double)frames_played / (double)engine->sample_rate;
 }
 
 double audio_get_duration(AudioEngine *engine) {
   if (!engine)
     return 0.0;
+
+  if (engine->channels <= 0 || engine->sample_rate <= 0)
+    return engine->duration;
+
+  // The decoder already moved on to the next track: this one is complete
+  PrimedTrack *pt = atomic_load(&engine->spliced);
+  if (pt && atomic_load(&engine->track_changes) ==
+                atomic_load(&engine->track_changes_seen)) {
+    size_t frames = pt->prev_samples / (size_t)engine->channels;
+    return (double)frames / (double)engine->sample_rate;
+  }
+
+  // Once the whole file has been decoded, the sample count is exact
+  if (atomic_load(&engine->decoder_eof)) {
+    size_t frames =
+        atomic_load(&engine->decoded_samples) / (size_t)engine->channels;
+    return (double)frames / (double)engine->sample_rate;
+  }
   return engine->duration;
 }
 
 bool audio_is_playing(AudioEngine *engine) {
   if (!engine)
     return false;
-  return engine->playing;
+  return engine->play_requested && !audio_is_finished(engine);
+}
+
+bool audio_decode_is_behind(AudioEngine *engine) {
+  if (!engine)
+    return false;
+  return atomic_load_explicit(&engine->decode_behind, memory_order_relaxed);
+}
+
+bool audio_is_finished(AudioEngine *engine) {
+  if (!engine)
+    return false;
+  // Ignore a stale flag from before a flush the callback has not seen yet
+  if (atomic_load(&engine->flush_ack) != engine->flush_seq)
+    return false;
+  return atomic_load(&engine->finished);
+}
+
+bool audio_queue_next(AudioEngine *engine, const char *filename, float gain) {
+  if (!engine)
+    return false;
+
+  PrimedTrack *pt = calloc(1, sizeof(PrimedTrack));
+  if (!pt)
+    return false;
+
+  pt->dec = pcmcache_open(filename);
+  if (!pt->dec) {
+    free(pt);
+    return false;
+  }
+
+  // The stream rate is fixed, so any track can be spliced in; its filter
+  // is built here so the decoder thread never allocates.
+  if (!resampler_prepare(engine, &pt->resampler, pt->dec->rate)) {
+    primed_track_free(pt);
+    return false;
+  }
+  pt->duration = decoder_duration(pt->dec);
+  pt->gain = gain;
+
+  // Replaces whatever was primed before
+  primed_track_free(atomic_exchange(&engine->next, pt));
+  return true;
+}
+
+void audio_clear_next(AudioEngine *engine) {
+  if (!engine)
+    return;
+  primed_track_free(atomic_exchange(&engine->next, NULL));
+}
+
+bool audio_take_track_change(AudioEngine *engine) {
+  if (!engine)
+    return false;
+
+  size_t changes = atomic_load(&engine->track_changes);
+  if (changes == atomic_load(&engine->track_changes_seen))
+    return false;
+
+  // The finished track's decoder comes back to us for closing. After a
+  // crossfade the decoder thread hands it over just after the callback
+  // switched; report the change once it has.
+  PrimedTrack *pt = atomic_exchange(&engine->spliced, NULL);
+  if (!pt)
+    return false;
+  atomic_store(&engine->track_changes_seen, changes);
+  engine->duration = pt->duration;
+  primed_track_free(pt);
+  return true;
+}
+
+size_t audio_get_alloc_bytes(AudioEngine *engine) {
+  if (!engine)
+    return 0;
+
+  // Decoding goes straight into the rings (through the small stages when
+  // resampling), so beyond them only the primed next-track bookkeeping is
+  // allocated per track.
+  size_t bytes = 2 * engine->rings[0].capacity * sizeof(float);
+  bytes += 2 * AUDIO_DECODE_CHUNK * sizeof(float);
+  bytes += resampler_alloc_bytes(&engine->resampler);
+  if (atomic_load(&engine->next))
+    bytes += sizeof(PrimedTrack);
+  if (atomic_load(&engine->spliced))
+    bytes += sizeof(PrimedTrack);
+  return bytes;
+}
+
+bool audio_tap_read(AudioEngine *engine, float *dst, size_t frames,
+                    long *rate) {
+  if (!engine || engine->sample_rate <= 0 || engine->channels != 2)
+    return false;
+  *rate = engine->sample_rate;
+  return tap_read_latest(&engine->tap, dst, frames * 2);
+}
+
+void audio_get_stats(AudioEngine *engine, AudioStats *out) {
+  memset(out, 0, sizeof(*out));
+  if (!engine)
+    return;
+
+  AudioStatCounters *st = &engine->stats;
+  out->callbacks = atomic_load_explicit(&st->callbacks, memory_order_relaxed);
+  out->underflows = atomic_load_explicit(&st->underflows, memory_order_relaxed);
+  out->overflows = atomic_load_explicit(&st->overflows, memory_order_relaxed);
+  out->starved = atomic_load_explicit(&st->starved, memory_order_relaxed);
+  for (int i = 0; i < AUDIO_STATS_BUCKETS; ++i)
+    out->time_hist[i] =
+        atomic_load_explicit(&st->time_hist[i], memory_order_relaxed);
+
+  double us_per_tick = 1e6 / (double)engine->qpc_freq;
+  uint64_t total = atomic_load_explicit(&st->time_total, memory_order_relaxed);
+  if (out->callbacks > 0)
+    out->time_mean_us = (double)total * us_per_tick / (double)out->callbacks;
+  out->time_max_us =
+      (double)atomic_load_explicit(&st->time_max, memory_order_relaxed) *
+      us_per_tick;
+  size_t frames = atomic_load_explicit(&st->frames, memory_order_relaxed);
+  if (engine->sample_rate > 0)
+    out->budget_us = (double)frames * 1e6 / (double)engine->sample_rate;
+
+  out->ring_fill = atomic_load_explicit(&st->fill, memory_order_relaxed);
+  size_t fill_min = atomic_load_explicit(&st->fill_min, memory_order_relaxed);
+  out->ring_fill_min = fill_min == SIZE_MAX ? out->ring_fill : fill_min;
+  out->ring_capacity = engine->rings[0].capacity;
+
+  if (engine->sink) {
+    out->buffer_frames = engine->sink->frames ? engine->sink->frames
+                                              : (unsigned)frames;
+    out->latency_ms = engine->sink->latency * 1000.0;
+  }
+  out->latency_level = engine->latency_level;
+  out->latency_changes = engine->latency_changes;
+  size_t kept = engine->latency_changes < AUDIO_LATENCY_LOG
+                    ? engine->latency_changes
+                    : AUDIO_LATENCY_LOG;
+  for (size_t i = 0; i < kept; ++i)
+    out->latency_log[i] =
+        engine->latency_log[(engine->latency_changes - kept + i) %
+                            AUDIO_LATENCY_LOG];
+}
+
+void audio_stats_write_json(const AudioStats *stats, FILE *f) {
+  fprintf(f, "{\n");
+  fprintf(f, "  \"callbacks\": %llu,\n",
+          (unsigned long long)stats->callbacks);
+  fprintf(f, "  \"underflows\": %llu,\n",
+          (unsigned long long)stats->underflows);
+  fprintf(f, "  \"overflows\": %llu,\n",
+          (unsigned long long)stats->overflows);
+  fprintf(f, "  \"starved\": %llu,\n", (unsigned long long)stats->starved);
+  fprintf(f, "  \"callback_us\": {\n");
+  fprintf(f, "    \"mean\": %.2f,\n", stats->time_mean_us);
+  fprintf(f, "    \"max\": %.2f,\n", stats->time_max_us);
+  fprintf(f, "    \"budget\": %.2f,\n", stats->budget_us);
+  // bucket i counts callbacks that took at least `from` microseconds
+  fprintf(f, "    \"histogram\": [");
+  for (int i = 0; i < AUDIO_STATS_BUCKETS; ++i) {
+    unsigned long from = i == 0 ? 0ul : 1ul << (i - 1);
+    fprintf(f, "%s{\"from\": %lu, \"count\": %llu}", i ? ", " : "", from,
+            (unsigned long long)stats->time_hist[i]);
+  }
+  fprintf(f, "]\n  },\n");
+  fprintf(f, "  \"ring\": {\"fill\": %zu, \"fill_min\": %zu, "
+             "\"capacity\": %zu},\n",
+          stats->ring_fill, stats->ring_fill_min, stats->ring_capacity);
+
+  fprintf(f, "  \"output\": {\n");
+  fprintf(f, "    \"frames\": %u,\n", stats->buffer_frames);
+  fprintf(f, "    \"latency_ms\": %.2f,\n", stats->latency_ms);
+  fprintf(f, "    \"level\": %d,\n", stats->latency_level);
+  fprintf(f, "    \"changes\": %zu,\n", stats->latency_changes);
+  fprintf(f, "    \"log\": [");
+  size_t kept = stats->latency_changes < AUDIO_LATENCY_LOG
+                    ? stats->latency_changes
+                    : AUDIO_LATENCY_LOG;
+  for (size_t i = 0; i < kept; ++i) {
+    const AudioLatencyChange *c = &stats->latency_log[i];
+    fprintf(f,
+            "%s\n      {\"at\": %.3f, \"level\": %d, \"frames\": %u, "
+            "\"latency_ms\": %.2f, \"wakeups\": %.1f, \"reason\": \"%s\"}",
+            i ? "," : "", c->at, c->level, c->frames, c->latency_ms,
+            c->wakeups, c->reason ? c->reason : "");
+  }
+  fprintf(f, "%s]\n  }\n", kept ? "\n    " : "");
+  fprintf(f, "}\n");
 }
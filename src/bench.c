@@ -0,0 +1,663 @@
+#include "bench.h"
+#include "audio.h"
+#include "decoder.h"
+#include "eq.h"
+#include "kernels.h"
+#include "resampler.h"
+#include "trackstore.h"
+
+#include <math.h>
+#include <mpg123.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#define BENCH_FRAMES 512 // typical callback size
+#define BENCH_CHANNELS 2
+#define BENCH_TAG_FILES 24
+#define BENCH_TAG_MB 4 // per file: a typical song at 128 kbit/s
+#define BENCH_STORE_CHUNK 256 // tracks generated between timed adds
+#define BENCH_CONTROL_OPS 20000
+#define BENCH_CONTROL_WAIT_MS 5000 // for the engine to settle after the run
+
+static volatile float g_sink; // keeps results observable
+
+static double bench_now_ns(void) {
+  static LARGE_INTEGER freq = {0};
+  LARGE_INTEGER t;
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart * 1e9 / (double)freq.QuadPart;
+}
+
+static void fill_noise(float *buf, size_t count) {
+  unsigned int seed = 12345;
+  for (size_t i = 0; i < count; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    buf[i] = (float)((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+  }
+}
+
+static void bench_kernels(void) {
+  const size_t count = BENCH_FRAMES * BENCH_CHANNELS;
+  const int iterations = 200000;
+
+  float *src = malloc(count * sizeof(float));
+  float *dst = malloc(count * sizeof(float));
+  if (!src || !dst) {
+    fprintf(stderr, "bench: out of memory\n");
+    free(src);
+    free(dst);
+    return;
+  }
+  fill_noise(src, count);
+
+  kernels_init();
+  const AudioKernels *list[8];
+  int n = kernels_available(list, 8);
+
+  printf("gain kernel, %d-frame stereo blocks (active: %s)\n", BENCH_FRAMES,
+         kernels_active()->name);
+
+  for (int k = 0; k < n; ++k) {
+    // warm up caches and clocks
+    for (int i = 0; i < 1000; ++i)
+      list[k]->gain_copy(dst, src, count, 0.7f);
+
+    double t0 = bench_now_ns();
+    for (int i = 0; i < iterations; ++i) {
+      list[k]->gain_copy(dst, src, count, 0.7f);
+      g_sink += dst[i % count];
+    }
+    double elapsed = bench_now_ns() - t0;
+
+    printf("  %-8s %8.3f ns/frame\n", list[k]->name,
+           elapsed / ((double)iterations * BENCH_FRAMES));
+  }
+
+  free(src);
+  free(dst);
+}
+
+// CPU time spent per second of converted audio, for each quality tier
+static void bench_resampler(void) {
+  static const long pairs[][2] = {{44100, 48000}, {48000, 44100}};
+  const size_t seconds = 10;
+
+  kernels_init();
+  printf("resampler, stereo, %zu s of audio (kernel: %s)\n", seconds,
+         kernels_active()->name);
+
+  for (size_t p = 0; p < sizeof(pairs) / sizeof(pairs[0]); ++p) {
+    long in_rate = pairs[p][0], out_rate = pairs[p][1];
+    size_t in_frames = (size_t)in_rate * seconds;
+    size_t out_cap = (size_t)out_rate * seconds + 1024;
+
+    float *in = malloc(in_frames * 2 * sizeof(float));
+    float *out = malloc(out_cap * 2 * sizeof(float));
+    if (!in || !out) {
+      fprintf(stderr, "bench: out of memory\n");
+      free(in);
+      free(out);
+      return;
+    }
+    fill_noise(in, in_frames * 2);
+
+    for (int q = 0; q < RESAMPLER_QUALITY_COUNT; ++q) {
+      Resampler rs;
+      if (!resampler_init(&rs, in_rate, out_rate, (ResamplerQuality)q))
+        continue;
+
+      // feed in decoder-sized chunks, like the decoder thread does
+      double t0 = bench_now_ns();
+      size_t used_total = 0, produced = 0;
+      while (used_total < in_frames) {
+        size_t chunk = in_frames - used_total;
+        if (chunk > 1024)
+          chunk = 1024;
+        size_t used = 0;
+        produced += resampler_process(&rs, in + 2 * used_total, chunk, &used,
+                                      out + 2 * produced, out_cap - produced);
+        used_total += used;
+      }
+      produced += resampler_drain(&rs, out + 2 * produced, out_cap - produced);
+      double elapsed = bench_now_ns() - t0;
+      g_sink += out[produced / 2];
+
+      double ms_per_s = elapsed / 1e6 / (double)seconds;
+      printf("  %5ld -> %5ld %-6s %3u taps %8.3f ms CPU per s of audio "
+             "(%.0fx real time)\n",
+             in_rate, out_rate, resampler_quality_name((ResamplerQuality)q),
+             rs.taps, ms_per_s, 1000.0 / ms_per_s);
+      resampler_free(&rs);
+    }
+
+    free(in);
+    free(out);
+  }
+}
+
+// Replay cache storage: reading a track back from float32 (a copy) or
+// int16 (converted per decoder-sized chunk), and recording it as int16
+static void bench_cache_formats(void) {
+  const size_t frames = 44100 * 60; // a minute of CD audio
+  const size_t count = frames * 2;
+  const size_t chunk = 2048; // samples per decoder_read
+  const int passes = 20;
+
+  float *pcm = malloc(count * sizeof(float));
+  int16_t *pcm16 = malloc(count * sizeof(int16_t));
+  float *out = malloc(chunk * sizeof(float));
+  if (!pcm || !pcm16 || !out) {
+    fprintf(stderr, "bench: out of memory\n");
+    free(pcm);
+    free(pcm16);
+    free(out);
+    return;
+  }
+  fill_noise(pcm, count);
+
+  kernels_init();
+  const AudioKernels *list[8];
+  int n = kernels_available(list, 8);
+
+  printf("replay cache, one minute of 44.1k stereo: float32 %.1f MB, "
+         "int16 %.1f MB\n",
+         count * sizeof(float) / 1048576.0,
+         count * sizeof(int16_t) / 1048576.0);
+
+  double t0 = bench_now_ns();
+  for (int p = 0; p < passes; ++p) {
+    for (size_t i = 0; i < count; i += chunk) {
+      size_t len = count - i < chunk ? count - i : chunk;
+      memcpy(out, pcm + i, len * sizeof(float));
+      g_sink += out[p];
+    }
+  }
+  printf("  float32  read  %8.3f ns/frame\n",
+         (bench_now_ns() - t0) / ((double)passes * frames));
+
+  // int16 at the cache's scale, -2..2
+  for (int k = 0; k < n; ++k) {
+    t0 = bench_now_ns();
+    for (int p = 0; p < passes; ++p)
+      list[k]->float_to_s16(pcm16, pcm, count, 16384.0f);
+    double store = (bench_now_ns() - t0) / ((double)passes * frames);
+
+    t0 = bench_now_ns();
+    float err = 0.0f;
+    for (int p = 0; p < passes; ++p) {
+      for (size_t i = 0; i < count; i += chunk) {
+        size_t len = count - i < chunk ? count - i : chunk;
+        list[k]->s16_to_float(out, pcm16 + i, len, 1.0f / 16384.0f);
+        g_sink += out[p];
+      }
+    }
+    double load = (bench_now_ns() - t0) / ((double)passes * frames);
+
+    for (size_t i = 0; i < count; i += chunk) {
+      size_t len = count - i < chunk ? count - i : chunk;
+      list[k]->s16_to_float(out, pcm16 + i, len, 1.0f / 16384.0f);
+      for (size_t j = 0; j < len; ++j) {
+        float e = fabsf(out[j] - pcm[i + j]);
+        err = e > err ? e : err;
+      }
+    }
+
+    printf("  int16    read  %8.3f ns/frame  record %8.3f ns/frame  "
+           "(%s, max error %.1f dBFS)\n",
+           load, store, list[k]->name, 20.0 * log10(err));
+  }
+
+  free(pcm);
+  free(pcm16);
+  free(out);
+}
+
+// Equaliser cost per DSP block as bands are added. Every block starts
+// from the same noise (the copy is part of the 0-band figure).
+static void bench_eq(void) {
+  static const int band_counts[] = {0, 1, 2, 3, 4, 6, 8, 10, 12, 16};
+  const long rate = 48000;
+  const size_t count = DSP_BLOCK_FRAMES * 2;
+  const int iterations = 100000;
+  double budget_ns = (double)DSP_BLOCK_FRAMES * 1e9 / (double)rate;
+
+  float *src = malloc(count * sizeof(float));
+  float *buf = malloc(count * sizeof(float));
+  DspStage *eq = eq_create();
+  if (!src || !buf || !eq) {
+    fprintf(stderr, "bench: out of memory\n");
+    free(src);
+    free(buf);
+    if (eq)
+      eq->vt->destroy(eq);
+    return;
+  }
+  fill_noise(src, count);
+  for (size_t i = 0; i < count; ++i)
+    src[i] *= 0.25f;
+  eq->vt->prepare(eq, rate);
+
+  printf("equaliser, %d-frame stereo blocks at %ld Hz\n", DSP_BLOCK_FRAMES,
+         rate);
+  for (size_t b = 0; b < sizeof(band_counts) / sizeof(band_counts[0]);
+       ++b) {
+    // peaks spread log-evenly over the audible range
+    EqBand bands[EQ_MAX_BANDS];
+    int n = band_counts[b];
+    for (int i = 0; i < n; ++i)
+      bands[i] = (EqBand){EQ_PEAK, 40.0 * pow(400.0, (i + 0.5) / n),
+                          i % 2 ? -3.0 : 3.0, 1.0};
+    eq_set_bands(eq, bands, n);
+
+    // the first blocks take the new settings and crossfade to them
+    for (int i = 0; i < 1000; ++i) {
+      memcpy(buf, src, count * sizeof(float));
+      eq->vt->process(eq, buf, DSP_BLOCK_FRAMES);
+    }
+
+    double t0 = bench_now_ns();
+    for (int i = 0; i < iterations; ++i) {
+      memcpy(buf, src, count * sizeof(float));
+      eq->vt->process(eq, buf, DSP_BLOCK_FRAMES);
+      g_sink += buf[i % count];
+    }
+    double per_block = (bench_now_ns() - t0) / iterations;
+
+    printf("  %2d bands %9.1f ns/block %7.2f ns/frame %7.3f%% of real time\n",
+           n, per_block, per_block / DSP_BLOCK_FRAMES,
+           100.0 * per_block / budget_ns);
+  }
+
+  eq->vt->destroy(eq);
+  free(src);
+  free(buf);
+}
+
+static void put_syncsafe(unsigned char *p, size_t v) {
+  p[0] = (unsigned char)((v >> 21) & 0x7F);
+  p[1] = (unsigned char)((v >> 14) & 0x7F);
+  p[2] = (unsigned char)((v >> 7) & 0x7F);
+  p[3] = (unsigned char)(v & 0x7F);
+}
+
+// One ID3v2.3/2.4 text frame: UTF-8 for 2.4, UTF-16 with BOM for 2.3
+static size_t put_text_frame(unsigned char *p, const char *id,
+                             const char *text, int version) {
+  size_t len = strlen(text);
+  size_t body = version == 4 ? 1 + len : 1 + 2 + 2 * len;
+  memset(p, 0, 10);
+  memcpy(p, id, 4);
+  if (version == 4) {
+    put_syncsafe(p + 4, body);
+  } else {
+    p[6] = (unsigned char)(body >> 8);
+    p[7] = (unsigned char)body;
+  }
+  unsigned char *q = p + 10;
+  if (version == 4) {
+    *q++ = 3;
+    memcpy(q, text, len);
+  } else {
+    *q++ = 1;
+    *q++ = 0xFF;
+    *q++ = 0xFE;
+    for (size_t i = 0; i < len; ++i) {
+      *q++ = (unsigned char)text[i];
+      *q++ = 0;
+    }
+  }
+  return 10 + body;
+}
+
+// A silent CBR MP3 with the tag layouts taggers commonly write: 2.3 with
+// cover art, 2.4, ID3v1 alone, and 2.3 plus ID3v1
+static bool write_tag_file(const char *path, int i) {
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return false;
+  char title[64], artist[64], album[64];
+  snprintf(title, sizeof(title), "Title %d", i);
+  snprintf(artist, sizeof(artist), "Artist %d", i % 5);
+  snprintf(album, sizeof(album), "Album %d", i % 3);
+
+  int kind = i % 4;
+  if (kind != 2) {
+    int version = kind == 1 ? 4 : 3;
+    size_t art = kind == 0 ? 64 * 1024 : 0;
+    unsigned char *tag = calloc(1, 4096 + art);
+    if (!tag) {
+      fclose(f);
+      return false;
+    }
+    size_t len = 10;
+    len += put_text_frame(tag + len, "TIT2", title, version);
+    len += put_text_frame(tag + len, "TPE1", artist, version);
+    len += put_text_frame(tag + len, "TALB", album, version);
+    if (art) {
+      memcpy(tag + len, "APIC", 4);
+      tag[len + 5] = (unsigned char)(art >> 16);
+      tag[len + 6] = (unsigned char)(art >> 8);
+      len += 10 + art;
+    }
+    len += 1024; // padding
+    memcpy(tag, "ID3", 3);
+    tag[3] = (unsigned char)version;
+    put_syncsafe(tag + 6, len - 10);
+    fwrite(tag, 1, len, f);
+    free(tag);
+  }
+
+  // MPEG-1 layer III, 128 kbit/s, 44.1 kHz: 417-byte frames of silence
+  unsigned char frame[417] = {0xFF, 0xFB, 0x90, 0x00};
+  size_t frames = (size_t)BENCH_TAG_MB * 1024 * 1024 / sizeof(frame);
+  for (size_t n = 0; n < frames; ++n)
+    fwrite(frame, 1, sizeof(frame), f);
+
+  if (kind >= 2) {
+    unsigned char v1[128] = {'T', 'A', 'G'};
+    memcpy(v1 + 3, title, strlen(title));
+    memcpy(v1 + 33, artist, strlen(artist));
+    memcpy(v1 + 63, album, strlen(album));
+    fwrite(v1, 1, sizeof(v1), f);
+  }
+  return fclose(f) == 0;
+}
+
+// What reading tags cost before: mpg123_scan walks every frame to reach
+// the ID3v1 tag at the end
+static bool tags_via_scan(const char *path, DecoderTags *out) {
+  memset(out, 0, sizeof(*out));
+  mpg123_handle *mh = mpg123_new(NULL, NULL);
+  if (!mh)
+    return false;
+  bool ok = false;
+  if (mpg123_open(mh, path) == MPG123_OK) {
+    mpg123_scan(mh);
+    mpg123_id3v1 *v1 = NULL;
+    mpg123_id3v2 *v2 = NULL;
+    if (mpg123_id3(mh, &v1, &v2) == MPG123_OK && (v1 || v2)) {
+      if (v2 && v2->title && v2->title->p)
+        decoder_copy_tag(out->title, sizeof(out->title), v2->title->p,
+                         strlen(v2->title->p));
+      else if (v1)
+        decoder_copy_tag(out->title, sizeof(out->title), v1->title,
+                         sizeof(v1->title));
+      ok = true;
+    }
+    mpg123_close(mh);
+  }
+  mpg123_delete(mh);
+  return ok;
+}
+
+static void bench_tags(void) {
+  char dir[MAX_PATH], paths[BENCH_TAG_FILES][MAX_PATH];
+  DWORD n = GetTempPathA(MAX_PATH, dir);
+  if (n == 0 || n > MAX_PATH - 32) {
+    fprintf(stderr, "bench: no temp directory\n");
+    return;
+  }
+  int written = 0;
+  for (; written < BENCH_TAG_FILES; ++written) {
+    snprintf(paths[written], MAX_PATH, "%smusicplayer-bench-%d.mp3", dir,
+             written);
+    if (!write_tag_file(paths[written], written))
+      break;
+  }
+  if (written < BENCH_TAG_FILES) {
+    fprintf(stderr, "bench: cannot write %s\n", paths[written]);
+    for (int i = 0; i <= written; ++i)
+      remove(paths[i]);
+    return;
+  }
+  mpg123_init();
+
+  printf("tag reading, %d files of %d MB (in the OS cache, so this is the "
+         "CPU side only)\n",
+         BENCH_TAG_FILES, BENCH_TAG_MB);
+  const int passes = 3;
+  DecoderTags tags;
+  double t0 = bench_now_ns();
+  for (int p = 0; p < passes; ++p)
+    for (int i = 0; i < BENCH_TAG_FILES; ++i)
+      tags_via_scan(paths[i], &tags);
+  double scan = passes * BENCH_TAG_FILES / ((bench_now_ns() - t0) / 1e9);
+
+  t0 = bench_now_ns();
+  for (int p = 0; p < passes; ++p)
+    for (int i = 0; i < BENCH_TAG_FILES; ++i)
+      decoder_read_tags(paths[i], &tags);
+  double header = passes * BENCH_TAG_FILES / ((bench_now_ns() - t0) / 1e9);
+
+  printf("  mpg123_scan + id3  %10.1f tracks/s\n", scan);
+  printf("  header-only id3    %10.1f tracks/s (%.0fx)\n", header,
+         header / scan);
+
+  // both must agree on what the files say
+  int mismatched = 0;
+  for (int i = 0; i < BENCH_TAG_FILES; ++i) {
+    DecoderTags old_way;
+    tags_via_scan(paths[i], &old_way);
+    decoder_read_tags(paths[i], &tags);
+    mismatched += strcmp(old_way.title, tags.title) != 0;
+  }
+  if (mismatched)
+    printf("  %d files with a different title\n", mismatched);
+
+  for (int i = 0; i < BENCH_TAG_FILES; ++i)
+    remove(paths[i]);
+}
+
+// A made-up library: 10 tracks per album, 10 albums per artist
+static void make_store_track(Track *t, int i) {
+  snprintf(t->filepath, sizeof(t->filepath),
+           "D:\\Music\\Artist %d\\Album %d\\%02d - Song Title %d.mp3",
+           i / 100, i / 10, i % 10 + 1, i);
+  snprintf(t->title, sizeof(t->title), "Song Title %d", i);
+  snprintf(t->artist, sizeof(t->artist), "Artist %d", i / 100);
+  snprintf(t->album, sizeof(t->album), "Album %d", i / 10);
+  t->duration = 180.0 + i % 120;
+  t->size = 4000000 + (uint64_t)i;
+  t->mtime = 132000000000000000ull + (uint64_t)i;
+}
+
+static void bench_store(void) {
+  static Track chunk[BENCH_STORE_CHUNK];
+  const int sizes[] = {10000, 100000, 250000, 1000000};
+
+  printf("track store, synthetic library (Track is %zu bytes)\n",
+         sizeof(Track));
+  for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+    TrackStore store = {0};
+    double add_ns = 0.0;
+    bool ok = true;
+    for (int base = 0; ok && base < sizes[k]; base += BENCH_STORE_CHUNK) {
+      int n = sizes[k] - base < BENCH_STORE_CHUNK ? sizes[k] - base
+                                                  : BENCH_STORE_CHUNK;
+      for (int i = 0; i < n; ++i)
+        make_store_track(&chunk[i], base + i);
+      double t0 = bench_now_ns();
+      for (int i = 0; ok && i < n; ++i)
+        ok = trackstore_add(&store, &chunk[i]) >= 0;
+      add_ns += bench_now_ns() - t0;
+    }
+    if (!ok) {
+      printf("  %8d tracks: out of memory\n", sizes[k]);
+      trackstore_free(&store);
+      break;
+    }
+    printf("  %8d tracks: %7.1f MB (as Track array %7.1f MB), "
+           "added in %6.3f s (%.0f ns/track)\n",
+           sizes[k], trackstore_bytes(&store) / 1048576.0,
+           (double)sizes[k] * sizeof(Track) / 1048576.0, add_ns / 1e9,
+           add_ns / sizes[k]);
+    trackstore_free(&store);
+  }
+}
+
+// Until playback passes `target` or the track ends; false on timeout
+static bool control_wait(AudioEngine *engine, double target) {
+  for (int ms = 0; ms < BENCH_CONTROL_WAIT_MS; ++ms) {
+    if (audio_get_position(engine) > target || audio_is_finished(engine))
+      return true;
+    Sleep(1);
+  }
+  return false;
+}
+
+// Stress run of the control path: random play, pause, volume, gain, seek,
+// stop, reload and queue calls while the null sink runs the callback as
+// fast as the decoder keeps up, then a check that the last ones took
+// effect. It checks the end state only: MinGW has no ThreadSanitizer, and
+// the engine only builds against Win32, so races that do not show in the
+// end state go unnoticed.
+static bool bench_control(const char *file) {
+  AudioEngine *engine = audio_init();
+  if (!engine || !audio_set_output(engine, "null", 0) ||
+      !audio_load_file(engine, file)) {
+    fprintf(stderr, "bench: cannot play %s\n", file);
+    audio_cleanup(engine);
+    return false;
+  }
+  audio_play(engine);
+
+  unsigned int seed = 12345;
+  double t0 = bench_now_ns();
+  for (int i = 0; i < BENCH_CONTROL_OPS; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    float r = (float)((seed >> 8) & 0xFFFF) / 65536.0f;
+    switch ((seed >> 24) % 10) {
+    case 0:
+      audio_set_volume(engine, r);
+      break;
+    case 1:
+      audio_set_track_gain(engine, 2.0f * r);
+      break;
+    case 2:
+      audio_pause(engine);
+      break;
+    case 3:
+      audio_play(engine);
+      break;
+    case 4:
+      audio_seek(engine, r * audio_get_duration(engine));
+      break;
+    case 5:
+      audio_stop(engine);
+      audio_play(engine);
+      break;
+    case 6:
+      if (i % 16 == 0)
+        audio_load_file(engine, file);
+      break;
+    case 7:
+      audio_queue_next(engine, file, r);
+      break;
+    case 8:
+      audio_clear_next(engine);
+      break;
+    default:
+      audio_take_track_change(engine);
+      break;
+    }
+    g_sink += (float)audio_get_position(engine) + audio_is_playing(engine);
+  }
+  double elapsed = bench_now_ns() - t0;
+
+  // Silent and playing from a quarter in: the position must move past it
+  // with nothing but zeros reaching the output
+  audio_clear_next(engine);
+  audio_set_volume(engine, 0.0f);
+  audio_set_track_gain(engine, 1.0f);
+  audio_play(engine);
+  double target = audio_get_duration(engine) / 4.0;
+  audio_seek(engine, target);
+  bool ok = control_wait(engine, target);
+  if (!ok)
+    fprintf(stderr, "bench: playback did not resume\n");
+
+  float tap[BENCH_FRAMES * BENCH_CHANNELS];
+  long rate;
+  if (ok && audio_tap_read(engine, tap, BENCH_FRAMES, &rate)) {
+    for (size_t i = 0; i < BENCH_FRAMES * BENCH_CHANNELS; ++i) {
+      if (tap[i] != 0.0f) {
+        fprintf(stderr, "bench: volume 0 not applied\n");
+        ok = false;
+        break;
+      }
+    }
+  }
+
+  // Paused and sent back there: the position stays put. (Decoders may land
+  // a little off the frame asked for.)
+  audio_pause(engine);
+  audio_seek(engine, target);
+  Sleep(100);
+  if (fabs(audio_get_position(engine) - target) > 0.5) {
+    fprintf(stderr, "bench: pause not applied\n");
+    ok = false;
+  }
+
+  AudioStats stats;
+  audio_get_stats(engine, &stats);
+  audio_cleanup(engine);
+
+  printf("control path, %d random commands against the null sink\n",
+         BENCH_CONTROL_OPS);
+  printf("  %.3f s (%.1f us/command), %llu callbacks meanwhile: %s\n",
+         elapsed / 1e9, elapsed / 1e3 / BENCH_CONTROL_OPS,
+         (unsigned long long)stats.callbacks, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int bench_main(int argc, char *argv[]) {
+  const char *which = argc > 0 ? argv[0] : "all";
+  bool all = strcmp(which, "all") == 0;
+  bool ran = false;
+
+  if (all || strcmp(which, "kernels") == 0) {
+    bench_kernels();
+    ran = true;
+  }
+
+  if (all || strcmp(which, "resampler") == 0) {
+    bench_resampler();
+    ran = true;
+  }
+
+  if (all || strcmp(which, "cache") == 0) {
+    bench_cache_formats();
+    ran = true;
+  }
+
+  if (all || strcmp(which, "eq") == 0) {
+    bench_eq();
+    ran = true;
+  }
+
+  if (all || strcmp(which, "tags") == 0) {
+    bench_tags();
+    ran = true;
+  }
+
+  if (all || strcmp(which, "store") == 0) {
+    bench_store();
+    ran = true;
+  }
+
+  // Needs a track to play, so not part of "all"
+  if (strcmp(which, "control") == 0 && argc > 1)
+    return bench_control(argv[1]) ? 0 : 1;
+
+  if (!ran) {
+    fprintf(stderr, "usage: musicplayer bench "
+                    "[all|kernels|resampler|cache|eq|tags|store]\n"
+                    "       musicplayer bench control <file>\n");
+    return 1;
+  }
+  return 0;
+}
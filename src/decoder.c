@@ -0,0 +1,182 @@
+#include "decoder.h"
+#include "id3tag.h"
+#include "mapfile.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DECODER_PROBE_BYTES 64
+
+// Probe order matters: mpg123 accepts a bare frame sync, so it goes last
+static const DecoderVTable *const g_backends[] = {
+    &decoder_flac_vtable,
+    &decoder_vorbis_vtable,
+    &decoder_mpg123_vtable,
+};
+#define BACKEND_COUNT (sizeof(g_backends) / sizeof(g_backends[0]))
+
+static bool g_exact_durations = false;
+
+void decoder_init_base(Decoder *dec, const DecoderVTable *vt,
+                       const char *filepath) {
+  dec->vt = vt;
+  strncpy(dec->path, filepath, sizeof(dec->path) - 1);
+  dec->path[sizeof(dec->path) - 1] = '\0';
+  dec->rate = 0;
+  dec->channels = 2;
+}
+
+// Copy at most src_len bytes of src, stopping early at a NUL
+void decoder_copy_tag(char *dst, size_t dst_size, const char *src,
+                      size_t src_len) {
+  const char *nul = memchr(src, '\0', src_len);
+  if (nul)
+    src_len = (size_t)(nul - src);
+  if (src_len >= dst_size)
+    src_len = dst_size - 1;
+  memcpy(dst, src, src_len);
+  dst[src_len] = '\0';
+}
+
+static bool comment_key_is(const char *entry, size_t len, const char *key) {
+  size_t klen = strlen(key);
+  if (len <= klen || entry[klen] != '=')
+    return false;
+  for (size_t i = 0; i < klen; ++i) {
+    if (toupper((unsigned char)entry[i]) != key[i])
+      return false;
+  }
+  return true;
+}
+
+// Vorbis-comment style "KEY=value" (used by both FLAC and Ogg Vorbis)
+bool decoder_parse_comment(DecoderTags *out, const char *entry, size_t len) {
+  if (comment_key_is(entry, len, "TITLE")) {
+    decoder_copy_tag(out->title, sizeof(out->title), entry + 6, len - 6);
+  } else if (comment_key_is(entry, len, "ARTIST")) {
+    decoder_copy_tag(out->artist, sizeof(out->artist), entry + 7, len - 7);
+  } else if (comment_key_is(entry, len, "ALBUM")) {
+    decoder_copy_tag(out->album, sizeof(out->album), entry + 6, len - 6);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Copy the first bytes of the stream, skipping an ID3v2 tag if present
+// (some FLAC files carry one too). The mapping stays cached for the
+// backend that opens the file next.
+static size_t read_head(const char *filepath, unsigned char *head, size_t len,
+                        bool *after_id3) {
+  *after_id3 = false;
+
+  MappedFile *mf = mapfile_open(filepath);
+  if (!mf)
+    return 0;
+
+  size_t start = id3_v2_size(mf->data, mf->size);
+  *after_id3 = start > 0;
+
+  size_t got = 0;
+  if (start < mf->size) {
+    got = mf->size - start < len ? mf->size - start : len;
+    memcpy(head, mf->data + start, got);
+  }
+  mapfile_release(mf);
+  return got;
+}
+
+static const DecoderVTable *pick_backend(const char *filepath) {
+  unsigned char head[DECODER_PROBE_BYTES];
+  bool after_id3;
+  size_t len = read_head(filepath, head, sizeof(head), &after_id3);
+  if (len == 0 && !after_id3)
+    return NULL;
+
+  for (size_t i = 0; i < BACKEND_COUNT; ++i) {
+    if (g_backends[i]->probe(head, len, after_id3))
+      return g_backends[i];
+  }
+  return NULL;
+}
+
+Decoder *decoder_open(const char *filepath) {
+  return decoder_open_ex(filepath, 0);
+}
+
+Decoder *decoder_open_ex(const char *filepath, unsigned flags) {
+  const DecoderVTable *vt = pick_backend(filepath);
+  if (!vt) {
+    fprintf(stderr, "[decoder] unrecognized format: %s\n", filepath);
+    return NULL;
+  }
+
+  Decoder *dec = vt->open(filepath, flags);
+  if (!dec)
+    fprintf(stderr, "[decoder] %s failed to open %s\n", vt->name, filepath);
+  return dec;
+}
+
+void decoder_close(Decoder *dec) {
+  if (dec)
+    dec->vt->close(dec);
+}
+
+DecoderResult decoder_read(Decoder *dec, float *dst, size_t max_samples,
+                           size_t *done) {
+  return dec->vt->read(dec, dst, max_samples, done);
+}
+
+int64_t decoder_seek(Decoder *dec, int64_t frame) {
+  return dec->vt->seek(dec, frame);
+}
+
+double decoder_duration(Decoder *dec) { return dec->vt->duration(dec); }
+
+bool decoder_tags(Decoder *dec, DecoderTags *out) {
+  return dec->vt->tags(dec, out);
+}
+
+bool decoder_supports_file(const char *filepath) {
+  return pick_backend(filepath) != NULL;
+}
+
+bool decoder_read_tags(const char *filepath, DecoderTags *out) {
+  return decoder_read_info(filepath, out, NULL);
+}
+
+bool decoder_read_info(const char *filepath, DecoderTags *out,
+                       double *duration) {
+  memset(out, 0, sizeof(*out));
+  if (duration)
+    *duration = 0.0;
+
+  const DecoderVTable *vt = pick_backend(filepath);
+  if (!vt)
+    return false;
+  if (vt->file_tags && (vt->file_duration || !duration)) {
+    // the mapping pick_backend used is still cached
+    MappedFile *mf = mapfile_open(filepath);
+    if (!mf)
+      return false;
+    bool ok = vt->file_tags(mf->data, mf->size, out);
+    if (duration)
+      *duration = vt->file_duration(mf->data, mf->size, g_exact_durations);
+    mapfile_release(mf);
+    return ok;
+  }
+
+  // only tags and length: no decoder caches involved, whatever the thread
+  Decoder *dec = vt->open(filepath, DECODER_OPEN_BACKGROUND);
+  if (!dec)
+    return false;
+
+  bool ok = decoder_tags(dec, out);
+  if (duration)
+    *duration = decoder_duration(dec);
+  decoder_close(dec);
+  return ok;
+}
+
+void decoder_set_exact_durations(bool exact) { g_exact_durations = exact; }
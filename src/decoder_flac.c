@@ -0,0 +1,254 @@
+#include "decoder.h"
+#include "mapfile.h"
+
+#include <FLAC/stream_decoder.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  Decoder base;
+  FLAC__StreamDecoder *fd;
+  MapReader reader; // libFLAC reads the mapped file through this
+
+  // One FLAC frame is decoded at a time; whatever the caller could not
+  // take yet waits here as interleaved stereo float.
+  float *pending;
+  size_t pending_len; // samples
+  size_t pending_pos;
+  size_t pending_cap;
+
+  unsigned bits_per_sample;
+  FLAC__uint64 total_frames;
+  DecoderTags tags;
+  bool failed;
+} FlacDecoder;
+
+static bool flac_probe(const unsigned char *head, size_t len, bool after_id3) {
+  (void)after_id3;
+  return len >= 4 && memcmp(head, "fLaC", 4) == 0;
+}
+
+static FLAC__StreamDecoderWriteStatus
+flac_write_cb(const FLAC__StreamDecoder *fd, const FLAC__Frame *frame,
+              const FLAC__int32 *const buffer[], void *user) {
+  (void)fd;
+  FlacDecoder *d = user;
+
+  unsigned blocksize = frame->header.blocksize;
+  unsigned channels = frame->header.channels;
+  unsigned bps = frame->header.bits_per_sample;
+  if (bps == 0)
+    bps = d->bits_per_sample;
+
+  size_t needed = (size_t)blocksize * 2;
+  if (needed > d->pending_cap) {
+    float *grown = realloc(d->pending, needed * sizeof(float));
+    if (!grown) {
+      d->failed = true;
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+    d->pending = grown;
+    d->pending_cap = needed;
+  }
+
+  // Planar int32 -> interleaved stereo float
+  const float scale = 1.0f / (float)(1u << (bps - 1));
+  const FLAC__int32 *left = buffer[0];
+  const FLAC__int32 *right = channels > 1 ? buffer[1] : buffer[0];
+  float *out = d->pending;
+  for (unsigned i = 0; i < blocksize; ++i) {
+    out[2 * i] = (float)left[i] * scale;
+    out[2 * i + 1] = (float)right[i] * scale;
+  }
+
+  d->pending_len = needed;
+  d->pending_pos = 0;
+  return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void flac_metadata_cb(const FLAC__StreamDecoder *fd,
+                             const FLAC__StreamMetadata *meta, void *user) {
+  (void)fd;
+  FlacDecoder *d = user;
+
+  if (meta->type == FLAC__METADATA_TYPE_STREAMINFO) {
+    d->base.rate = (long)meta->data.stream_info.sample_rate;
+    d->bits_per_sample = meta->data.stream_info.bits_per_sample;
+    d->total_frames = meta->data.stream_info.total_samples;
+  } else if (meta->type == FLAC__METADATA_TYPE_VORBIS_COMMENT) {
+    const FLAC__StreamMetadata_VorbisComment *vc = &meta->data.vorbis_comment;
+    for (FLAC__uint32 i = 0; i < vc->num_comments; ++i) {
+      decoder_parse_comment(&d->tags, (const char *)vc->comments[i].entry,
+                            vc->comments[i].length);
+    }
+  }
+}
+
+static void flac_error_cb(const FLAC__StreamDecoder *fd,
+                          FLAC__StreamDecoderErrorStatus status, void *user) {
+  (void)fd;
+  (void)user;
+  // libFLAC resyncs on its own; just note it
+  fprintf(stderr, "[decoder] flac stream error %d\n", (int)status);
+}
+
+// ---- stream callbacks over the file mapping ----
+
+static FLAC__StreamDecoderReadStatus
+flac_read_cb(const FLAC__StreamDecoder *fd, FLAC__byte buffer[],
+             size_t *bytes, void *user) {
+  (void)fd;
+  FlacDecoder *d = user;
+  *bytes = mapreader_read(&d->reader, buffer, *bytes);
+  return *bytes ? FLAC__STREAM_DECODER_READ_STATUS_CONTINUE
+                : FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+}
+
+static FLAC__StreamDecoderSeekStatus
+flac_seek_cb(const FLAC__StreamDecoder *fd, FLAC__uint64 offset, void *user) {
+  (void)fd;
+  FlacDecoder *d = user;
+  if (offset > d->reader.map->size ||
+      mapreader_seek(&d->reader, (int64_t)offset, SEEK_SET) < 0)
+    return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+  return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamDecoderTellStatus
+flac_tell_cb(const FLAC__StreamDecoder *fd, FLAC__uint64 *offset,
+             void *user) {
+  (void)fd;
+  FlacDecoder *d = user;
+  *offset = d->reader.pos;
+  return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus
+flac_length_cb(const FLAC__StreamDecoder *fd, FLAC__uint64 *length,
+               void *user) {
+  (void)fd;
+  FlacDecoder *d = user;
+  *length = d->reader.map->size;
+  return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool flac_eof_cb(const FLAC__StreamDecoder *fd, void *user) {
+  (void)fd;
+  FlacDecoder *d = user;
+  return d->reader.pos >= d->reader.map->size;
+}
+
+static Decoder *flac_backend_open(const char *filepath, unsigned flags) {
+  (void)flags;
+  FlacDecoder *d = calloc(1, sizeof(FlacDecoder));
+  if (!d)
+    return NULL;
+  decoder_init_base(&d->base, &decoder_flac_vtable, filepath);
+
+  d->fd = FLAC__stream_decoder_new();
+  d->reader.map = mapfile_open(filepath);
+  if (!d->fd || !d->reader.map)
+    goto fail;
+
+  FLAC__stream_decoder_set_metadata_respond(d->fd,
+                                            FLAC__METADATA_TYPE_VORBIS_COMMENT);
+  if (FLAC__stream_decoder_init_stream(
+          d->fd, flac_read_cb, flac_seek_cb, flac_tell_cb, flac_length_cb,
+          flac_eof_cb, flac_write_cb, flac_metadata_cb, flac_error_cb,
+          d) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+    goto fail;
+
+  if (!FLAC__stream_decoder_process_until_end_of_metadata(d->fd) ||
+      d->base.rate <= 0 || d->bits_per_sample == 0) {
+    fprintf(stderr, "[decoder] flac: no usable STREAMINFO in %s\n", filepath);
+    goto fail;
+  }
+  return &d->base;
+
+fail:
+  if (d->fd) {
+    FLAC__stream_decoder_finish(d->fd);
+    FLAC__stream_decoder_delete(d->fd);
+  }
+  mapfile_release(d->reader.map);
+  free(d);
+  return NULL;
+}
+
+static DecoderResult flac_backend_read(Decoder *dec, float *dst,
+                                       size_t max_samples, size_t *done) {
+  FlacDecoder *d = (FlacDecoder *)dec;
+  *done = 0;
+
+  // Decode one frame when nothing is left over; a frame is only a few
+  // thousand samples, so the caller's chunk loop keeps the ring topped up.
+  while (d->pending_pos == d->pending_len) {
+    FLAC__StreamDecoderState state = FLAC__stream_decoder_get_state(d->fd);
+    if (state == FLAC__STREAM_DECODER_END_OF_STREAM)
+      return DECODER_DONE;
+    if (!FLAC__stream_decoder_process_single(d->fd) || d->failed) {
+      fprintf(stderr, "[decoder] flac decode failed (state %d)\n",
+              (int)FLAC__stream_decoder_get_state(d->fd));
+      return DECODER_ERROR;
+    }
+  }
+
+  size_t n = d->pending_len - d->pending_pos;
+  if (n > max_samples)
+    n = max_samples & ~(size_t)1; // whole stereo frames only
+  memcpy(dst, d->pending + d->pending_pos, n * sizeof(float));
+  d->pending_pos += n;
+  *done = n;
+  return DECODER_OK;
+}
+
+static int64_t flac_backend_seek(Decoder *dec, int64_t frame) {
+  FlacDecoder *d = (FlacDecoder *)dec;
+  d->pending_len = d->pending_pos = 0;
+
+  // seek_absolute decodes the target frame through the write callback,
+  // so the first pending sample is exactly `frame`
+  if (!FLAC__stream_decoder_seek_absolute(d->fd, (FLAC__uint64)frame)) {
+    if (FLAC__stream_decoder_get_state(d->fd) ==
+        FLAC__STREAM_DECODER_SEEK_ERROR)
+      FLAC__stream_decoder_flush(d->fd);
+    d->pending_len = d->pending_pos = 0;
+    return -1;
+  }
+  return frame;
+}
+
+static double flac_backend_duration(Decoder *dec) {
+  FlacDecoder *d = (FlacDecoder *)dec;
+  if (d->total_frames == 0 || dec->rate <= 0)
+    return 0.0;
+  return (double)d->total_frames / (double)dec->rate;
+}
+
+static bool flac_backend_tags(Decoder *dec, DecoderTags *out) {
+  FlacDecoder *d = (FlacDecoder *)dec;
+  *out = d->tags;
+  return d->tags.title[0] || d->tags.artist[0] || d->tags.album[0];
+}
+
+static void flac_backend_close(Decoder *dec) {
+  FlacDecoder *d = (FlacDecoder *)dec;
+  FLAC__stream_decoder_finish(d->fd);
+  FLAC__stream_decoder_delete(d->fd);
+  mapfile_release(d->reader.map);
+  free(d->pending);
+  free(d);
+}
+
+const DecoderVTable decoder_flac_vtable = {
+    "flac",
+    flac_probe,
+    flac_backend_open,
+    flac_backend_read,
+    flac_backend_seek,
+    flac_backend_duration,
+    flac_backend_tags,
+    NULL,
+    NULL,
+    flac_backend_close,
+};
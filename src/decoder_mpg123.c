@@ -0,0 +1,206 @@
+#include "decoder.h"
+#include "id3tag.h"
+#include "mapfile.h"
+#include "mpegaudio.h"
+#include "seekindex.h"
+
+#include <mpg123.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+typedef struct {
+  Decoder base;
+  mpg123_handle *mh;
+  MapReader reader; // mpg123 reads the mapped file through this
+  bool use_seekindex; // the seek index cache is control-thread only
+} Mpg123Decoder;
+
+// 0 = not yet, 1 = in progress, 2 = ready. Analysis workers may open the
+// first file concurrently with the control thread.
+static atomic_int g_mpg123_init_state = 0;
+
+static bool mpg123_ensure_init(void) {
+  int expected = 0;
+  if (atomic_compare_exchange_strong(&g_mpg123_init_state, &expected, 1)) {
+    if (mpg123_init() != MPG123_OK) {
+      fprintf(stderr, "mpg123 init failed\n");
+      atomic_store(&g_mpg123_init_state, 0);
+      return false;
+    }
+    atomic_store(&g_mpg123_init_state, 2);
+    return true;
+  }
+  while (atomic_load(&g_mpg123_init_state) == 1)
+    Sleep(0);
+  return atomic_load(&g_mpg123_init_state) == 2;
+}
+
+// ---- reader callbacks over the file mapping ----
+
+static ssize_t mpg123_map_read(void *handle, void *buf, size_t count) {
+  return (ssize_t)mapreader_read(handle, buf, count);
+}
+
+static off_t mpg123_map_lseek(void *handle, off_t offset, int whence) {
+  return (off_t)mapreader_seek(handle, (int64_t)offset, whence);
+}
+
+static bool mpg123_probe(const unsigned char *head, size_t len,
+                         bool after_id3) {
+  // an ID3v2 tag in front of anything the other backends did not claim
+  if (after_id3)
+    return true;
+  // MPEG audio frame sync with a valid layer
+  return len >= 2 && head[0] == 0xFF && (head[1] & 0xE0) == 0xE0 &&
+         ((head[1] >> 1) & 0x03) != 0;
+}
+
+static Decoder *mpg123_backend_open(const char *filepath, unsigned flags) {
+  if (!mpg123_ensure_init())
+    return NULL;
+  bool use_seekindex = !(flags & DECODER_OPEN_BACKGROUND);
+
+  // The reader lives in the decoder, so allocate that first
+  Mpg123Decoder *d = calloc(1, sizeof(Mpg123Decoder));
+  if (!d)
+    return NULL;
+  d->reader.map = mapfile_open(filepath);
+  if (!d->reader.map) {
+    fprintf(stderr, "[audio] cannot open %s\n", filepath);
+    free(d);
+    return NULL;
+  }
+
+  // ---- Open and configure mpg123 ----
+  int err = 0;
+  mpg123_handle *mh = mpg123_new(NULL, &err);
+  if (!mh) {
+    fprintf(stderr, "[audio] mpg123_new failed: %s\n",
+            mpg123_plain_strerror(err));
+    goto fail;
+  }
+
+  // Trim encoder delay/padding (LAME/Xing header) so tracks splice cleanly
+  mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_GAPLESS, 0.0);
+  // Negative size: the frame index grows with the file instead of
+  // thinning out, so every frame stays directly addressable for seeks
+  mpg123_param(mh, MPG123_INDEX_SIZE, -1000, 0.0);
+
+  // Tags and audio come straight from the shared mapping instead of
+  // mpg123's own buffered reads of the file
+  if (mpg123_replace_reader_handle(mh, mpg123_map_read, mpg123_map_lseek,
+                                   NULL) != MPG123_OK ||
+      mpg123_open_handle(mh, &d->reader) != MPG123_OK) {
+    fprintf(stderr, "[audio] mpg123_open failed for %s\n", filepath);
+    goto fail;
+  }
+
+  // Reuse the index from an earlier decode of this file, if we have one
+  if (use_seekindex)
+    seekindex_apply(filepath, d->reader.map, mh);
+
+  long rate;
+  int channels, encoding;
+  if (mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK) {
+    fprintf(stderr, "[audio] mpg123_getformat failed\n");
+    goto fail;
+  }
+
+  // Ask for float32 stereo at the same rate, the format the callback plays.
+  // Mono sources are duplicated, so every track shares the stream's
+  // channel layout.
+  mpg123_format_none(mh);
+  if (mpg123_format(mh, rate, MPG123_STEREO, MPG123_ENC_FLOAT_32) !=
+      MPG123_OK) {
+    fprintf(stderr, "[audio] mpg123_format failed\n");
+    goto fail;
+  }
+
+  // Re-query actual output format (mpg123 can adjust it)
+  if (mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK) {
+    fprintf(stderr, "[audio] mpg123_getformat (after format) failed\n");
+    goto fail;
+  }
+
+  decoder_init_base(&d->base, &decoder_mpg123_vtable, filepath);
+  d->base.rate = rate;
+  d->mh = mh;
+  d->use_seekindex = use_seekindex;
+  return &d->base;
+
+fail:
+  if (mh) {
+    mpg123_close(mh);
+    mpg123_delete(mh);
+  }
+  mapfile_release(d->reader.map);
+  free(d);
+  return NULL;
+}
+
+static DecoderResult mpg123_backend_read(Decoder *dec, float *dst,
+                                         size_t max_samples, size_t *done) {
+  Mpg123Decoder *d = (Mpg123Decoder *)dec;
+
+  size_t bytes = 0;
+  int err = mpg123_read(d->mh, (unsigned char *)dst,
+                        max_samples * sizeof(float), &bytes);
+  *done = bytes / sizeof(float);
+
+  if (err == MPG123_DONE)
+    return DECODER_DONE;
+  if (err != MPG123_OK && err != MPG123_NEW_FORMAT) {
+    fprintf(stderr, "[audio] mpg123_read error: %s\n", mpg123_strerror(d->mh));
+    return DECODER_ERROR;
+  }
+  return DECODER_OK;
+}
+
+static int64_t mpg123_backend_seek(Decoder *dec, int64_t frame) {
+  Mpg123Decoder *d = (Mpg123Decoder *)dec;
+  // mpg123 lands on the exact sample via its frame index
+  off_t landed = mpg123_seek(d->mh, (off_t)frame, SEEK_SET);
+  return landed < 0 ? -1 : (int64_t)landed;
+}
+
+static double mpg123_backend_duration(Decoder *dec) {
+  Mpg123Decoder *d = (Mpg123Decoder *)dec;
+  // Xing/Info header or bitrate * size; exact once decoded to the end
+  off_t frames = mpg123_length(d->mh);
+  if (frames <= 0 || dec->rate <= 0)
+    return 0.0;
+  return (double)frames / (double)dec->rate;
+}
+
+static bool mpg123_backend_tags(Decoder *dec, DecoderTags *out) {
+  Mpg123Decoder *d = (Mpg123Decoder *)dec;
+  // straight from the mapping: mpg123_scan would walk every frame just to
+  // reach the ID3v1 tag at the end
+  return id3_read_tags(d->reader.map->data, d->reader.map->size, out);
+}
+
+static void mpg123_backend_close(Decoder *dec) {
+  Mpg123Decoder *d = (Mpg123Decoder *)dec;
+  // keep the frame index for the next time this file is opened
+  if (d->use_seekindex)
+    seekindex_store(dec->path, d->reader.map, d->mh);
+  mpg123_close(d->mh);
+  mpg123_delete(d->mh);
+  mapfile_release(d->reader.map);
+  free(d);
+}
+
+const DecoderVTable decoder_mpg123_vtable = {
+    "mpg123",
+    mpg123_probe,
+    mpg123_backend_open,
+    mpg123_backend_read,
+    mpg123_backend_seek,
+    mpg123_backend_duration,
+    mpg123_backend_tags,
+    id3_read_tags,
+    mpeg_audio_duration,
+    mpg123_backend_close,
+};
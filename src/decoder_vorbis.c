@@ -0,0 +1,155 @@
+#include "decoder.h"
+#include "mapfile.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vorbis/vorbisfile.h>
+
+typedef struct {
+  Decoder base;
+  OggVorbis_File vf;
+  MapReader reader; // vorbisfile reads the mapped file through this
+  int src_channels;
+} VorbisDecoder;
+
+// ---- callbacks over the file mapping ----
+
+static size_t vorbis_read_cb(void *ptr, size_t size, size_t nmemb,
+                             void *src) {
+  if (size == 0)
+    return 0;
+  return mapreader_read(src, ptr, size * nmemb) / size;
+}
+
+static int vorbis_seek_cb(void *src, ogg_int64_t offset, int whence) {
+  return mapreader_seek(src, (int64_t)offset, whence) < 0 ? -1 : 0;
+}
+
+static long vorbis_tell_cb(void *src) { return (long)((MapReader *)src)->pos; }
+
+static bool vorbis_probe(const unsigned char *head, size_t len,
+                         bool after_id3) {
+  (void)after_id3;
+  // Ogg page whose first packet is a Vorbis identification header
+  return len >= 35 && memcmp(head, "OggS", 4) == 0 &&
+         memcmp(head + 28, "\x01vorbis", 7) == 0;
+}
+
+static Decoder *vorbis_backend_open(const char *filepath, unsigned flags) {
+  (void)flags;
+  VorbisDecoder *d = calloc(1, sizeof(VorbisDecoder));
+  if (!d)
+    return NULL;
+  decoder_init_base(&d->base, &decoder_vorbis_vtable, filepath);
+
+  d->reader.map = mapfile_open(filepath);
+  if (!d->reader.map) {
+    free(d);
+    return NULL;
+  }
+
+  // no close callback: the mapping is released with the decoder
+  ov_callbacks cb = {vorbis_read_cb, vorbis_seek_cb, NULL, vorbis_tell_cb};
+  if (ov_open_callbacks(&d->reader, &d->vf, NULL, 0, cb) != 0) {
+    fprintf(stderr, "[decoder] not a readable Ogg Vorbis file: %s\n",
+            filepath);
+    mapfile_release(d->reader.map);
+    free(d);
+    return NULL;
+  }
+
+  vorbis_info *vi = ov_info(&d->vf, -1);
+  if (!vi || vi->channels < 1) {
+    ov_clear(&d->vf);
+    mapfile_release(d->reader.map);
+    free(d);
+    return NULL;
+  }
+  d->base.rate = vi->rate;
+  d->src_channels = vi->channels;
+  return &d->base;
+}
+
+static DecoderResult vorbis_backend_read(Decoder *dec, float *dst,
+                                         size_t max_samples, size_t *done) {
+  VorbisDecoder *d = (VorbisDecoder *)dec;
+  *done = 0;
+
+  int want = (int)(max_samples / 2);
+  if (want <= 0)
+    return DECODER_OK;
+
+  for (;;) {
+    float **pcm;
+    int section;
+    long frames = ov_read_float(&d->vf, &pcm, want, &section);
+    if (frames == 0)
+      return DECODER_DONE;
+    if (frames == OV_HOLE)
+      continue; // recoverable gap in the stream, keep going
+    if (frames < 0) {
+      fprintf(stderr, "[decoder] vorbis read error %ld\n", frames);
+      return DECODER_ERROR;
+    }
+
+    // Planar -> interleaved stereo
+    const float *left = pcm[0];
+    const float *right = d->src_channels > 1 ? pcm[1] : pcm[0];
+    for (long i = 0; i < frames; ++i) {
+      dst[2 * i] = left[i];
+      dst[2 * i + 1] = right[i];
+    }
+    *done = (size_t)frames * 2;
+    return DECODER_OK;
+  }
+}
+
+static int64_t vorbis_backend_seek(Decoder *dec, int64_t frame) {
+  VorbisDecoder *d = (VorbisDecoder *)dec;
+  if (ov_pcm_seek(&d->vf, (ogg_int64_t)frame) != 0)
+    return -1;
+  return (int64_t)ov_pcm_tell(&d->vf);
+}
+
+static double vorbis_backend_duration(Decoder *dec) {
+  VorbisDecoder *d = (VorbisDecoder *)dec;
+  ogg_int64_t frames = ov_pcm_total(&d->vf, -1);
+  if (frames <= 0 || dec->rate <= 0)
+    return 0.0;
+  return (double)frames / (double)dec->rate;
+}
+
+static bool vorbis_backend_tags(Decoder *dec, DecoderTags *out) {
+  VorbisDecoder *d = (VorbisDecoder *)dec;
+  vorbis_comment *vc = ov_comment(&d->vf, -1);
+  if (!vc)
+    return false;
+
+  bool any = false;
+  for (int i = 0; i < vc->comments; ++i) {
+    if (decoder_parse_comment(out, vc->user_comments[i],
+                              (size_t)vc->comment_lengths[i]))
+      any = true;
+  }
+  return any;
+}
+
+static void vorbis_backend_close(Decoder *dec) {
+  VorbisDecoder *d = (VorbisDecoder *)dec;
+  ov_clear(&d->vf);
+  mapfile_release(d->reader.map);
+  free(d);
+}
+
+const DecoderVTable decoder_vorbis_vtable = {
+    "vorbis",
+    vorbis_probe,
+    vorbis_backend_open,
+    vorbis_backend_read,
+    vorbis_backend_seek,
+    vorbis_backend_duration,
+    vorbis_backend_tags,
+    NULL,
+    NULL,
+    vorbis_backend_close,
+};
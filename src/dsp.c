@@ -0,0 +1,32 @@
+#include "dsp.h"
+
+void dsp_chain_init(DspChain *chain) { chain->count = 0; }
+
+bool dsp_chain_add(DspChain *chain, DspStage *stage) {
+  if (!stage || chain->count >= DSP_MAX_STAGES)
+    return false;
+  chain->stages[chain->count++] = stage;
+  return true;
+}
+
+void dsp_chain_prepare(DspChain *chain, long rate) {
+  for (int i = 0; i < chain->count; ++i)
+    chain->stages[i]->vt->prepare(chain->stages[i], rate);
+}
+
+void dsp_chain_process(DspChain *chain, float *buf, size_t frames) {
+  while (frames > 0) {
+    size_t n = frames < DSP_BLOCK_FRAMES ? frames : DSP_BLOCK_FRAMES;
+    // every stage on one block while it is still in cache
+    for (int i = 0; i < chain->count; ++i)
+      chain->stages[i]->vt->process(chain->stages[i], buf, n);
+    buf += n * 2;
+    frames -= n;
+  }
+}
+
+void dsp_chain_free(DspChain *chain) {
+  for (int i = 0; i < chain->count; ++i)
+    chain->stages[i]->vt->destroy(chain->stages[i]);
+  chain->count = 0;
+}
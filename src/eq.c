@@ -0,0 +1,342 @@
+#include "eq.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define EQ_SLOTS 3
+#define EQ_SLOT_MASK 3
+#define EQ_FRESH 4            // in `latest`: published, not taken yet
+#define EQ_FLAT_DB 0.01       // bands closer to 0 dB are skipped
+#define EQ_STATE_FLOOR 1e-20f // flushed to 0 so silence never goes denormal
+
+// One complete parameter set, as the audio thread uses it
+typedef struct {
+  int sections;
+  int band[EQ_MAX_BANDS];   // band (state slot) of each, in cascade order
+  float c[EQ_MAX_BANDS][5]; // b0 b1 b2 a1 a2, divided by a0
+} EqCoeffs;
+
+// Transposed direct form II memory of each band: z1 L R, z2 L R
+typedef float EqState[EQ_MAX_BANDS][4];
+
+typedef struct {
+  DspStage base;
+
+  // Control thread
+  EqBand bands[EQ_MAX_BANDS];
+  int count;
+  long rate;
+  int back; // slot being filled
+
+  // Parameter sets are double-buffered: the audio thread runs one while
+  // the control thread fills the other. The third lets the control thread
+  // publish again before the last one was taken, without ever waiting;
+  // slots only change hands through `latest`.
+  EqCoeffs sets[EQ_SLOTS];
+  atomic_int latest; // slot published last, | EQ_FRESH until taken
+
+  // Audio thread
+  int front; // slot in use
+  EqState state;
+  EqState old_state;                   // old settings, crossfade block
+  float old_out[DSP_BLOCK_FRAMES * 2]; // and their output
+} Eq;
+
+// ---- design ----
+
+static bool design_band(const EqBand *b, long rate, float c[5]) {
+  if (fabs(b->gain_db) < EQ_FLAT_DB || b->freq <= 0.0 ||
+      b->freq >= 0.49 * (double)rate)
+    return false;
+  double q = b->q < 0.1 ? 0.1 : b->q > 20.0 ? 20.0 : b->q;
+  double a = pow(10.0, b->gain_db / 40.0);
+  double w0 = 2.0 * M_PI * b->freq / (double)rate;
+  double cw = cos(w0);
+  double alpha = sin(w0) / (2.0 * q);
+  double sa = 2.0 * sqrt(a) * alpha;
+  double b0, b1, b2, a0, a1, a2;
+
+  switch (b->type) {
+  case EQ_LOW_SHELF:
+    b0 = a * ((a + 1.0) - (a - 1.0) * cw + sa);
+    b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cw);
+    b2 = a * ((a + 1.0) - (a - 1.0) * cw - sa);
+    a0 = (a + 1.0) + (a - 1.0) * cw + sa;
+    a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cw);
+    a2 = (a + 1.0) + (a - 1.0) * cw - sa;
+    break;
+  case EQ_HIGH_SHELF:
+    b0 = a * ((a + 1.0) + (a - 1.0) * cw + sa);
+    b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cw);
+    b2 = a * ((a + 1.0) + (a - 1.0) * cw - sa);
+    a0 = (a + 1.0) - (a - 1.0) * cw + sa;
+    a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cw);
+    a2 = (a + 1.0) - (a - 1.0) * cw - sa;
+    break;
+  default:
+    b0 = 1.0 + alpha * a;
+    b1 = -2.0 * cw;
+    b2 = 1.0 - alpha * a;
+    a0 = 1.0 + alpha / a;
+    a1 = -2.0 * cw;
+    a2 = 1.0 - alpha / a;
+    break;
+  }
+
+  c[0] = (float)(b0 / a0);
+  c[1] = (float)(b1 / a0);
+  c[2] = (float)(b2 / a0);
+  c[3] = (float)(a1 / a0);
+  c[4] = (float)(a2 / a0);
+  return true;
+}
+
+static void design(const Eq *eq, EqCoeffs *out) {
+  out->sections = 0;
+  if (eq->rate <= 0)
+    return;
+  for (int i = 0; i < eq->count; ++i) {
+    if (design_band(&eq->bands[i], eq->rate, out->c[out->sections]))
+      out->band[out->sections++] = i;
+  }
+}
+
+// ---- filtering ----
+
+// One section on one frame, both channels
+static inline void biquad_frame(const float *c, float *z, float *x) {
+  for (int ch = 0; ch < 2; ++ch) {
+    float in = x[ch];
+    float y = c[0] * in + z[ch];
+    z[ch] = (c[1] * in + z[2 + ch]) - c[3] * y;
+    z[2 + ch] = c[2] * in - c[4] * y;
+    x[ch] = y;
+  }
+}
+
+static void biquad_block(const float *c, float *z, float *buf, size_t frames) {
+  for (size_t f = 0; f < frames; ++f)
+    biquad_frame(c, z, buf + 2 * f);
+}
+
+#ifdef __SSE2__
+// Two consecutive sections of the cascade in one register: lanes are
+// [first L, first R, second L, second R]. The recursion forbids working
+// on several frames of one section at once, so the second section runs
+// one frame behind the first and takes its output straight from the
+// lower lanes.
+static void biquad_pair_block(const float *ca, float *za, const float *cb,
+                              float *zb, float *buf, size_t frames) {
+  biquad_frame(ca, za, buf); // the first section leads by one frame
+
+  __m128 b0 = _mm_setr_ps(ca[0], ca[0], cb[0], cb[0]);
+  __m128 b1 = _mm_setr_ps(ca[1], ca[1], cb[1], cb[1]);
+  __m128 b2 = _mm_setr_ps(ca[2], ca[2], cb[2], cb[2]);
+  __m128 a1 = _mm_setr_ps(ca[3], ca[3], cb[3], cb[3]);
+  __m128 a2 = _mm_setr_ps(ca[4], ca[4], cb[4], cb[4]);
+  __m128 zero = _mm_setzero_ps();
+  __m128 z1 = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64 *)za),
+                           (const __m64 *)zb);
+  __m128 z2 = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64 *)(za + 2)),
+                           (const __m64 *)(zb + 2));
+  __m128 y = _mm_loadl_pi(zero, (const __m64 *)buf);
+
+  for (size_t f = 1; f < frames; ++f) {
+    __m128 in = _mm_loadl_pi(zero, (const __m64 *)(buf + 2 * f));
+    __m128 x = _mm_movelh_ps(in, y); // frame f; first's output for f - 1
+    y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+    // the part not waiting on y first: shorter dependency chain
+    z1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(b1, x), z2), _mm_mul_ps(a1, y));
+    z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+    _mm_storeh_pi((__m64 *)(buf + 2 * (f - 1)), y);
+  }
+
+  _mm_storel_pi((__m64 *)za, z1);
+  _mm_storeh_pi((__m64 *)zb, z1);
+  _mm_storel_pi((__m64 *)(za + 2), z2);
+  _mm_storeh_pi((__m64 *)(zb + 2), z2);
+
+  // the second section catches up on the last frame
+  float *last = buf + 2 * (frames - 1);
+  _mm_storel_pi((__m64 *)last, y);
+  biquad_frame(cb, zb, last);
+}
+#endif
+
+static void run_cascade(const EqCoeffs *set, EqState state, float *buf,
+                        size_t frames) {
+  int s = 0;
+#ifdef __SSE2__
+  for (; s + 2 <= set->sections; s += 2)
+    biquad_pair_block(set->c[s], state[set->band[s]], set->c[s + 1],
+                      state[set->band[s + 1]], buf, frames);
+  if (s < set->sections) {
+    // An odd one out is paired with a pass-through section, which is
+    // still quicker than the scalar loop
+    static const float through[5] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    float unused[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    biquad_pair_block(set->c[s], state[set->band[s]], through, unused, buf,
+                      frames);
+    ++s;
+  }
+#endif
+  for (; s < set->sections; ++s)
+    biquad_block(set->c[s], state[set->band[s]], buf, frames);
+
+  for (s = 0; s < set->sections; ++s) {
+    float *z = state[set->band[s]];
+    for (int k = 0; k < 4; ++k)
+      if (fabsf(z[k]) < EQ_STATE_FLOOR)
+        z[k] = 0.0f;
+  }
+}
+
+static bool uses_band(const EqCoeffs *set, int band) {
+  for (int s = 0; s < set->sections; ++s)
+    if (set->band[s] == band)
+      return true;
+  return false;
+}
+
+// ---- stage ----
+
+static void eq_process(DspStage *stage, float *buf, size_t frames) {
+  Eq *eq = (Eq *)stage;
+  const EqCoeffs *old = NULL;
+  if (atomic_load_explicit(&eq->latest, memory_order_relaxed) & EQ_FRESH) {
+    old = &eq->sets[eq->front];
+    int taken = atomic_exchange(&eq->latest, eq->front);
+    eq->front = taken & EQ_SLOT_MASK;
+  }
+  const EqCoeffs *set = &eq->sets[eq->front];
+
+  if (old && (old->sections > 0 || set->sections > 0)) {
+    // Run the old settings on a copy as well and fade over to the new
+    // ones, which continue from the same filter memory
+    memcpy(eq->old_state, eq->state, sizeof(EqState));
+    memcpy(eq->old_out, buf, frames * 2 * sizeof(float));
+    run_cascade(old, eq->old_state, eq->old_out, frames);
+
+    // a band that was off starts from silence
+    for (int s = 0; s < set->sections; ++s)
+      if (!uses_band(old, set->band[s]))
+        memset(eq->state[set->band[s]], 0, sizeof(eq->state[0]));
+    run_cascade(set, eq->state, buf, frames);
+
+    float step = 1.0f / (float)frames;
+    for (size_t f = 0; f < frames; ++f) {
+      float t = (float)(f + 1) * step;
+      for (int ch = 0; ch < 2; ++ch) {
+        float o = eq->old_out[2 * f + ch];
+        buf[2 * f + ch] = o + (buf[2 * f + ch] - o) * t;
+      }
+    }
+    return;
+  }
+
+  run_cascade(set, eq->state, buf, frames);
+}
+
+static void eq_prepare(DspStage *stage, long rate) {
+  Eq *eq = (Eq *)stage;
+  eq->rate = rate;
+  // Nothing runs concurrently here: design straight into the set in use
+  // and drop a publication that was made for the old rate
+  design(eq, &eq->sets[eq->front]);
+  atomic_store(&eq->latest, atomic_load(&eq->latest) & EQ_SLOT_MASK);
+  memset(eq->state, 0, sizeof(EqState));
+}
+
+static void eq_destroy(DspStage *stage) { free(stage); }
+
+static const DspStageVTable eq_vtable = {
+    .name = "eq",
+    .prepare = eq_prepare,
+    .process = eq_process,
+    .destroy = eq_destroy,
+};
+
+DspStage *eq_create(void) {
+  Eq *eq = calloc(1, sizeof(Eq));
+  if (!eq)
+    return NULL;
+  eq->base.vt = &eq_vtable;
+  eq->front = 0;
+  atomic_init(&eq->latest, 1);
+  eq->back = 2;
+  return &eq->base;
+}
+
+void eq_set_bands(DspStage *stage, const EqBand *bands, int count) {
+  Eq *eq = (Eq *)stage;
+  if (count > EQ_MAX_BANDS)
+    count = EQ_MAX_BANDS;
+  if (count <= 0 || !bands)
+    count = 0;
+  else
+    memcpy(eq->bands, bands, (size_t)count * sizeof(EqBand));
+  eq->count = count;
+
+  design(eq, &eq->sets[eq->back]);
+  int prev = atomic_exchange(&eq->latest, eq->back | EQ_FRESH);
+  eq->back = prev & EQ_SLOT_MASK;
+}
+
+// ---- presets ----
+
+typedef struct {
+  const char *name;
+  int count;
+  EqBand bands[10];
+} EqPreset;
+
+static const EqPreset g_presets[] = {
+    {"Flat", 0, {{0}}},
+    {"Bass", 2, {{EQ_LOW_SHELF, 90.0, 6.0, 0.707},
+                 {EQ_PEAK, 250.0, -1.5, 1.0}}},
+    {"Treble", 2, {{EQ_PEAK, 3000.0, 1.5, 0.8},
+                   {EQ_HIGH_SHELF, 8000.0, 5.0, 0.707}}},
+    {"Loudness", 3, {{EQ_LOW_SHELF, 80.0, 6.0, 0.707},
+                     {EQ_PEAK, 2500.0, -2.0, 1.0},
+                     {EQ_HIGH_SHELF, 10000.0, 4.0, 0.707}}},
+    {"Vocal", 3, {{EQ_LOW_SHELF, 120.0, -3.0, 0.707},
+                  {EQ_PEAK, 1000.0, 2.0, 0.7},
+                  {EQ_PEAK, 3500.0, 3.5, 1.2}}},
+    // classic ten-band graphic, octave-spaced, in a gentle "smile"
+    {"V-shape", 10, {{EQ_PEAK, 31.0, 5.0, 1.4},
+                     {EQ_PEAK, 62.0, 4.0, 1.4},
+                     {EQ_PEAK, 125.0, 2.5, 1.4},
+                     {EQ_PEAK, 250.0, 0.5, 1.4},
+                     {EQ_PEAK, 500.0, -1.5, 1.4},
+                     {EQ_PEAK, 1000.0, -2.0, 1.4},
+                     {EQ_PEAK, 2000.0, -0.5, 1.4},
+                     {EQ_PEAK, 4000.0, 1.5, 1.4},
+                     {EQ_PEAK, 8000.0, 3.5, 1.4},
+                     {EQ_PEAK, 16000.0, 4.5, 1.4}}},
+};
+
+#define EQ_PRESETS ((int)(sizeof(g_presets) / sizeof(g_presets[0])))
+
+int eq_preset_count(void) { return EQ_PRESETS; }
+
+const char *eq_preset_name(int preset) {
+  return preset >= 0 && preset < EQ_PRESETS ? g_presets[preset].name : "?";
+}
+
+int eq_preset_bands(int preset, EqBand *out) {
+  if (preset < 0 || preset >= EQ_PRESETS)
+    return 0;
+  memcpy(out, g_presets[preset].bands,
+         (size_t)g_presets[preset].count * sizeof(EqBand));
+  return g_presets[preset].count;
+}
@@ -0,0 +1,262 @@
+#include "id3tag.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ID3_HEADER 10
+#define ID3V1_SIZE 128
+#define ID3_FRAME_MAX 4096 // bytes of a text frame we look at
+
+typedef enum { TEXT_LATIN1, TEXT_UTF16, TEXT_UTF16BE, TEXT_UTF8 } TextEncoding;
+
+static uint32_t be32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t syncsafe32(const unsigned char *p) {
+  return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) |
+         ((uint32_t)(p[2] & 0x7F) << 7) | (uint32_t)(p[3] & 0x7F);
+}
+
+// Undo unsynchronisation (FF 00 -> FF); returns the new length
+static size_t unsync(unsigned char *buf, size_t len) {
+  size_t out = 0;
+  for (size_t i = 0; i < len; ++i) {
+    buf[out++] = buf[i];
+    if (buf[i] == 0xFF && i + 1 < len && buf[i + 1] == 0x00)
+      i++;
+  }
+  return out;
+}
+
+// ---- text ----
+
+// Append one code point as UTF-8 if it fits whole
+static bool put_utf8(char *dst, size_t dst_size, size_t *pos, uint32_t cp) {
+  unsigned char seq[4];
+  size_t n;
+  if (cp < 0x80) {
+    seq[0] = (unsigned char)cp;
+    n = 1;
+  } else if (cp < 0x800) {
+    seq[0] = (unsigned char)(0xC0 | (cp >> 6));
+    seq[1] = (unsigned char)(0x80 | (cp & 0x3F));
+    n = 2;
+  } else if (cp < 0x10000) {
+    seq[0] = (unsigned char)(0xE0 | (cp >> 12));
+    seq[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+    seq[2] = (unsigned char)(0x80 | (cp & 0x3F));
+    n = 3;
+  } else {
+    seq[0] = (unsigned char)(0xF0 | (cp >> 18));
+    seq[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+    seq[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+    seq[3] = (unsigned char)(0x80 | (cp & 0x3F));
+    n = 4;
+  }
+  if (*pos + n >= dst_size)
+    return false;
+  memcpy(dst + *pos, seq, n);
+  *pos += n;
+  return true;
+}
+
+// First value of a text field as UTF-8, without trailing padding
+static void copy_text(char *dst, size_t dst_size, const unsigned char *src,
+                      size_t len, TextEncoding enc) {
+  size_t pos = 0;
+  if (enc == TEXT_UTF16 || enc == TEXT_UTF16BE) {
+    bool big = enc == TEXT_UTF16BE;
+    size_t i = 0;
+    if (enc == TEXT_UTF16 && len >= 2) {
+      if (src[0] == 0xFE && src[1] == 0xFF) {
+        big = true;
+        i = 2;
+      } else if (src[0] == 0xFF && src[1] == 0xFE) {
+        i = 2;
+      }
+    }
+    for (; i + 1 < len; i += 2) {
+      uint32_t cu = big ? (uint32_t)(src[i] << 8 | src[i + 1])
+                        : (uint32_t)(src[i + 1] << 8 | src[i]);
+      if (cu == 0)
+        break;
+      if (cu >= 0xD800 && cu < 0xDC00 && i + 3 < len) {
+        uint32_t lo = big ? (uint32_t)(src[i + 2] << 8 | src[i + 3])
+                          : (uint32_t)(src[i + 3] << 8 | src[i + 2]);
+        if (lo >= 0xDC00 && lo < 0xE000) {
+          cu = 0x10000 + ((cu - 0xD800) << 10) + (lo - 0xDC00);
+          i += 2;
+        }
+      }
+      if (!put_utf8(dst, dst_size, &pos, cu))
+        break;
+    }
+  } else if (enc == TEXT_UTF8) {
+    size_t n = 0;
+    while (n < len && src[n])
+      n++;
+    if (n >= dst_size)
+      n = dst_size - 1;
+    while (n > 0 && n < len && (src[n] & 0xC0) == 0x80)
+      n--; // do not cut a character in half
+    memcpy(dst, src, n);
+    pos = n;
+  } else {
+    for (size_t i = 0; i < len && src[i]; ++i)
+      if (!put_utf8(dst, dst_size, &pos, src[i]))
+        break;
+  }
+  while (pos > 0 && dst[pos - 1] == ' ')
+    pos--;
+  dst[pos] = '\0';
+}
+
+// ---- ID3v2 ----
+
+size_t id3_v2_size(const unsigned char *data, size_t size) {
+  if (size < ID3_HEADER || memcmp(data, "ID3", 3) != 0)
+    return 0;
+  size_t len = ID3_HEADER + syncsafe32(data + 6);
+  if (data[5] & 0x10)
+    len += ID3_HEADER; // footer present
+  return len;
+}
+
+// The field a frame fills, or NULL for the frames we skip
+static char *frame_field(const unsigned char *id, int version,
+                         DecoderTags *out) {
+  if (version == 2) {
+    if (memcmp(id, "TT2", 3) == 0)
+      return out->title;
+    if (memcmp(id, "TP1", 3) == 0)
+      return out->artist;
+    if (memcmp(id, "TAL", 3) == 0)
+      return out->album;
+    return NULL;
+  }
+  if (memcmp(id, "TIT2", 4) == 0)
+    return out->title;
+  if (memcmp(id, "TPE1", 4) == 0)
+    return out->artist;
+  if (memcmp(id, "TALB", 4) == 0)
+    return out->album;
+  return NULL;
+}
+
+static void text_frame(char *field, const unsigned char *p, size_t len,
+                       bool frame_unsync) {
+  unsigned char buf[ID3_FRAME_MAX];
+  if (frame_unsync) {
+    len = len < sizeof(buf) ? len : sizeof(buf);
+    memcpy(buf, p, len);
+    len = unsync(buf, len);
+    p = buf;
+  }
+  if (len < 2 || p[0] > TEXT_UTF8)
+    return;
+  // every field in DecoderTags has the same size
+  copy_text(field, sizeof(((DecoderTags *)0)->title), p + 1, len - 1,
+            (TextEncoding)p[0]);
+}
+
+// Walk the frames of a tag body (after the header), skipping all but the
+// three text frames by their sizes
+static void parse_v2_frames(const unsigned char *p, size_t len, int version,
+                            DecoderTags *out) {
+  size_t header = version == 2 ? 6 : 10;
+  size_t pos = 0;
+  while (pos + header <= len) {
+    const unsigned char *f = p + pos;
+    if (f[0] == 0)
+      break; // padding
+    size_t size;
+    if (version == 2)
+      size = ((size_t)f[3] << 16) | ((size_t)f[4] << 8) | f[5];
+    else if (version == 3)
+      size = be32(f + 4);
+    else
+      size = syncsafe32(f + 4);
+    if (size > len - pos - header)
+      break;
+
+    char *field = frame_field(f, version, out);
+    if (field && !field[0]) {
+      bool skip = false, frame_unsync = false;
+      size_t extra = 0; // group id, data length ahead of the text
+      if (version == 3) {
+        skip = (f[9] & 0xC0) != 0; // compressed or encrypted
+        extra = (f[9] & 0x20) ? 1 : 0;
+      } else if (version == 4) {
+        skip = (f[9] & 0x0C) != 0;
+        frame_unsync = (f[9] & 0x02) != 0;
+        extra = ((f[9] & 0x40) ? 1 : 0) + ((f[9] & 0x01) ? 4 : 0);
+      }
+      if (!skip && extra < size)
+        text_frame(field, f + header + extra, size - extra, frame_unsync);
+    }
+    pos += header + size;
+  }
+}
+
+static bool parse_v2(const unsigned char *data, size_t size,
+                     DecoderTags *out) {
+  size_t tag_len = id3_v2_size(data, size);
+  int version = tag_len ? data[3] : 0;
+  if (version < 2 || version > 4)
+    return false;
+  unsigned flags = data[5];
+  size_t body_len = syncsafe32(data + 6);
+  if (body_len > size - ID3_HEADER)
+    body_len = size - ID3_HEADER;
+  const unsigned char *body = data + ID3_HEADER;
+
+  // before 2.4, unsynchronisation covers the whole tag; undo it on a copy
+  unsigned char *copy = NULL;
+  if ((flags & 0x80) && version < 4) {
+    copy = malloc(body_len ? body_len : 1);
+    if (!copy)
+      return true;
+    memcpy(copy, body, body_len);
+    body_len = unsync(copy, body_len);
+    body = copy;
+  }
+
+  if ((flags & 0x40) && version >= 3 && body_len >= 4) {
+    size_t ext = version == 3 ? 4 + be32(body) : syncsafe32(body);
+    if (ext > body_len)
+      ext = body_len;
+    body += ext;
+    body_len -= ext;
+  }
+  if (version > 2 || !(flags & 0x40)) // 2.2 used this bit for compression
+    parse_v2_frames(body, body_len, version, out);
+  free(copy);
+  return true;
+}
+
+// ---- ID3v1 ----
+
+static bool parse_v1(const unsigned char *data, size_t size, size_t v2_len,
+                     DecoderTags *out) {
+  if (size < v2_len + ID3V1_SIZE)
+    return false;
+  const unsigned char *t = data + size - ID3V1_SIZE;
+  if (memcmp(t, "TAG", 3) != 0)
+    return false;
+  if (!out->title[0])
+    copy_text(out->title, sizeof(out->title), t + 3, 30, TEXT_LATIN1);
+  if (!out->artist[0])
+    copy_text(out->artist, sizeof(out->artist), t + 33, 30, TEXT_LATIN1);
+  if (!out->album[0])
+    copy_text(out->album, sizeof(out->album), t + 63, 30, TEXT_LATIN1);
+  return true;
+}
+
+bool id3_read_tags(const unsigned char *data, size_t size, DecoderTags *out) {
+  bool v2 = parse_v2(data, size, out);
+  bool v1 = parse_v1(data, size, id3_v2_size(data, size), out);
+  return v2 || v1;
+}
@@ -0,0 +1,247 @@
+#include "kernels.h"
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// ---- Scalar fallback ----
+
+static void gain_copy_scalar(float *dst, const float *src, size_t count,
+                             float gain) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = src[i] * gain;
+  }
+}
+
+static float dot_scalar(const float *a, const float *b, size_t count) {
+  // four partial sums, same grouping as the vector versions
+  float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < count; ++i) {
+    s0 += a[i] * b[i];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+static void s16_to_float_scalar(float *dst, const int16_t *src, size_t count,
+                                float scale) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = (float)src[i] * scale;
+  }
+}
+
+static inline int16_t to_s16(float x) {
+  if (x > 32767.0f)
+    x = 32767.0f;
+  if (x < -32768.0f)
+    x = -32768.0f;
+  return (int16_t)lrintf(x);
+}
+
+static void float_to_s16_scalar(int16_t *dst, const float *src, size_t count,
+                                float scale) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[i] = to_s16(src[i] * scale);
+  }
+}
+
+static const AudioKernels g_scalar = {"scalar", gain_copy_scalar, dot_scalar,
+                                      s16_to_float_scalar,
+                                      float_to_s16_scalar};
+
+#ifdef KERNELS_X86
+
+// ---- SSE2: 8 samples per iteration ----
+
+__attribute__((target("sse2"))) static void
+gain_copy_sse2(float *dst, const float *src, size_t count, float gain) {
+  __m128 g = _mm_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128 a = _mm_loadu_ps(src + i);
+    __m128 b = _mm_loadu_ps(src + i + 4);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(a, g));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(b, g));
+  }
+  for (; i < count; ++i) {
+    dst[i] = src[i] * gain;
+  }
+}
+
+// ---- AVX2: 16 samples per iteration ----
+
+__attribute__((target("avx2"))) static void
+gain_copy_avx2(float *dst, const float *src, size_t count, float gain) {
+  __m256 g = _mm256_set1_ps(gain);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 a = _mm256_loadu_ps(src + i);
+    __m256 b = _mm256_loadu_ps(src + i + 8);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(a, g));
+    _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(b, g));
+  }
+  for (; i < count; ++i) {
+    dst[i] = src[i] * gain;
+  }
+}
+
+__attribute__((target("sse2"))) static float
+dot_sse2(const float *a, const float *b, size_t count) {
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                       _mm_loadu_ps(b + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+  float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < count; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+__attribute__((target("avx2"))) static float
+dot_avx2(const float *a, const float *b, size_t count) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+  }
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc),
+                           _mm256_extractf128_ps(acc, 1));
+  float lanes[4];
+  _mm_storeu_ps(lanes, half);
+  float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for (; i < count; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// ---- int16 <-> float: 8 samples per SSE2 and 16 per AVX2 iteration ----
+
+__attribute__((target("sse2"))) static void
+s16_to_float_sse2(float *dst, const int16_t *src, size_t count, float scale) {
+  __m128 k = _mm_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    // each int16 into the top half of a lane, then sign-extended down
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+  }
+  for (; i < count; ++i) {
+    dst[i] = (float)src[i] * scale;
+  }
+}
+
+__attribute__((target("sse2"))) static void
+float_to_s16_sse2(int16_t *dst, const float *src, size_t count, float scale) {
+  __m128 k = _mm_set1_ps(scale);
+  __m128 top = _mm_set1_ps(32767.0f), bottom = _mm_set1_ps(-32768.0f);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    // clamped first: out-of-range conversions would wrap to INT_MIN
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), k);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), k);
+    a = _mm_max_ps(_mm_min_ps(a, top), bottom);
+    b = _mm_max_ps(_mm_min_ps(b, top), bottom);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128((__m128i *)(dst + i), packed);
+  }
+  for (; i < count; ++i) {
+    dst[i] = to_s16(src[i] * scale);
+  }
+}
+
+__attribute__((target("avx2"))) static void
+s16_to_float_avx2(float *dst, const int16_t *src, size_t count, float scale) {
+  __m256 k = _mm256_set1_ps(scale);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a));
+    __m256 fb = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(fa, k));
+    _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(fb, k));
+  }
+  for (; i < count; ++i) {
+    dst[i] = (float)src[i] * scale;
+  }
+}
+
+__attribute__((target("avx2"))) static void
+float_to_s16_avx2(int16_t *dst, const float *src, size_t count, float scale) {
+  __m256 k = _mm256_set1_ps(scale);
+  __m256 top = _mm256_set1_ps(32767.0f), bottom = _mm256_set1_ps(-32768.0f);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), k);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), k);
+    a = _mm256_max_ps(_mm256_min_ps(a, top), bottom);
+    b = _mm256_max_ps(_mm256_min_ps(b, top), bottom);
+    // packs works within 128-bit lanes; put the quarters back in order
+    __m256i packed =
+        _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    packed = _mm256_permute4x64_epi64(packed, 0xD8);
+    _mm256_storeu_si256((__m256i *)(dst + i), packed);
+  }
+  for (; i < count; ++i) {
+    dst[i] = to_s16(src[i] * scale);
+  }
+}
+
+static const AudioKernels g_sse2 = {"sse2", gain_copy_sse2, dot_sse2,
+                                    s16_to_float_sse2, float_to_s16_sse2};
+static const AudioKernels g_avx2 = {"avx2", gain_copy_avx2, dot_avx2,
+                                    s16_to_float_avx2, float_to_s16_avx2};
+
+#endif
+
+static const AudioKernels *g_active = &g_scalar;
+
+int kernels_available(const AudioKernels **out, int max) {
+  int count = 0;
+  if (count < max)
+    out[count++] = &g_scalar;
+
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  if (count < max && __builtin_cpu_supports("sse2"))
+    out[count++] = &g_sse2;
+  if (count < max && __builtin_cpu_supports("avx2"))
+    out[count++] = &g_avx2;
+#endif
+
+  return count;
+}
+
+void kernels_init(void) {
+  const AudioKernels *list[8];
+  int count = kernels_available(list, 8);
+  g_active = list[count - 1];
+}
+
+const AudioKernels *kernels_active(void) { return g_active; }
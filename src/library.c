@@ -0,0 +1,572 @@
+#include "library.h"
+#include "decoder.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#define LIBRARY_MAGIC "MPLIBIDX"
+#define LIBRARY_VERSION 1
+#define LIBRARY_INTERN_INIT 4096 // slots, power of two
+
+// File layout: header, records, root offsets (uint32), strings. Strings
+// are NUL-terminated UTF-8, each stored once; offset 0 is "".
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size; // sizeof(LibraryRecord), as a layout check
+  uint32_t track_count;
+  uint32_t root_count;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+  uint64_t file_size;
+} LibraryHeader;
+
+typedef struct {
+  uint64_t size;
+  uint64_t mtime; // FILETIME ticks
+  double duration;
+  uint32_t path, title, artist, album; // offsets into the strings
+} LibraryRecord;
+
+static wchar_t g_index_path[MAX_PATH];
+
+// The mapped index, read by the check thread until it is stopped
+static const uint8_t *g_view;
+static const LibraryRecord *g_records;
+static const char *g_strings;
+static uint32_t g_record_count;
+
+// Check thread; its results are guarded by g_lock
+static HANDLE g_thread;
+static atomic_bool g_stop;
+static CRITICAL_SECTION g_lock;
+static bool g_lock_ready;
+static LibraryChange *g_changes; // FIFO
+static size_t g_change_head, g_change_count, g_change_cap;
+static bool *g_missing;
+static bool g_checked; // finished, missing not taken yet
+
+static char *g_roots[LIBRARY_MAX_ROOTS];
+static int g_root_count;
+
+static bool index_locate(void) {
+  if (g_index_path[0])
+    return true;
+  wchar_t dir[MAX_PATH];
+  DWORD n = ExpandEnvironmentStringsW(L"%LOCALAPPDATA%\\MusicPlayer", dir,
+                                      MAX_PATH);
+  if (n == 0 || n > MAX_PATH || dir[0] == L'%')
+    return false; // no LOCALAPPDATA: the playlist lives for this session
+  CreateDirectoryW(dir, NULL); // fine if it already exists
+  swprintf(g_index_path, MAX_PATH, L"%ls\\library.idx", dir);
+  return true;
+}
+
+// Unlike strncpy, leaves the rest of `dst` alone: zero-filling Track's
+// fixed arrays would cost more than the copy
+static void copy_string(char *dst, size_t dst_size, const char *src) {
+  size_t n = strnlen(src, dst_size - 1);
+  memcpy(dst, src, n);
+  dst[n] = '\0';
+}
+
+static uint64_t filetime_u64(FILETIME ft) {
+  return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+// ---- loading ----
+
+static void index_unmap(void) {
+  if (g_view)
+    UnmapViewOfFile(g_view);
+  g_view = NULL;
+  g_records = NULL;
+  g_strings = NULL;
+  g_record_count = 0;
+}
+
+// Everything library_load relies on, so a damaged file is refused as a
+// whole rather than read out of bounds
+static bool index_valid(const uint8_t *view, size_t size) {
+  const LibraryHeader *h = (const LibraryHeader *)view;
+  if (size < sizeof(LibraryHeader) ||
+      memcmp(h->magic, LIBRARY_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != LIBRARY_VERSION ||
+      h->record_size != sizeof(LibraryRecord) || h->file_size != size ||
+      h->root_count > LIBRARY_MAX_ROOTS)
+    return false;
+
+  uint64_t tables = sizeof(LibraryHeader) +
+                    (uint64_t)h->track_count * sizeof(LibraryRecord) +
+                    (uint64_t)h->root_count * sizeof(uint32_t);
+  if (tables > h->strings_offset || h->strings_size == 0 ||
+      h->strings_offset + h->strings_size != size ||
+      view[size - 1] != '\0')
+    return false;
+
+  const LibraryRecord *r =
+      (const LibraryRecord *)(view + sizeof(LibraryHeader));
+  for (uint32_t i = 0; i < h->track_count; ++i) {
+    if (r[i].path >= h->strings_size || r[i].title >= h->strings_size ||
+        r[i].artist >= h->strings_size || r[i].album >= h->strings_size)
+      return false;
+  }
+  const uint32_t *roots = (const uint32_t *)(r + h->track_count);
+  for (uint32_t i = 0; i < h->root_count; ++i)
+    if (roots[i] >= h->strings_size)
+      return false;
+  return true;
+}
+
+bool library_load(TrackStore *tracks) {
+  if (g_view || !index_locate())
+    return false;
+
+  LARGE_INTEGER freq, t0, t1;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t0);
+
+  HANDLE file = CreateFileW(g_index_path, GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false; // first run
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+      (uint64_t)size.QuadPart > SIZE_MAX) {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (!mapping)
+    return false;
+  const uint8_t *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view)
+    return false;
+
+  if (!index_valid(view, (size_t)size.QuadPart)) {
+    fprintf(stderr, "[library] index is damaged or from another version; "
+                    "starting empty\n");
+    UnmapViewOfFile(view);
+    return false;
+  }
+
+  const LibraryHeader *h = (const LibraryHeader *)view;
+  const LibraryRecord *records =
+      (const LibraryRecord *)(view + sizeof(LibraryHeader));
+  const uint32_t *roots = (const uint32_t *)(records + h->track_count);
+  const char *strings = (const char *)view + h->strings_offset;
+
+  // positions in the store must match the records for the check's sake
+  bool ok = trackstore_reserve(tracks, (int)h->track_count);
+  Track t;
+  for (uint32_t i = 0; ok && i < h->track_count; ++i) {
+    const LibraryRecord *r = &records[i];
+    copy_string(t.filepath, sizeof(t.filepath), strings + r->path);
+    copy_string(t.title, sizeof(t.title), strings + r->title);
+    copy_string(t.artist, sizeof(t.artist), strings + r->artist);
+    copy_string(t.album, sizeof(t.album), strings + r->album);
+    t.duration = r->duration;
+    t.size = r->size;
+    t.mtime = r->mtime;
+    ok = trackstore_add(tracks, &t) >= 0;
+  }
+  if (!ok) {
+    fprintf(stderr, "[library] out of memory loading the index\n");
+    trackstore_free(tracks);
+    UnmapViewOfFile(view);
+    return false;
+  }
+  for (uint32_t i = 0; i < h->root_count; ++i)
+    library_add_root(strings + roots[i]);
+
+  g_view = view;
+  g_records = records;
+  g_strings = strings;
+  g_record_count = h->track_count;
+
+  QueryPerformanceCounter(&t1);
+  fprintf(stderr, "[library] %u tracks from the index in %.1f ms\n",
+          h->track_count,
+          (double)(t1.QuadPart - t0.QuadPart) * 1000.0 /
+              (double)freq.QuadPart);
+  return true;
+}
+
+// ---- background check ----
+
+static void push_change(const LibraryChange *c) {
+  EnterCriticalSection(&g_lock);
+  if (g_change_head + g_change_count == g_change_cap) {
+    if (g_change_head > 0) {
+      memmove(g_changes, g_changes + g_change_head,
+              g_change_count * sizeof(LibraryChange));
+      g_change_head = 0;
+    } else {
+      size_t cap = g_change_cap ? g_change_cap * 2 : 16;
+      LibraryChange *grown = realloc(g_changes, cap * sizeof(LibraryChange));
+      if (!grown) {
+        LeaveCriticalSection(&g_lock);
+        return; // the entry just stays as it was
+      }
+      g_changes = grown;
+      g_change_cap = cap;
+    }
+  }
+  g_changes[g_change_head + g_change_count++] = *c;
+  LeaveCriticalSection(&g_lock);
+}
+
+// Whether the drive or share a path is on is reachable at all, so that an
+// unplugged disk does not read as every one of its files deleted
+static bool volume_present(const wchar_t *path) {
+  wchar_t root[MAX_PATH];
+  size_t len = 0;
+  if (path[0] && path[1] == L':') {
+    len = 3; // "X:\"
+  } else if (path[0] == L'\\' && path[1] == L'\\') {
+    int slashes = 0;
+    while (path[len] && slashes < 4)
+      if (path[len++] == L'\\')
+        slashes++;
+  }
+  if (len == 0 || len >= MAX_PATH)
+    return true;
+  memcpy(root, path, len * sizeof(wchar_t));
+  root[len] = L'\0';
+  return GetFileAttributesW(root) != INVALID_FILE_ATTRIBUTES;
+}
+
+void library_read_track(const char *path, uint64_t size, uint64_t mtime,
+                        Track *t) {
+  memset(t, 0, sizeof(Track));
+  copy_string(t->filepath, sizeof(t->filepath), path);
+  const char *name = strrchr(path, '\\');
+  copy_string(t->title, sizeof(t->title), name ? name + 1 : path);
+  strcpy(t->artist, "Unknown Artist");
+  strcpy(t->album, "Unknown Album");
+  t->size = size;
+  t->mtime = mtime;
+
+  DecoderTags tags;
+  if (decoder_read_info(path, &tags, &t->duration)) {
+    if (tags.title[0])
+      copy_string(t->title, sizeof(t->title), tags.title);
+    if (tags.artist[0])
+      copy_string(t->artist, sizeof(t->artist), tags.artist);
+    if (tags.album[0])
+      copy_string(t->album, sizeof(t->album), tags.album);
+  }
+}
+
+static DWORD WINAPI check_main(LPVOID arg) {
+  (void)arg;
+  LARGE_INTEGER freq, t0, t1;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t0);
+  int changed = 0, missing = 0;
+
+  for (uint32_t i = 0; i < g_record_count; ++i) {
+    if (atomic_load(&g_stop))
+      return 0;
+    const LibraryRecord *r = &g_records[i];
+    const char *path = g_strings + r->path;
+    wchar_t path_w[DECODER_PATH_MAX];
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (MultiByteToWideChar(CP_UTF8, 0, path, -1, path_w,
+                            DECODER_PATH_MAX) <= 0)
+      continue;
+
+    if (!GetFileAttributesExW(path_w, GetFileExInfoStandard, &fad)) {
+      DWORD err = GetLastError();
+      if ((err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND) &&
+          volume_present(path_w)) {
+        g_missing[i] = true;
+        missing++;
+      }
+      continue;
+    }
+
+    uint64_t size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    uint64_t mtime = filetime_u64(fad.ftLastWriteTime);
+    // entries from before durations were read at scan time get one now
+    if (size == r->size && mtime == r->mtime && r->duration > 0.0)
+      continue;
+
+    LibraryChange c = {.index = (int)i};
+    library_read_track(path, size, mtime, &c.track);
+    push_change(&c);
+    changed++;
+  }
+
+  EnterCriticalSection(&g_lock);
+  g_checked = true;
+  LeaveCriticalSection(&g_lock);
+
+  QueryPerformanceCounter(&t1);
+  fprintf(stderr, "[library] checked %u files in %.1f s: %d changed, "
+                  "%d missing\n",
+          g_record_count,
+          (double)(t1.QuadPart - t0.QuadPart) / (double)freq.QuadPart,
+          changed, missing);
+  return 0;
+}
+
+static void check_stop(void) {
+  if (g_thread) {
+    atomic_store(&g_stop, true);
+    WaitForSingleObject(g_thread, INFINITE);
+    CloseHandle(g_thread);
+    g_thread = NULL;
+  }
+  index_unmap();
+}
+
+bool library_validate_start(void) {
+  if (g_thread)
+    return true;
+  if (g_record_count == 0)
+    return false;
+  if (!g_lock_ready) {
+    InitializeCriticalSection(&g_lock);
+    g_lock_ready = true;
+  }
+  g_missing = calloc(g_record_count, sizeof(bool));
+  if (!g_missing)
+    return false;
+  atomic_store(&g_stop, false);
+  g_thread = CreateThread(NULL, 0, check_main, NULL, 0, NULL);
+  if (!g_thread) {
+    free(g_missing);
+    g_missing = NULL;
+    return false;
+  }
+  SetThreadPriority(g_thread, THREAD_PRIORITY_LOWEST);
+  return true;
+}
+
+bool library_poll_change(LibraryChange *out) {
+  if (!g_lock_ready)
+    return false;
+  EnterCriticalSection(&g_lock);
+  bool got = g_change_count > 0;
+  if (got) {
+    *out = g_changes[g_change_head++];
+    if (--g_change_count == 0)
+      g_change_head = 0;
+  }
+  LeaveCriticalSection(&g_lock);
+  return got;
+}
+
+bool library_take_missing(bool **missing, int *count) {
+  if (!g_lock_ready)
+    return false;
+  EnterCriticalSection(&g_lock);
+  bool done = g_checked && g_change_count == 0;
+  if (done) {
+    *missing = g_missing;
+    *count = (int)g_record_count;
+    g_missing = NULL;
+    g_checked = false;
+  }
+  LeaveCriticalSection(&g_lock);
+  return done;
+}
+
+// ---- saving ----
+
+// String block being written, each distinct string stored once
+typedef struct {
+  char *data;
+  size_t len, cap;
+  uint32_t *slots; // offset + 1 of a string, 0 = empty
+  size_t slot_cap, used;
+} StringBlock;
+
+static bool block_init(StringBlock *b) {
+  memset(b, 0, sizeof(*b));
+  b->cap = 1 << 16;
+  b->data = malloc(b->cap);
+  if (!b->data)
+    return false;
+  b->data[0] = '\0'; // what offset 0 stands for
+  b->len = 1;
+  return true;
+}
+
+static uint32_t hash_string(const char *s) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (; *s; ++s)
+    h = (h ^ (uint8_t)*s) * 16777619u;
+  return h;
+}
+
+static bool block_grow_slots(StringBlock *b) {
+  size_t cap = b->slot_cap ? b->slot_cap * 2 : LIBRARY_INTERN_INIT;
+  uint32_t *slots = calloc(cap, sizeof(uint32_t));
+  if (!slots)
+    return false;
+  for (size_t i = 0; i < b->slot_cap; ++i) {
+    if (!b->slots[i])
+      continue;
+    size_t j = hash_string(b->data + b->slots[i] - 1) & (cap - 1);
+    while (slots[j])
+      j = (j + 1) & (cap - 1);
+    slots[j] = b->slots[i];
+  }
+  free(b->slots);
+  b->slots = slots;
+  b->slot_cap = cap;
+  return true;
+}
+
+// Offset of `s` in the block, added if new; UINT32_MAX when out of memory
+static uint32_t block_intern(StringBlock *b, const char *s) {
+  if (!*s)
+    return 0;
+  if ((b->used + 1) * 2 > b->slot_cap && !block_grow_slots(b))
+    return UINT32_MAX;
+
+  size_t j = hash_string(s) & (b->slot_cap - 1);
+  for (; b->slots[j]; j = (j + 1) & (b->slot_cap - 1))
+    if (strcmp(b->data + b->slots[j] - 1, s) == 0)
+      return b->slots[j] - 1;
+
+  size_t n = strlen(s) + 1;
+  if (b->len + n > UINT32_MAX - 1)
+    return UINT32_MAX;
+  if (b->len + n > b->cap) {
+    size_t cap = b->cap * 2 > b->len + n ? b->cap * 2 : b->len + n;
+    char *data = realloc(b->data, cap);
+    if (!data)
+      return UINT32_MAX;
+    b->data = data;
+    b->cap = cap;
+  }
+  uint32_t off = (uint32_t)b->len;
+  memcpy(b->data + off, s, n);
+  b->len += n;
+  b->slots[j] = off + 1;
+  b->used++;
+  return off;
+}
+
+bool library_save(const TrackStore *tracks) {
+  check_stop();
+  if (!index_locate())
+    return false;
+
+  int count = tracks->count;
+  char path[DECODER_PATH_MAX];
+
+  StringBlock b = {0};
+  LibraryRecord *records =
+      count > 0 ? malloc((size_t)count * sizeof(LibraryRecord)) : NULL;
+  uint32_t roots[LIBRARY_MAX_ROOTS];
+  bool ok = block_init(&b) && (count == 0 || records);
+
+  for (int i = 0; ok && i < count; ++i) {
+    const TrackRecord *t = &tracks->records[i];
+    LibraryRecord *r = &records[i];
+    r->size = t->size;
+    r->mtime = t->mtime;
+    r->duration = t->duration;
+    if (!trackstore_path(tracks, i, path, sizeof(path)))
+      path[0] = '\0';
+    r->path = block_intern(&b, path);
+    r->title = block_intern(&b, trackstore_title(tracks, i));
+    r->artist = block_intern(&b, trackstore_artist(tracks, i));
+    r->album = block_intern(&b, trackstore_album(tracks, i));
+    ok = r->path != UINT32_MAX && r->title != UINT32_MAX &&
+         r->artist != UINT32_MAX && r->album != UINT32_MAX;
+  }
+  for (int i = 0; ok && i < g_root_count; ++i) {
+    roots[i] = block_intern(&b, g_roots[i]);
+    ok = roots[i] != UINT32_MAX;
+  }
+
+  LibraryHeader h = {.version = LIBRARY_VERSION,
+                     .record_size = sizeof(LibraryRecord),
+                     .track_count = (uint32_t)count,
+                     .root_count = (uint32_t)g_root_count};
+  memcpy(h.magic, LIBRARY_MAGIC, sizeof(h.magic));
+  h.strings_offset = sizeof(LibraryHeader) +
+                     (uint64_t)count * sizeof(LibraryRecord) +
+                     (uint64_t)g_root_count * sizeof(uint32_t);
+  h.strings_size = b.len;
+  h.file_size = h.strings_offset + h.strings_size;
+
+  // Written to a temporary file and moved over the old one, so a crash
+  // never leaves a truncated index
+  wchar_t tmp_path[MAX_PATH];
+  swprintf(tmp_path, MAX_PATH, L"%ls.tmp", g_index_path);
+  FILE *f = ok ? _wfopen(tmp_path, L"wb") : NULL;
+  if (f) {
+    ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+         (count == 0 || fwrite(records, sizeof(LibraryRecord), (size_t)count,
+                               f) == (size_t)count) &&
+         (g_root_count == 0 ||
+          fwrite(roots, sizeof(uint32_t), (size_t)g_root_count, f) ==
+              (size_t)g_root_count) &&
+         fwrite(b.data, 1, b.len, f) == b.len;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && MoveFileExW(tmp_path, g_index_path, MOVEFILE_REPLACE_EXISTING);
+  } else {
+    ok = false;
+  }
+
+  if (ok)
+    fprintf(stderr, "[library] saved %d tracks, %zu bytes of strings\n",
+            count, b.len);
+  else
+    fprintf(stderr, "[library] cannot write the index\n");
+  free(records);
+  free(b.data);
+  free(b.slots);
+  return ok;
+}
+
+void library_shutdown(void) {
+  check_stop();
+  if (g_lock_ready) {
+    DeleteCriticalSection(&g_lock);
+    g_lock_ready = false;
+  }
+  free(g_changes);
+  g_changes = NULL;
+  g_change_head = g_change_count = g_change_cap = 0;
+  free(g_missing);
+  g_missing = NULL;
+  g_checked = false;
+  for (int i = 0; i < g_root_count; ++i)
+    free(g_roots[i]);
+  g_root_count = 0;
+}
+
+// ---- roots ----
+
+void library_add_root(const char *folder) {
+  for (int i = 0; i < g_root_count; ++i)
+    if (strcmp(g_roots[i], folder) == 0)
+      return;
+  if (g_root_count == LIBRARY_MAX_ROOTS)
+    return;
+  char *copy = malloc(strlen(folder) + 1);
+  if (!copy)
+    return;
+  strcpy(copy, folder);
+  g_roots[g_root_count++] = copy;
+}
+
+int library_root_count(void) { return g_root_count; }
+
+const char *library_root(int index) {
+  return index >= 0 && index < g_root_count ? g_roots[index] : NULL;
+}
@@ -0,0 +1,219 @@
+#include "loudness.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define LOUDNESS_GATE_ABS (-70.0) // LUFS
+#define LOUDNESS_GATE_REL (-10.0) // LU below the absolute-gated level
+
+// BS.1770 K-weighting, re-derived for any sample rate (the standard only
+// lists 48 kHz coefficients)
+static void kweight_init(LoudnessMeter *m) {
+  double rate = (double)m->rate;
+
+  // Stage 1: +4 dB high shelf modelling the head
+  double f0 = 1681.974450955533;
+  double gain_db = 3.999843853973347;
+  double q = 0.7071752369554196;
+  double k = tan(M_PI * f0 / rate);
+  double vh = pow(10.0, gain_db / 20.0);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  m->shelf.b0 = (vh + vb * k / q + k * k) / a0;
+  m->shelf.b1 = 2.0 * (k * k - vh) / a0;
+  m->shelf.b2 = (vh - vb * k / q + k * k) / a0;
+  m->shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+  m->shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+  // Stage 2: RLB high-pass around 38 Hz
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = tan(M_PI * f0 / rate);
+  a0 = 1.0 + k / q + k * k;
+  m->hpf.b0 = 1.0;
+  m->hpf.b1 = -2.0;
+  m->hpf.b2 = 1.0;
+  m->hpf.a1 = 2.0 * (k * k - 1.0) / a0;
+  m->hpf.a2 = (1.0 - k / q + k * k) / a0;
+}
+
+static inline double biquad(LoudnessBiquad *f, int ch, double x) {
+  double y = f->b0 * x + f->z1[ch];
+  f->z1[ch] = f->b1 * x - f->a1 * y + f->z2[ch];
+  f->z2[ch] = f->b2 * x - f->a2 * y;
+  return y;
+}
+
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+// 4x interpolator: phase p estimates the signal p/4 of a sample after the
+// middle of the window. Phase 0 is the input itself and is not stored.
+static void true_peak_init(LoudnessMeter *m) {
+  const double beta = 6.0;
+  double half = LOUDNESS_TP_TAPS / 2.0;
+  double center = half - 1.0;
+  double i0_beta = bessel_i0(beta);
+
+  for (int p = 1; p < 4; ++p) {
+    float *h = m->tp_coeffs[p - 1];
+    double sum = 0.0;
+    for (int k = 0; k < LOUDNESS_TP_TAPS; ++k) {
+      double d = (double)k - center - (double)p / 4.0;
+      double sinc = sin(M_PI * d) / (M_PI * d);
+      double w = d / half;
+      double win = w * w < 1.0 ? bessel_i0(beta * sqrt(1.0 - w * w)) / i0_beta
+                               : 0.0;
+      h[k] = (float)(sinc * win);
+      sum += sinc * win;
+    }
+    for (int k = 0; k < LOUDNESS_TP_TAPS; ++k)
+      h[k] = (float)(h[k] / sum);
+  }
+}
+
+bool loudness_init(LoudnessMeter *m, long rate) {
+  memset(m, 0, sizeof(*m));
+  if (rate <= 0)
+    return false;
+
+  m->rate = rate;
+  m->sub_len = (size_t)(rate / 10);
+  m->kernels = kernels_active();
+  kweight_init(m);
+  true_peak_init(m);
+
+  size_t len = LOUDNESS_CHUNK + LOUDNESS_TP_TAPS - 1;
+  m->tp_hist[0] = calloc(len, sizeof(float));
+  m->tp_hist[1] = calloc(len, sizeof(float));
+  if (!m->tp_hist[0] || !m->tp_hist[1]) {
+    loudness_free(m);
+    return false;
+  }
+  return true;
+}
+
+void loudness_free(LoudnessMeter *m) {
+  free(m->tp_hist[0]);
+  free(m->tp_hist[1]);
+  m->tp_hist[0] = m->tp_hist[1] = NULL;
+}
+
+// A 100 ms sub-block is complete; every one of them ends a 400 ms block
+static void finish_sub_block(LoudnessMeter *m) {
+  m->sub_ring[m->sub_filled & 3] = m->sub_sum;
+  m->sub_filled++;
+  m->sub_sum = 0.0;
+  m->sub_pos = 0;
+  if (m->sub_filled < 4)
+    return;
+
+  double energy = (m->sub_ring[0] + m->sub_ring[1] + m->sub_ring[2] +
+                   m->sub_ring[3]) /
+                  (4.0 * (double)m->sub_len);
+  if (energy <= 0.0)
+    return;
+  double lufs = -0.691 + 10.0 * log10(energy);
+  if (lufs < LOUDNESS_GATE_ABS)
+    return;
+
+  int bin = (int)((lufs - LOUDNESS_GATE_ABS) * 10.0);
+  if (bin >= LOUDNESS_HIST_BINS)
+    bin = LOUDNESS_HIST_BINS - 1;
+  m->hist_count[bin]++;
+  m->hist_energy[bin] += energy;
+}
+
+static void add_chunk(LoudnessMeter *m, const float *stereo, size_t frames) {
+  const size_t keep = LOUDNESS_TP_TAPS - 1;
+  float *l = m->tp_hist[0] + keep;
+  float *r = m->tp_hist[1] + keep;
+  float peak = m->peak;
+
+  for (size_t i = 0; i < frames; ++i) {
+    float xl = stereo[2 * i];
+    float xr = stereo[2 * i + 1];
+    l[i] = xl;
+    r[i] = xr;
+    if (fabsf(xl) > peak)
+      peak = fabsf(xl);
+    if (fabsf(xr) > peak)
+      peak = fabsf(xr);
+
+    double yl = biquad(&m->hpf, 0, biquad(&m->shelf, 0, xl));
+    double yr = biquad(&m->hpf, 1, biquad(&m->shelf, 1, xr));
+    m->sub_sum += yl * yl + yr * yr;
+    if (++m->sub_pos == m->sub_len)
+      finish_sub_block(m);
+  }
+
+  // Inter-sample peaks: windows ending at each new frame
+  DotFn dot = m->kernels->dot;
+  for (int c = 0; c < 2; ++c) {
+    const float *x = m->tp_hist[c];
+    for (size_t i = 0; i < frames; ++i) {
+      for (int p = 0; p < 3; ++p) {
+        float v = fabsf(dot(m->tp_coeffs[p], x + i, LOUDNESS_TP_TAPS));
+        if (v > peak)
+          peak = v;
+      }
+    }
+  }
+  m->peak = peak;
+
+  memmove(m->tp_hist[0], m->tp_hist[0] + frames, keep * sizeof(float));
+  memmove(m->tp_hist[1], m->tp_hist[1] + frames, keep * sizeof(float));
+}
+
+void loudness_add(LoudnessMeter *m, const float *stereo, size_t frames) {
+  while (frames > 0) {
+    size_t n = frames < LOUDNESS_CHUNK ? frames : LOUDNESS_CHUNK;
+    add_chunk(m, stereo, n);
+    stereo += 2 * n;
+    frames -= n;
+    m->frames += n;
+  }
+}
+
+// Mean loudness of the histogram bins from `first` up
+static double gated_mean(const LoudnessMeter *m, int first, uint64_t *count) {
+  double energy = 0.0;
+  *count = 0;
+  for (int b = first; b < LOUDNESS_HIST_BINS; ++b) {
+    *count += m->hist_count[b];
+    energy += m->hist_energy[b];
+  }
+  if (*count == 0)
+    return LOUDNESS_SILENT;
+  return -0.691 + 10.0 * log10(energy / (double)*count);
+}
+
+double loudness_integrated(const LoudnessMeter *m) {
+  uint64_t count;
+  double abs_gated = gated_mean(m, 0, &count);
+  if (count == 0)
+    return LOUDNESS_SILENT;
+
+  // The relative gate lands on a bin edge: 0.1 LU resolution
+  double rel = abs_gated + LOUDNESS_GATE_REL;
+  int first = rel <= LOUDNESS_GATE_ABS
+                  ? 0
+                  : (int)((rel - LOUDNESS_GATE_ABS) * 10.0);
+  double lufs = gated_mean(m, first, &count);
+  return count > 0 ? lufs : abs_gated;
+}
+
+double loudness_true_peak(const LoudnessMeter *m) { return (double)m->peak; }
@@ -1,6 +1,13 @@
+#include "bench.h"
+#include "decoder.h"
+#include "pcmcache.h"
 #include "player.h"
+#include "render.h"
+#include "scanner.h"
+#include "trackstore.h"
 #include "ui.h"
 #include "version.h"
+#include "watcher.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <windows.h>
@@ -97,6 +104,58 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    return bench_main(argc - 2, argv + 2);
+  }
+
+  if (argc > 1 && strcmp(argv[1], "render") == 0) {
+    return render_main(argc - 2, argv + 2);
+  }
+
+  // Options ahead of the track:
+  //   --stats-json FILE    write output stats on exit
+  //   --buffer-frames N    frames per output callback (default: host's)
+  //   --latency-ms MS      suggested output latency (default: device's)
+  //   --adaptive-latency   grow the buffer on underflows, shrink when stable
+  //   --cache-float32      keep replay-cached tracks as float, not int16
+  //   --exact-durations    count MP3 frames for lengths, not estimate them
+  const char *stats_path = NULL;
+  unsigned buffer_frames = 0;
+  double latency_ms = 0.0;
+  bool adaptive_latency = false;
+  while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+    if (strcmp(argv[1], "--adaptive-latency") == 0) {
+      adaptive_latency = true;
+      argc -= 1;
+      argv += 1;
+      continue;
+    }
+    if (strcmp(argv[1], "--exact-durations") == 0) {
+      decoder_set_exact_durations(true);
+      argc -= 1;
+      argv += 1;
+      continue;
+    }
+    if (strcmp(argv[1], "--cache-float32") == 0) {
+      pcmcache_set_format(PCMCACHE_FLOAT32);
+      argc -= 1;
+      argv += 1;
+      continue;
+    }
+    if (argc < 3)
+      break;
+    if (strcmp(argv[1], "--stats-json") == 0)
+      stats_path = argv[2];
+    else if (strcmp(argv[1], "--buffer-frames") == 0)
+      buffer_frames = (unsigned)strtoul(argv[2], NULL, 10);
+    else if (strcmp(argv[1], "--latency-ms") == 0)
+      latency_ms = strtod(argv[2], NULL);
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+
   printf("Starting main, argc = %d\n", argc);
   fflush(stdout);
 
@@ -106,16 +165,18 @@ int main(int argc, char *argv[]) {
 
   Player player;
   player_init(&player);
+  player_set_stats_dump(stats_path);
+  player_set_output_buffering(buffer_frames, latency_ms / 1000.0,
+                              adaptive_latency);
   printf("Loaded player");
 
   UIState ui_state = {0};
   ui_get_terminal_size(&ui_state.width, &ui_state.height);
 
   // NEW: playlist fields start empty
-  ui_state.tracks = NULL;
-  ui_state.track_count = 0;
   ui_state.selected_index = 0;
   ui_state.track_offset = 0;
+  ui_state.next_index = -1;
   ui_state.has_update = false;
   ui_state.latest_version[0] = '\0';
   ui_state.dirty = true;
@@ -126,6 +187,7 @@ int main(int argc, char *argv[]) {
   ui_state.folder_offset = 0;
 
   ui_init_state(&ui_state, UI_MODE_FULL);
+  ui_library_open(&ui_state);
 
   // OPTIONAL: if user *does* pass an mp3, pre-load it
   if (argc >= 2) {
@@ -153,9 +215,11 @@ int main(int argc, char *argv[]) {
 
     PlayerState old_state = player.state;
     double old_pos = player.position;
-    bool finished = player_update(&player);
-    if (finished) {
+    PlayerEvent event = player_update(&player);
+    if (event == PLAYER_EVENT_FINISHED) {
       ui_handle_track_end(&player, &ui_state);
+    } else if (event == PLAYER_EVENT_ADVANCED) {
+      ui_handle_track_advanced(&player, &ui_state);
     }
 
     if (player.state != old_state) {
@@ -169,6 +233,9 @@ int main(int argc, char *argv[]) {
       ui_state.last_prog_tick = now;
     }
 
+    ui_library_update(&player, &ui_state);
+    ui_scan_update(&player, &ui_state);
+    ui_watch_update(&player, &ui_state);
     ui_handle_input(&player, &ui_state);
 
     if (ui_state.dirty) {
@@ -180,8 +247,12 @@ int main(int argc, char *argv[]) {
   }
   // Cleanup
   printf("Goodbye!\n");
+  watcher_shutdown();
+  scanner_shutdown(); // a folder still being added is cut short
+  ui_library_close(&ui_state);
+  player_cleanup();
   ui_cleanup();
-  free(ui_state.tracks);
+  trackstore_free(&ui_state.tracks);
 
   return 0;
 }
@@ -0,0 +1,250 @@
+#include "mapfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#define MAPFILE_PATH_MAX 1024
+#define MAPFILE_IDLE_KEEP 4            // released mappings kept open
+#define MAPFILE_HEAD_BYTES (64 * 1024) // where probing and tags look first
+#define MAPFILE_READAHEAD (1 << 20)    // hinted ahead of a reader
+
+typedef struct MapEntry {
+  MappedFile pub; // first: handed out as MappedFile *
+  char path[MAPFILE_PATH_MAX];
+  int refs;
+  unsigned long released; // clock value when refs last dropped to 0
+  bool stale;             // the file changed; no longer handed out
+  struct MapEntry *next;
+} MapEntry;
+
+static SRWLOCK g_lock = SRWLOCK_INIT;
+static MapEntry *g_maps;
+static unsigned long g_clock;
+
+// PrefetchVirtualMemory only exists from Windows 8 on; without it the
+// hints are skipped and pages simply fault in on first touch
+typedef struct {
+  void *addr;
+  size_t bytes;
+} PrefetchRange;
+typedef BOOL(WINAPI *PrefetchFn)(HANDLE, ULONG_PTR, PrefetchRange *, ULONG);
+static PrefetchFn g_prefetch;
+static bool g_prefetch_resolved;
+
+static uint64_t filetime_u64(FILETIME ft) {
+  return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static void map_free(MapEntry *e) {
+  if (!e)
+    return;
+  UnmapViewOfFile(e->pub.data);
+  free(e);
+}
+
+// Map the whole file. Only the view is kept: it holds the mapping, which
+// holds the file.
+static MapEntry *map_create(const wchar_t *path_w, const char *filepath) {
+  HANDLE file = CreateFileW(path_w, GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  LARGE_INTEGER size;
+  FILETIME mtime;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+      (uint64_t)size.QuadPart > SIZE_MAX ||
+      !GetFileTime(file, NULL, NULL, &mtime)) {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (!mapping)
+    return NULL;
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view) {
+    fprintf(stderr, "[mapfile] cannot map %s\n", filepath);
+    return NULL;
+  }
+
+  MapEntry *e = calloc(1, sizeof(MapEntry));
+  if (!e) {
+    UnmapViewOfFile(view);
+    return NULL;
+  }
+  e->pub.data = view;
+  e->pub.size = (size_t)size.QuadPart;
+  strcpy(e->path, filepath);
+  e->pub.mtime = filetime_u64(mtime);
+  return e;
+}
+
+static void unlink_entry(MapEntry *e) {
+  for (MapEntry **p = &g_maps; *p; p = &(*p)->next) {
+    if (*p == e) {
+      *p = e->next;
+      return;
+    }
+  }
+}
+
+// A current mapping of `filepath`, if there is one. Lock held. An idle
+// mapping of a file that changed is unlinked into `*stale`; one still in
+// use stays with its users until they release it.
+static MapEntry *find_current(const char *filepath, uint64_t size,
+                              uint64_t mtime, MapEntry **stale) {
+  for (MapEntry *e = g_maps; e; e = e->next) {
+    if (e->stale || strcmp(e->path, filepath) != 0)
+      continue;
+    if (e->pub.size == size && e->pub.mtime == mtime)
+      return e;
+    e->stale = true;
+    if (e->refs == 0) {
+      unlink_entry(e);
+      *stale = e;
+    }
+    return NULL;
+  }
+  return NULL;
+}
+
+MappedFile *mapfile_open(const char *filepath) {
+  wchar_t path_w[MAPFILE_PATH_MAX];
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  if (strlen(filepath) >= MAPFILE_PATH_MAX ||
+      MultiByteToWideChar(CP_UTF8, 0, filepath, -1, path_w,
+                          MAPFILE_PATH_MAX) <= 0 ||
+      !GetFileAttributesExW(path_w, GetFileExInfoStandard, &fad))
+    return NULL;
+  uint64_t size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  uint64_t mtime = filetime_u64(fad.ftLastWriteTime);
+
+  MapEntry *stale = NULL;
+  AcquireSRWLockExclusive(&g_lock);
+  if (!g_prefetch_resolved) {
+    HMODULE k32 = GetModuleHandleW(L"kernel32.dll");
+    if (k32)
+      g_prefetch = (PrefetchFn)(void (*)(void))GetProcAddress(
+          k32, "PrefetchVirtualMemory");
+    g_prefetch_resolved = true;
+  }
+  MapEntry *e = find_current(filepath, size, mtime, &stale);
+  if (e)
+    e->refs++;
+  ReleaseSRWLockExclusive(&g_lock);
+  map_free(stale);
+  if (e)
+    return &e->pub;
+
+  // Map outside the lock: opening a file can be slow (network drives)
+  MapEntry *fresh = map_create(path_w, filepath);
+  if (!fresh)
+    return NULL;
+  mapfile_prefetch(&fresh->pub, 0, MAPFILE_HEAD_BYTES);
+
+  // Someone may have mapped it meanwhile; share theirs
+  stale = NULL;
+  AcquireSRWLockExclusive(&g_lock);
+  e = find_current(filepath, fresh->pub.size, fresh->pub.mtime, &stale);
+  if (e) {
+    e->refs++;
+  } else {
+    fresh->refs = 1;
+    fresh->next = g_maps;
+    g_maps = fresh;
+    e = fresh;
+    fresh = NULL;
+  }
+  ReleaseSRWLockExclusive(&g_lock);
+  map_free(stale);
+  map_free(fresh);
+  return &e->pub;
+}
+
+void mapfile_release(MappedFile *mf) {
+  if (!mf)
+    return;
+  MapEntry *e = (MapEntry *)mf;
+  MapEntry *drop = NULL;
+
+  AcquireSRWLockExclusive(&g_lock);
+  if (--e->refs == 0) {
+    e->released = ++g_clock;
+
+    // Keep the most recently released few, unless the file has changed
+    int idle = 0;
+    MapEntry *oldest = NULL;
+    for (MapEntry *m = g_maps; m; m = m->next) {
+      if (m->refs != 0)
+        continue;
+      idle++;
+      if (!oldest || m->released < oldest->released)
+        oldest = m;
+    }
+    if (e->stale)
+      drop = e;
+    else if (idle > MAPFILE_IDLE_KEEP)
+      drop = oldest;
+    if (drop)
+      unlink_entry(drop);
+  }
+  ReleaseSRWLockExclusive(&g_lock);
+  map_free(drop);
+}
+
+void mapfile_prefetch(MappedFile *mf, size_t offset, size_t len) {
+  if (!g_prefetch || !mf || offset >= mf->size)
+    return;
+  if (len > mf->size - offset)
+    len = mf->size - offset;
+  PrefetchRange range = {(void *)(mf->data + offset), len};
+  g_prefetch(GetCurrentProcess(), 1, &range, 0);
+}
+
+size_t mapreader_read(MapReader *r, void *dst, size_t len) {
+  size_t size = r->map->size;
+  if (r->pos >= size)
+    return 0;
+  if (len > size - r->pos)
+    len = size - r->pos;
+
+  // Keep a window hinted ahead of sequential reads, topped up in large
+  // steps so this is one call per half window
+  size_t end = r->pos + len;
+  if (end + MAPFILE_READAHEAD / 2 > r->prefetched) {
+    size_t from = r->prefetched > r->pos ? r->prefetched : r->pos;
+    r->prefetched = end + MAPFILE_READAHEAD;
+    mapfile_prefetch(r->map, from, r->prefetched - from);
+  }
+
+  memcpy(dst, r->map->data + r->pos, len);
+  r->pos = end;
+  return len;
+}
+
+int64_t mapreader_seek(MapReader *r, int64_t offset, int whence) {
+  int64_t base;
+  if (whence == SEEK_SET)
+    base = 0;
+  else if (whence == SEEK_CUR)
+    base = (int64_t)r->pos;
+  else if (whence == SEEK_END)
+    base = (int64_t)r->map->size;
+  else
+    return -1;
+
+  int64_t pos = base + offset;
+  if (pos < 0)
+    return -1;
+  r->pos = (size_t)pos;
+  if (r->prefetched > r->pos + MAPFILE_READAHEAD)
+    r->prefetched = r->pos; // jumped back: hint from here on
+  return pos;
+}
@@ -0,0 +1,193 @@
+#include "mpegaudio.h"
+#include "id3tag.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MPEG_SYNC_SEARCH (64 * 1024) // how far to look for the first frame
+#define MPEG_HEADER 4
+
+typedef struct {
+  int lsf;     // 0 = MPEG-1, 1 = MPEG-2 or 2.5 (half the samples per frame)
+  int layer;   // 1..3
+  int mono;    // single channel
+  long rate;   // Hz
+  long bitrate; // bit/s, 0 for free format
+  size_t length; // bytes, header included; 0 for free format
+  int samples;   // per frame
+} FrameHeader;
+
+static const short g_bitrates[2][3][15] = {
+    // MPEG-1, layers I to III (kbit/s)
+    {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+     {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+     {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},
+    // MPEG-2 and 2.5
+    {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+     {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}},
+};
+
+static const long g_rates[3] = {44100, 48000, 32000}; // MPEG-1
+
+static uint32_t be32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static bool parse_header(const unsigned char *p, FrameHeader *h) {
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+    return false;
+  int version = (p[1] >> 3) & 3; // 0 = 2.5, 2 = 2, 3 = 1
+  int layer = 4 - ((p[1] >> 1) & 3);
+  int bitrate_index = p[2] >> 4;
+  int rate_index = (p[2] >> 2) & 3;
+  if (version == 1 || layer == 4 || bitrate_index == 15 || rate_index == 3)
+    return false;
+
+  h->lsf = version != 3;
+  h->layer = layer;
+  h->mono = (p[3] >> 6) == 3;
+  h->rate = g_rates[rate_index] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+  h->bitrate = g_bitrates[h->lsf][layer - 1][bitrate_index] * 1000L;
+  h->samples = layer == 1 ? 384 : (layer == 3 && h->lsf) ? 576 : 1152;
+
+  int padding = (p[2] >> 1) & 1;
+  if (h->bitrate == 0)
+    h->length = 0;
+  else if (layer == 1)
+    h->length = (size_t)((12 * h->bitrate / h->rate + padding) * 4);
+  else
+    h->length = (size_t)(h->samples / 8 * h->bitrate / h->rate + padding);
+  return true;
+}
+
+static bool same_stream(const FrameHeader *a, const FrameHeader *b) {
+  return a->lsf == b->lsf && a->layer == b->layer && a->rate == b->rate;
+}
+
+// First frame at or after `pos` whose successor also parses, so a stray
+// sync pattern in junk before the audio is not taken for a frame
+static size_t find_first_frame(const unsigned char *data, size_t pos,
+                               size_t end, FrameHeader *h) {
+  size_t limit = end - pos > MPEG_SYNC_SEARCH ? pos + MPEG_SYNC_SEARCH : end;
+  for (; pos + MPEG_HEADER <= limit; ++pos) {
+    if (!parse_header(data + pos, h) || h->length == 0)
+      continue;
+    size_t next = pos + h->length;
+    FrameHeader n;
+    if (next == end ||
+        (next + MPEG_HEADER <= end && parse_header(data + next, &n) &&
+         same_stream(h, &n)))
+      return pos;
+  }
+  return SIZE_MAX;
+}
+
+// ---- info frame ----
+
+typedef struct {
+  long frames; // audio frames after the info frame, -1 if not given
+  int delay, padding; // LAME encoder delay and end padding, in samples
+} InfoFrame;
+
+// Xing/Info (with an optional LAME tag) or VBRI in the first frame
+static bool parse_info_frame(const unsigned char *f, const FrameHeader *h,
+                             InfoFrame *info) {
+  info->frames = -1;
+  info->delay = info->padding = 0;
+  if (h->layer != 3)
+    return false;
+
+  size_t side = h->lsf ? (h->mono ? 9 : 17) : (h->mono ? 17 : 32);
+  const unsigned char *x = f + MPEG_HEADER + side;
+  if (MPEG_HEADER + side + 8 <= h->length &&
+      (memcmp(x, "Xing", 4) == 0 || memcmp(x, "Info", 4) == 0)) {
+    uint32_t flags = be32(x + 4);
+    size_t at = 8;
+    if ((flags & 1) && MPEG_HEADER + side + at + 4 <= h->length)
+      info->frames = (long)be32(x + at);
+    at += (flags & 1 ? 4 : 0) + (flags & 2 ? 4 : 0) + (flags & 4 ? 100 : 0) +
+          (flags & 8 ? 4 : 0);
+    // LAME (or libavcodec's look-alike) tag right after
+    const unsigned char *lame = x + at;
+    if (MPEG_HEADER + side + at + 24 <= h->length &&
+        (memcmp(lame, "LAME", 4) == 0 || memcmp(lame, "Lavc", 4) == 0 ||
+         memcmp(lame, "Lavf", 4) == 0)) {
+      info->delay = (lame[21] << 4) | (lame[22] >> 4);
+      info->padding = ((lame[22] & 0x0F) << 8) | lame[23];
+    }
+    return true;
+  }
+
+  // Fraunhofer's VBRI always sits 32 bytes after the header
+  const unsigned char *v = f + MPEG_HEADER + 32;
+  if (MPEG_HEADER + 32 + 18 <= h->length && memcmp(v, "VBRI", 4) == 0) {
+    info->frames = (long)be32(v + 14);
+    return true;
+  }
+  return false;
+}
+
+// Where the audio stops: before an ID3v1 tag and an APE tag ahead of it
+static size_t audio_end(const unsigned char *data, size_t size,
+                        size_t start) {
+  size_t end = size;
+  if (end - start >= 128 && memcmp(data + end - 128, "TAG", 3) == 0)
+    end -= 128;
+  if (end - start >= 32 && memcmp(data + end - 32, "APETAGEX", 8) == 0) {
+    const unsigned char *a = data + end - 32;
+    size_t len = (size_t)a[12] | (size_t)a[13] << 8 | (size_t)a[14] << 16 |
+                 (size_t)a[15] << 24; // footer and items, not the header
+    if (a[23] & 0x80)
+      len += 32; // header present
+    if (len <= end - start)
+      end -= len;
+  }
+  return end;
+}
+
+// ---- public API ----
+
+double mpeg_audio_duration(const unsigned char *data, size_t size,
+                           bool exact) {
+  size_t start = id3_v2_size(data, size);
+  if (start >= size)
+    return 0.0;
+  size_t end = audio_end(data, size, start);
+
+  FrameHeader first;
+  size_t pos = find_first_frame(data, start, end, &first);
+  if (pos == SIZE_MAX)
+    return 0.0;
+
+  InfoFrame info;
+  bool has_info = parse_info_frame(data + pos, &first, &info);
+  if (has_info)
+    pos += first.length; // the info frame carries no audio
+
+  int64_t samples = 0;
+  if (exact) {
+    // header to header, resyncing over damage
+    FrameHeader h;
+    while (pos + MPEG_HEADER <= end) {
+      if (parse_header(data + pos, &h) && h.length > 0 &&
+          same_stream(&h, &first) && pos + h.length <= end) {
+        samples += h.samples;
+        pos += h.length;
+      } else {
+        pos++;
+      }
+    }
+  } else if (info.frames >= 0) {
+    samples = (int64_t)info.frames * first.samples;
+  } else if (first.bitrate > 0) {
+    // constant bitrate: the size says it all
+    return (double)(end - pos) * 8.0 / (double)first.bitrate;
+  } else {
+    return 0.0;
+  }
+
+  samples -= info.delay + info.padding;
+  return samples > 0 ? (double)samples / (double)first.rate : 0.0;
+}
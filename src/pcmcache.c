@@ -0,0 +1,357 @@
+#include "pcmcache.h"
+#include "kernels.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+// int16 holds -2..2: decoded lossy audio overshoots full scale, and a
+// 16-bit step of 2^-14 still leaves the noise floor near -95 dBFS
+#define PCMCACHE_S16_RANGE 2.0f
+
+typedef struct PcmEntry {
+  char path[DECODER_PATH_MAX];
+  uint64_t size, mtime; // of the file it was decoded from
+  long rate;
+  PcmCacheFormat format;
+  void *pcm;       // interleaved stereo at the file's native rate
+  size_t samples;  // valid once complete
+  size_t capacity; // samples allocated
+  int users;       // open cached decoders
+  unsigned long last_used;
+  bool complete; // false while still being recorded
+  struct PcmEntry *next;
+} PcmEntry;
+
+// Plays a complete entry back, or records what `inner` decodes into one
+typedef struct {
+  Decoder base;
+  Decoder *inner; // NULL when playing from memory
+  PcmEntry *entry;
+  size_t pos;     // samples into entry->pcm
+  size_t high;    // recording: samples held from the start on
+  bool recording; // what inner produced so far is all in the entry
+  bool ended;     // recording reached the end of the track
+} CacheDecoder;
+
+static PcmEntry *g_entries;
+static size_t g_bytes;
+static size_t g_limit = PCMCACHE_DEFAULT_LIMIT;
+static PcmCacheFormat g_format = PCMCACHE_INT16;
+static unsigned long g_clock;
+
+static size_t sample_bytes(PcmCacheFormat format) {
+  return format == PCMCACHE_INT16 ? sizeof(int16_t) : sizeof(float);
+}
+
+static size_t entry_bytes(const PcmEntry *e) {
+  return e->capacity * sample_bytes(e->format);
+}
+
+// Samples [pos, pos + n) of the entry, as float
+static void entry_load(const PcmEntry *e, size_t pos, float *dst, size_t n) {
+  if (e->format == PCMCACHE_INT16)
+    kernels_active()->s16_to_float(dst, (const int16_t *)e->pcm + pos, n,
+                                   PCMCACHE_S16_RANGE / 32768.0f);
+  else
+    memcpy(dst, (const float *)e->pcm + pos, n * sizeof(float));
+}
+
+static void entry_store(PcmEntry *e, size_t pos, const float *src, size_t n) {
+  if (e->format == PCMCACHE_INT16)
+    kernels_active()->float_to_s16((int16_t *)e->pcm + pos, src, n,
+                                   32768.0f / PCMCACHE_S16_RANGE);
+  else
+    memcpy((float *)e->pcm + pos, src, n * sizeof(float));
+}
+
+static bool file_stamp(const char *filepath, uint64_t *size, uint64_t *mtime) {
+  wchar_t path_w[DECODER_PATH_MAX];
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  if (strlen(filepath) >= DECODER_PATH_MAX ||
+      MultiByteToWideChar(CP_UTF8, 0, filepath, -1, path_w,
+                          DECODER_PATH_MAX) <= 0 ||
+      !GetFileAttributesExW(path_w, GetFileExInfoStandard, &fad))
+    return false;
+  *size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  *mtime = ((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) |
+           fad.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
+static void entry_drop(PcmEntry *e) {
+  for (PcmEntry **p = &g_entries; *p; p = &(*p)->next) {
+    if (*p == e) {
+      *p = e->next;
+      break;
+    }
+  }
+  g_bytes -= entry_bytes(e);
+  free(e->pcm);
+  free(e);
+}
+
+static bool entry_idle(const PcmEntry *e) {
+  return e->complete && e->users == 0;
+}
+
+// Evict least recently used idle tracks until `bytes` more fit. Evicts
+// nothing if even dropping all of them would not be enough.
+static bool make_room(size_t bytes) {
+  size_t idle = 0;
+  for (PcmEntry *e = g_entries; e; e = e->next)
+    if (entry_idle(e))
+      idle += entry_bytes(e);
+  if (bytes > g_limit || g_bytes - idle > g_limit - bytes)
+    return false;
+
+  while (g_bytes > g_limit - bytes) {
+    PcmEntry *oldest = NULL;
+    for (PcmEntry *e = g_entries; e; e = e->next)
+      if (entry_idle(e) && (!oldest || e->last_used < oldest->last_used))
+        oldest = e;
+    entry_drop(oldest);
+  }
+  return true;
+}
+
+// ---- playback from memory ----
+
+static DecoderResult cached_read(Decoder *dec, float *dst, size_t max_samples,
+                                 size_t *done) {
+  CacheDecoder *d = (CacheDecoder *)dec;
+  size_t n = d->entry->samples - d->pos;
+  if (n > max_samples)
+    n = max_samples & ~(size_t)1; // whole frames
+  entry_load(d->entry, d->pos, dst, n);
+  d->pos += n;
+  *done = n;
+  return n > 0 ? DECODER_OK : DECODER_DONE;
+}
+
+static int64_t cached_seek(Decoder *dec, int64_t frame) {
+  CacheDecoder *d = (CacheDecoder *)dec;
+  int64_t frames = (int64_t)(d->entry->samples / 2);
+  if (frame < 0)
+    frame = 0;
+  if (frame > frames)
+    frame = frames;
+  d->pos = (size_t)frame * 2;
+  return frame;
+}
+
+static double cached_duration(Decoder *dec) {
+  CacheDecoder *d = (CacheDecoder *)dec;
+  return (double)(d->entry->samples / 2) / (double)dec->rate;
+}
+
+static bool cached_tags(Decoder *dec, DecoderTags *out) {
+  (void)dec;
+  (void)out;
+  return false; // the player reads tags from the file
+}
+
+static void cached_close(Decoder *dec) {
+  CacheDecoder *d = (CacheDecoder *)dec;
+  d->entry->users--;
+  free(d);
+}
+
+static const DecoderVTable cached_vtable = {
+    .name = "cache",
+    .read = cached_read,
+    .seek = cached_seek,
+    .duration = cached_duration,
+    .tags = cached_tags,
+    .close = cached_close,
+};
+
+// ---- recording while decoding ----
+
+static DecoderResult record_read(Decoder *dec, float *dst, size_t max_samples,
+                                 size_t *done) {
+  CacheDecoder *d = (CacheDecoder *)dec;
+  DecoderResult res = decoder_read(d->inner, dst, max_samples, done);
+  if (!d->recording)
+    return res;
+
+  // The buffer was sized from the duration estimate; a track that turns
+  // out longer is simply not kept
+  PcmEntry *e = d->entry;
+  if (res == DECODER_ERROR || *done > e->capacity - d->pos) {
+    d->recording = false;
+    return res;
+  }
+  entry_store(e, d->pos, dst, *done);
+  d->pos += *done;
+  if (d->pos > d->high)
+    d->high = d->pos;
+  if (res == DECODER_DONE)
+    d->ended = true;
+  return res;
+}
+
+static int64_t record_seek(Decoder *dec, int64_t frame) {
+  CacheDecoder *d = (CacheDecoder *)dec;
+  int64_t landed = decoder_seek(d->inner, frame);
+
+  // Going back within what is held keeps recording (the same samples are
+  // written again); jumping past it would leave a hole
+  if (landed >= 0 && (size_t)landed * 2 <= d->high)
+    d->pos = (size_t)landed * 2;
+  else
+    d->recording = false;
+  return landed;
+}
+
+static double record_duration(Decoder *dec) {
+  return decoder_duration(((CacheDecoder *)dec)->inner);
+}
+
+static bool record_tags(Decoder *dec, DecoderTags *out) {
+  return decoder_tags(((CacheDecoder *)dec)->inner, out);
+}
+
+static void record_close(Decoder *dec) {
+  CacheDecoder *d = (CacheDecoder *)dec;
+  PcmEntry *e = d->entry;
+  decoder_close(d->inner);
+
+  if (d->recording && d->ended && d->high > 0) {
+    // Give back what the estimate over-reserved
+    void *fit = realloc(e->pcm, d->high * sample_bytes(e->format));
+    if (fit) {
+      e->pcm = fit;
+      g_bytes -= entry_bytes(e);
+      e->capacity = d->high;
+      g_bytes += entry_bytes(e);
+    }
+    e->samples = d->high;
+    e->complete = true;
+    e->last_used = ++g_clock;
+  } else {
+    entry_drop(e);
+  }
+  free(d);
+}
+
+static const DecoderVTable record_vtable = {
+    .name = "cache-record",
+    .read = record_read,
+    .seek = record_seek,
+    .duration = record_duration,
+    .tags = record_tags,
+    .close = record_close,
+};
+
+// ---- public ----
+
+static PcmEntry *find_entry(const char *filepath) {
+  for (PcmEntry *e = g_entries; e; e = e->next)
+    if (strcmp(e->path, filepath) == 0)
+      return e;
+  return NULL;
+}
+
+// Wrap `inner` so that its output is kept, or return it as is when the
+// track cannot be cached
+static Decoder *start_recording(Decoder *inner, uint64_t size,
+                                uint64_t mtime) {
+  double seconds = decoder_duration(inner);
+  if (seconds <= 0.0 || inner->rate <= 0)
+    return inner;
+
+  // Reserved up front so the decoder thread never allocates; pages of
+  // the slack are not touched unless the estimate was short
+  size_t capacity = (size_t)((seconds * 1.02 + 1.0) * (double)inner->rate) * 2;
+  size_t bytes = capacity * sample_bytes(g_format);
+  if (!make_room(bytes))
+    return inner;
+
+  PcmEntry *e = calloc(1, sizeof(PcmEntry));
+  CacheDecoder *d = calloc(1, sizeof(CacheDecoder));
+  void *pcm = malloc(bytes);
+  if (!e || !d || !pcm) {
+    free(e);
+    free(d);
+    free(pcm);
+    return inner;
+  }
+
+  strcpy(e->path, inner->path);
+  e->size = size;
+  e->mtime = mtime;
+  e->rate = inner->rate;
+  e->format = g_format;
+  e->pcm = pcm;
+  e->capacity = capacity;
+  e->next = g_entries;
+  g_entries = e;
+  g_bytes += bytes;
+
+  decoder_init_base(&d->base, &record_vtable, inner->path);
+  d->base.rate = inner->rate;
+  d->inner = inner;
+  d->entry = e;
+  d->recording = true;
+  return &d->base;
+}
+
+Decoder *pcmcache_open(const char *filepath) {
+  uint64_t size = 0, mtime = 0;
+  bool stamped = file_stamp(filepath, &size, &mtime);
+  PcmEntry *e = find_entry(filepath);
+
+  if (e && e->complete) {
+    if (stamped && e->size == size && e->mtime == mtime) {
+      CacheDecoder *d = calloc(1, sizeof(CacheDecoder));
+      if (d) {
+        decoder_init_base(&d->base, &cached_vtable, filepath);
+        d->base.rate = e->rate;
+        d->entry = e;
+        e->users++;
+        e->last_used = ++g_clock;
+        return &d->base;
+      }
+    } else if (e->users == 0) {
+      entry_drop(e); // the file changed
+      e = NULL;
+    }
+  }
+
+  Decoder *dec = decoder_open(filepath);
+  // One recording per file at a time (repeat-one queues a track behind
+  // itself before the first pass has been decoded)
+  if (!dec || !stamped || e || g_limit == 0)
+    return dec;
+  return start_recording(dec, size, mtime);
+}
+
+void pcmcache_set_limit(size_t bytes) {
+  g_limit = bytes;
+  for (;;) {
+    PcmEntry *oldest = NULL;
+    for (PcmEntry *e = g_entries; e; e = e->next)
+      if (entry_idle(e) && (!oldest || e->last_used < oldest->last_used))
+        oldest = e;
+    if (!oldest || g_bytes <= g_limit)
+      break;
+    entry_drop(oldest);
+  }
+}
+
+void pcmcache_set_format(PcmCacheFormat format) { g_format = format; }
+
+size_t pcmcache_bytes(void) { return g_bytes; }
+
+void pcmcache_clear(void) {
+  PcmEntry *e = g_entries;
+  while (e) {
+    PcmEntry *next = e->next;
+    if (entry_idle(e))
+      entry_drop(e);
+    e = next;
+  }
+}
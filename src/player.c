@@ -1,72 +1,43 @@
 #include "player.h"
 #include "audio.h"
-#include "mpg123.h"
+#include "decoder.h"
+#include "replaygain.h"
 #include <stdio.h>
 #include <string.h>
 
 static AudioEngine *audio_engine = NULL;
+static char g_stats_path[1024];
 
 void player_fill_metadata_from_file(const char *filepath, Track *track) {
-  static int mpg_inited = 0;
-  if (!mpg_inited) {
-    if (mpg123_init() != MPG123_OK) {
-      printf("ERROR");
-      return; // leave defaults if init fails
-    }
-    mpg_inited = 1;
-  }
-
-  int err = 0;
-  mpg123_handle *mh = mpg123_new(NULL, &err);
-  if (!mh)
-    return;
+  DecoderTags tags;
+  if (!decoder_read_tags(filepath, &tags))
+    return; // leave defaults
 
-  if (mpg123_open(mh, filepath) != MPG123_OK) {
-    mpg123_delete(mh);
-    return;
+  if (tags.title[0]) {
+    strncpy(track->title, tags.title, sizeof(track->title) - 1);
+    track->title[sizeof(track->title) - 1] = '\0';
   }
-
-  // Make sure all tags (incl. ID3v1 at end) are parsed
-  mpg123_scan(mh);
-
-  mpg123_id3v1 *v1 = NULL;
-  mpg123_id3v2 *v2 = NULL;
-
-  if (mpg123_id3(mh, &v1, &v2) == MPG123_OK) {
-    // Prefer ID3v2 if present
-    if (v2) {
-      if (v2->title && v2->title->p && v2->title->p[0]) {
-        strncpy(track->title, v2->title->p, sizeof(track->title) - 1);
-        track->title[sizeof(track->title) - 1] = '\0';
-      }
-      if (v2->artist && v2->artist->p && v2->artist->p[0]) {
-        strncpy(track->artist, v2->artist->p, sizeof(track->artist) - 1);
-        track->artist[sizeof(track->artist) - 1] = '\0';
-      }
-      if (v2->album && v2->album->p && v2->album->p[0]) {
-        strncpy(track->album, v2->album->p, sizeof(track->album) - 1);
-        track->album[sizeof(track->album) - 1] = '\0';
-      }
-    }
-    // Fallback to ID3v1 if v2 missing / empty
-    else if (v1) {
-      if (v1->title[0]) {
-        strncpy(track->title, v1->title, sizeof(track->title) - 1);
-        track->title[sizeof(track->title) - 1] = '\0';
-      }
-      if (v1->artist[0]) {
-        strncpy(track->artist, v1->artist, sizeof(track->artist) - 1);
-        track->artist[sizeof(track->artist) - 1] = '\0';
-      }
-      if (v1->album[0]) {
-        strncpy(track->album, v1->album, sizeof(track->album) - 1);
-        track->album[sizeof(track->album) - 1] = '\0';
-      }
-    }
+  if (tags.artist[0]) {
+    strncpy(track->artist, tags.artist, sizeof(track->artist) - 1);
+    track->artist[sizeof(track->artist) - 1] = '\0';
   }
+  if (tags.album[0]) {
+    strncpy(track->album, tags.album, sizeof(track->album) - 1);
+    track->album[sizeof(track->album) - 1] = '\0';
+  }
+}
+
+// Loudness analysis backs off while the playback decoder is behind
+static bool player_decode_behind(void *ctx) {
+  (void)ctx;
+  return audio_decode_is_behind(audio_engine);
+}
 
-  mpg123_close(mh);
-  mpg123_delete(mh);
+// Loudness gain of the current track under the player's mode
+static void apply_track_gain(const Player *player) {
+  audio_set_track_gain(audio_engine,
+                       replaygain_gain_for(player->current_track.filepath,
+                                           player->gain_mode));
 }
 
 void player_init(Player *player) {
@@ -75,11 +46,35 @@ void player_init(Player *player) {
   player->volume = 0.7; // 70% default volume
   player->shuffle = false;
   player->repeat_mode = REPEAT_NONE;
+  player->gain_mode = REPLAYGAIN_TRACK;
 
   audio_engine = audio_init();
   if (audio_engine) {
     audio_set_volume(audio_engine, player->volume);
   }
+  replaygain_init(0, player_decode_behind, NULL);
+}
+
+static void fill_track_info(const char *filepath, Track *track) {
+  memset(track, 0, sizeof(Track));
+
+  strncpy(track->filepath, filepath, sizeof(track->filepath) - 1);
+
+  // defaults
+  const char *filename = strrchr(filepath, '\\');
+  if (!filename)
+    filename = strrchr(filepath, '/');
+  if (filename)
+    filename++;
+  else
+    filename = filepath;
+
+  strncpy(track->title, filename, sizeof(track->title) - 1);
+  strcpy(track->artist, "Unknown Artist");
+  strcpy(track->album, "Unknown Album");
+
+  // try to overwrite with real metadata
+  player_fill_metadata_from_file(filepath, track);
 }
 
 bool player_load_track(Player *player, const char *filepath) {
@@ -87,27 +82,14 @@ bool player_load_track(Player *player, const char *filepath) {
     return false;
 
   if (audio_load_file(audio_engine, filepath)) {
-    memset(&player->current_track, 0, sizeof(Track));
-
-    strncpy(player->current_track.filepath, filepath,
-            sizeof(player->current_track.filepath) - 1);
-
-    // defaults
-    const char *filename = strrchr(filepath, '\\');
-    if (!filename)
-      filename = strrchr(filepath, '/');
-    if (filename)
-      filename++;
-    else
-      filename = filepath;
+    // replaying the current track: its tags are already read
+    if (strcmp(filepath, player->current_track.filepath) != 0)
+      fill_track_info(filepath, &player->current_track);
+    // loading drops anything that was primed
+    player->has_next = false;
 
-    strncpy(player->current_track.title, filename,
-            sizeof(player->current_track.title) - 1);
-    strcpy(player->current_track.artist, "Unknown Artist");
-    strcpy(player->current_track.album, "Unknown Album");
-
-    // try to overwrite with real metadata
-    player_fill_metadata_from_file(filepath, &player->current_track);
+    apply_track_gain(player);
+    replaygain_request(filepath, player->current_track.album);
 
     player->current_track.duration = audio_get_duration(audio_engine);
     player->position = 0.0;
@@ -117,6 +99,29 @@ bool player_load_track(Player *player, const char *filepath) {
   return false;
 }
 
+bool player_queue_next(Player *player, const char *filepath) {
+  if (!audio_engine)
+    return false;
+
+  float gain = replaygain_gain_for(filepath, player->gain_mode);
+  if (!audio_queue_next(audio_engine, filepath, gain)) {
+    player->has_next = false;
+    return false;
+  }
+
+  if (strcmp(filepath, player->current_track.filepath) == 0)
+    player->next_track = player->current_track; // repeat-one
+  else
+    fill_track_info(filepath, &player->next_track);
+  player->has_next = true;
+  return true;
+}
+
+void player_clear_next(Player *player) {
+  audio_clear_next(audio_engine);
+  player->has_next = false;
+}
+
 void player_play(Player *player) {
   if (!audio_engine)
     return;
@@ -128,6 +133,7 @@ void player_play(Player *player) {
 
     // reload audio data (reopens file, resets cursor)
     if (audio_load_file(audio_engine, player->current_track.filepath)) {
+      apply_track_gain(player);
       player->position = 0.0;
     }
   }
@@ -157,7 +163,14 @@ void player_stop(Player *player) {
 }
 
 void player_seek(Player *player, double position) {
-  // To be implemented with audio backend
+  if (position < 0.0)
+    position = 0.0;
+  if (player->current_track.duration > 0.0 &&
+      position > player->current_track.duration)
+    position = player->current_track.duration;
+
+  if (audio_engine)
+    audio_seek(audio_engine, position);
   player->position = position;
 }
 
@@ -173,24 +186,111 @@ void player_set_volume(Player *player, double volume) {
   }
 }
 
-bool player_update(Player *player) {
-  bool finished = false;
+void player_set_crossfade(Player *player, double seconds) {
+  if (seconds < 0.0)
+    seconds = 0.0;
+  if (seconds > 12.0)
+    seconds = 12.0;
+
+  player->crossfade = seconds;
+  if (audio_engine) {
+    audio_set_crossfade(audio_engine, seconds);
+  }
+}
+
+void player_set_gain_mode(Player *player, ReplayGainMode mode) {
+  if (mode >= REPLAYGAIN_MODE_COUNT)
+    mode = REPLAYGAIN_OFF;
+  player->gain_mode = mode;
+  if (!audio_engine)
+    return;
+
+  // Re-level what is playing now and what is queued after it
+  if (player->current_track.filepath[0])
+    apply_track_gain(player);
+  if (player->has_next)
+    player_queue_next(player, player->next_track.filepath);
+}
+
+void player_set_eq_preset(Player *player, int preset) {
+  if (preset < 0 || preset >= eq_preset_count())
+    preset = 0;
+  player->eq_preset = preset;
+
+  EqBand bands[EQ_MAX_BANDS];
+  int count = eq_preset_bands(preset, bands);
+  audio_set_eq(audio_engine, bands, count);
+}
+
+PlayerEvent player_update(Player *player) {
+  PlayerEvent event = PLAYER_EVENT_NONE;
+
+  audio_tune_latency(audio_engine);
 
   if (audio_engine && player->state == PLAYER_PLAYING) {
+    // the callback crossed into the primed track
+    if (audio_take_track_change(audio_engine)) {
+      player->current_track = player->next_track;
+      player->has_next = false;
+      event = PLAYER_EVENT_ADVANCED;
+    }
+
     player->position = audio_get_position(audio_engine);
+    // duration is an estimate until the decoder has seen the whole file
+    player->current_track.duration = audio_get_duration(audio_engine);
 
-    if (player->position >= player->current_track.duration - 0.01) {
+    // A tick can see both the splice and the end of the spliced track;
+    // report the advance first so the UI moves its next pick on, and the
+    // end (which stays set) on the next tick
+    if (event == PLAYER_EVENT_NONE && audio_is_finished(audio_engine)) {
       player->position = player->current_track.duration;
       player->state = PLAYER_STOPPED;
-      finished = true;
+      event = PLAYER_EVENT_FINISHED;
       // do NOT call player_stop() here (it resets and loses "end" state)
     }
   }
 
-  return finished;
+  return event;
+}
+
+void player_set_output_buffering(unsigned frames, double latency,
+                                 bool adaptive) {
+  audio_set_buffering(audio_engine, frames, latency);
+  audio_set_adaptive_latency(audio_engine, adaptive);
+}
+
+bool player_tap_read(float *dst, size_t frames, long *rate) {
+  return audio_tap_read(audio_engine, dst, frames, rate);
+}
+
+void player_get_audio_stats(AudioStats *out) {
+  audio_get_stats(audio_engine, out);
+}
+
+void player_set_stats_dump(const char *path) {
+  g_stats_path[0] = '\0';
+  if (path)
+    snprintf(g_stats_path, sizeof(g_stats_path), "%s", path);
+}
+
+static void dump_stats(void) {
+  if (!g_stats_path[0] || !audio_engine)
+    return;
+  FILE *f = fopen(g_stats_path, "w");
+  if (!f) {
+    fprintf(stderr, "[player] cannot write %s\n", g_stats_path);
+    return;
+  }
+  AudioStats stats;
+  audio_get_stats(audio_engine, &stats);
+  audio_stats_write_json(&stats, f);
+  fclose(f);
 }
 
 void player_cleanup(void) {
+  // workers poll the engine, so they stop first
+  replaygain_shutdown();
+  dump_stats();
   if (audio_engine) {
     audio_cleanup(audio_engine);
     audio_engine = NULL;
@@ -0,0 +1,131 @@
+#include "render.h"
+#include "audio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+static void render_usage(void) {
+  fprintf(stderr,
+          "usage: musicplayer render [--rate HZ] [--crossfade S] "
+          "[--buffer-frames N] [--stats FILE.json] <null|out.wav|out.raw> "
+          "<files...>\n");
+}
+
+static double render_now_s(void) {
+  LARGE_INTEGER freq, t;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart / (double)freq.QuadPart;
+}
+
+// Queue the first playable file from `*next` on behind the current track
+static void render_queue(AudioEngine *engine, char **files, int count,
+                         int *next) {
+  while (*next < count) {
+    if (audio_queue_next(engine, files[*next], 1.0f))
+      return;
+    fprintf(stderr, "[render] skipping %s\n", files[*next]);
+    ++*next;
+  }
+}
+
+// Plays the files back to back, exactly as the player would (gapless or
+// crossfaded), at unity volume. Offline sinks make the output a function
+// of the input files only, so it can be compared bit for bit across runs.
+// (With a crossfade, a track shorter than about twice the fade can still
+// start the following fade late; the engine needs its successor queued
+// by then.)
+int render_main(int argc, char *argv[]) {
+  long rate = 0;
+  double crossfade = 0.0;
+  const char *stats_path = NULL;
+  unsigned buffer_frames = 0;
+  int i = 0;
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; ++i) {
+    if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      rate = strtol(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--crossfade") == 0 && i + 1 < argc) {
+      crossfade = strtod(argv[++i], NULL);
+    } else if (strcmp(argv[i], "--buffer-frames") == 0 && i + 1 < argc) {
+      buffer_frames = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+      stats_path = argv[++i];
+    } else {
+      render_usage();
+      return 1;
+    }
+  }
+  if (argc - i < 2) {
+    render_usage();
+    return 1;
+  }
+
+  const char *target = argv[i];
+  char **files = argv + i + 1;
+  int count = argc - i - 1;
+
+  AudioEngine *engine = audio_init();
+  if (!engine || !audio_set_output(engine, target, rate)) {
+    audio_cleanup(engine);
+    return 1;
+  }
+  audio_set_volume(engine, 1.0f);
+  audio_set_buffering(engine, buffer_frames, 0.0);
+  audio_set_crossfade(engine, crossfade);
+
+  double t0 = render_now_s();
+  double seconds = 0.0;
+  int rendered = 0;
+  int next = 0;
+
+  while (next < count) {
+    if (!audio_load_file(engine, files[next])) {
+      fprintf(stderr, "[render] skipping %s\n", files[next++]);
+      continue;
+    }
+    ++next;
+    render_queue(engine, files, count, &next);
+    audio_play(engine);
+
+    // The engine splices queued tracks in by itself; keep one queued
+    for (;;) {
+      double duration = audio_get_duration(engine);
+      if (audio_take_track_change(engine)) {
+        seconds += duration;
+        ++rendered;
+        ++next;
+        render_queue(engine, files, count, &next);
+        continue;
+      }
+      if (audio_is_finished(engine)) {
+        seconds += audio_get_duration(engine);
+        ++rendered;
+        break;
+      }
+      Sleep(1);
+    }
+    // a track queued after the last one ended is loaded afresh
+    audio_clear_next(engine);
+  }
+
+  if (stats_path) {
+    FILE *f = fopen(stats_path, "w");
+    if (f) {
+      AudioStats stats;
+      audio_get_stats(engine, &stats);
+      audio_stats_write_json(&stats, f);
+      fclose(f);
+    } else {
+      fprintf(stderr, "[render] cannot write %s\n", stats_path);
+    }
+  }
+
+  audio_cleanup(engine); // closes the sink, which finishes the file
+  double elapsed = render_now_s() - t0;
+
+  printf("rendered %d file(s), %.2f s of audio in %.2f s (%.1fx real time)\n",
+         rendered, seconds, elapsed, elapsed > 0.0 ? seconds / elapsed : 0.0);
+  return rendered > 0 ? 0 : 1;
+}
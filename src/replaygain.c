@@ -0,0 +1,596 @@
+#include "replaygain.h"
+#include "decoder.h"
+#include "loudness.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#define RG_MAX_WORKERS 4
+#define RG_READ_SAMPLES 16384 // float samples per decoder_read
+#define RG_YIELD_MS 20        // back-off while playback decoding is behind
+#define RG_TABLE_INIT 1024    // power of two
+#define RG_CACHE_VERSION "musicplayer-loudness 1"
+
+typedef struct {
+  char *path; // NULL = empty slot
+  char *album;
+  uint64_t size;
+  uint64_t mtime; // FILETIME ticks
+  LoudnessInfo info;
+  bool valid;  // info matches size/mtime
+  bool queued; // waiting for or inside a worker
+} RgEntry;
+
+// Everything below is guarded by g_lock
+static CRITICAL_SECTION g_lock;
+static CONDITION_VARIABLE g_work;
+static bool g_initialized = false;
+static bool g_quit = false;
+
+static RgEntry *g_table = NULL; // open addressing, linear probing
+static size_t g_table_cap = 0;
+static size_t g_table_count = 0;
+static bool g_dirty = false; // table differs from the cache file
+
+static char **g_queue = NULL; // FIFO of paths, ring indexed
+static size_t g_queue_cap = 0;
+static size_t g_queue_head = 0;
+static size_t g_queue_len = 0;
+static int g_active = 0; // files inside a worker right now
+
+static int g_done = 0; // since the queue last ran empty
+static LARGE_INTEGER g_burst_start;
+
+static HANDLE g_workers[RG_MAX_WORKERS];
+static int g_worker_count = 0;
+static ReplayGainYieldFn g_should_yield = NULL;
+static void *g_yield_ctx = NULL;
+
+static wchar_t g_cache_path[MAX_PATH];
+
+// ---- file identity ----
+
+static bool utf8_to_wide(const char *src, wchar_t *dst, int dst_len) {
+  return MultiByteToWideChar(CP_UTF8, 0, src, -1, dst, dst_len) > 0;
+}
+
+static bool file_stamp(const char *filepath, uint64_t *size, uint64_t *mtime) {
+  wchar_t path_w[DECODER_PATH_MAX];
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  if (!utf8_to_wide(filepath, path_w, DECODER_PATH_MAX) ||
+      !GetFileAttributesExW(path_w, GetFileExInfoStandard, &fad))
+    return false;
+  *size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+  *mtime = ((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) |
+           fad.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
+// ---- path -> entry table ----
+
+static uint64_t hash_path(const char *s) {
+  uint64_t h = 1469598103934665603ull; // FNV-1a
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static RgEntry *table_slot(RgEntry *table, size_t cap, const char *path) {
+  size_t i = (size_t)hash_path(path) & (cap - 1);
+  while (table[i].path && strcmp(table[i].path, path) != 0)
+    i = (i + 1) & (cap - 1);
+  return &table[i];
+}
+
+static bool table_grow(void) {
+  size_t cap = g_table_cap ? g_table_cap * 2 : RG_TABLE_INIT;
+  RgEntry *table = calloc(cap, sizeof(RgEntry));
+  if (!table)
+    return false;
+  for (size_t i = 0; i < g_table_cap; ++i) {
+    if (g_table[i].path)
+      *table_slot(table, cap, g_table[i].path) = g_table[i];
+  }
+  free(g_table);
+  g_table = table;
+  g_table_cap = cap;
+  return true;
+}
+
+static RgEntry *table_find(const char *path) {
+  if (!g_table)
+    return NULL;
+  RgEntry *e = table_slot(g_table, g_table_cap, path);
+  return e->path ? e : NULL;
+}
+
+static RgEntry *table_insert(const char *path) {
+  // keep the load factor under 3/4
+  if ((g_table_count + 1) * 4 > g_table_cap * 3 && !table_grow())
+    return NULL;
+  RgEntry *e = table_slot(g_table, g_table_cap, path);
+  if (!e->path) {
+    e->path = malloc(strlen(path) + 1);
+    if (!e->path)
+      return NULL;
+    strcpy(e->path, path);
+    g_table_count++;
+  }
+  return e;
+}
+
+static void entry_set_album(RgEntry *e, const char *album) {
+  if (!album)
+    album = "";
+  if (e->album && strcmp(e->album, album) == 0)
+    return;
+  char *copy = malloc(strlen(album) + 1);
+  if (!copy)
+    return;
+  // tabs and newlines would break the cache file's line format
+  for (size_t i = 0;; ++i) {
+    char c = album[i];
+    copy[i] = (c == '\t' || c == '\r' || c == '\n') ? ' ' : c;
+    if (!c)
+      break;
+  }
+  free(e->album);
+  e->album = copy;
+}
+
+// ---- work queue ----
+
+static bool queue_push(char *path) {
+  if (g_queue_len == g_queue_cap) {
+    size_t cap = g_queue_cap ? g_queue_cap * 2 : 256;
+    char **grown = malloc(cap * sizeof(char *));
+    if (!grown)
+      return false;
+    for (size_t i = 0; i < g_queue_len; ++i)
+      grown[i] = g_queue[(g_queue_head + i) % g_queue_cap];
+    free(g_queue);
+    g_queue = grown;
+    g_queue_cap = cap;
+    g_queue_head = 0;
+  }
+  g_queue[(g_queue_head + g_queue_len) % g_queue_cap] = path;
+  g_queue_len++;
+  return true;
+}
+
+static char *queue_pop(void) {
+  if (g_queue_len == 0)
+    return NULL;
+  char *path = g_queue[g_queue_head];
+  g_queue_head = (g_queue_head + 1) % g_queue_cap;
+  g_queue_len--;
+  return path;
+}
+
+// ---- cache file ----
+
+static void cache_load(void) {
+  FILE *f = _wfopen(g_cache_path, L"rb");
+  if (!f)
+    return;
+
+  char line[DECODER_PATH_MAX + 512];
+  if (!fgets(line, sizeof(line), f) ||
+      strncmp(line, RG_CACHE_VERSION, strlen(RG_CACHE_VERSION)) != 0) {
+    fclose(f);
+    return; // unknown format: start over
+  }
+
+  int loaded = 0;
+  while (fgets(line, sizeof(line), f)) {
+    // size mtime lufs peak seconds \t path \t album
+    unsigned long long size, mtime;
+    double lufs, peak, seconds;
+    int consumed = 0;
+    if (sscanf(line, "%llu %llu %lf %lf %lf\t%n", &size, &mtime, &lufs, &peak,
+               &seconds, &consumed) != 5 ||
+        consumed == 0)
+      continue;
+
+    char *path = line + consumed;
+    char *album = strchr(path, '\t');
+    if (!album)
+      continue;
+    *album++ = '\0';
+    album[strcspn(album, "\r\n")] = '\0';
+
+    RgEntry *e = table_insert(path);
+    if (!e)
+      break;
+    entry_set_album(e, album);
+    e->size = size;
+    e->mtime = mtime;
+    e->info = (LoudnessInfo){lufs, peak, seconds};
+    e->valid = true;
+    loaded++;
+  }
+  fclose(f);
+  fprintf(stderr, "[replaygain] %d cached results\n", loaded);
+}
+
+// Written to a temporary file and moved over the old one, so a crash
+// never leaves a truncated cache
+static void cache_save(void) {
+  if (!g_dirty || !g_cache_path[0])
+    return;
+
+  wchar_t tmp_path[MAX_PATH];
+  swprintf(tmp_path, MAX_PATH, L"%ls.tmp", g_cache_path);
+  FILE *f = _wfopen(tmp_path, L"wb");
+  if (!f) {
+    fprintf(stderr, "[replaygain] cannot write the loudness cache\n");
+    return;
+  }
+
+  fprintf(f, "%s\n", RG_CACHE_VERSION);
+  for (size_t i = 0; i < g_table_cap; ++i) {
+    const RgEntry *e = &g_table[i];
+    if (!e->path || !e->valid)
+      continue;
+    fprintf(f, "%llu %llu %.2f %.6f %.2f\t%s\t%s\n",
+            (unsigned long long)e->size, (unsigned long long)e->mtime,
+            e->info.lufs, e->info.peak, e->info.seconds, e->path,
+            e->album ? e->album : "");
+  }
+
+  bool ok = fclose(f) == 0;
+  if (ok && MoveFileExW(tmp_path, g_cache_path, MOVEFILE_REPLACE_EXISTING))
+    g_dirty = false;
+}
+
+static void cache_locate(void) {
+  wchar_t dir[MAX_PATH];
+  g_cache_path[0] = L'\0';
+  DWORD n = ExpandEnvironmentStringsW(L"%LOCALAPPDATA%\\MusicPlayer", dir,
+                                      MAX_PATH);
+  if (n == 0 || n > MAX_PATH || dir[0] == L'%')
+    return; // no LOCALAPPDATA: results only live for this session
+  CreateDirectoryW(dir, NULL); // fine if it already exists
+  swprintf(g_cache_path, MAX_PATH, L"%ls\\loudness.cache", dir);
+}
+
+// ---- workers ----
+
+static bool should_stop(void) {
+  EnterCriticalSection(&g_lock);
+  bool quit = g_quit;
+  LeaveCriticalSection(&g_lock);
+  return quit;
+}
+
+// Decode the whole file at its native rate through the meter
+static bool analyse_file(const char *filepath, float *buf, LoudnessInfo *out) {
+  Decoder *dec = decoder_open_ex(filepath, DECODER_OPEN_BACKGROUND);
+  if (!dec)
+    return false;
+
+  LoudnessMeter meter;
+  if (!loudness_init(&meter, dec->rate)) {
+    decoder_close(dec);
+    return false;
+  }
+
+  bool ok = false;
+  for (;;) {
+    while (g_should_yield && g_should_yield(g_yield_ctx) && !should_stop())
+      Sleep(RG_YIELD_MS);
+    if (should_stop())
+      break;
+
+    size_t got = 0;
+    DecoderResult res = decoder_read(dec, buf, RG_READ_SAMPLES, &got);
+    loudness_add(&meter, buf, got / 2);
+    if (res == DECODER_DONE) {
+      ok = true;
+      break;
+    }
+    if (res == DECODER_ERROR)
+      break;
+  }
+
+  if (ok) {
+    out->lufs = loudness_integrated(&meter);
+    out->peak = loudness_true_peak(&meter);
+    out->seconds = (double)meter.frames / (double)dec->rate;
+  }
+  loudness_free(&meter);
+  decoder_close(dec);
+  return ok;
+}
+
+static DWORD WINAPI worker_main(LPVOID arg) {
+  (void)arg;
+  float *buf = malloc(RG_READ_SAMPLES * sizeof(float));
+  if (!buf)
+    return 1;
+
+  EnterCriticalSection(&g_lock);
+  for (;;) {
+    while (!g_quit && g_queue_len == 0)
+      SleepConditionVariableCS(&g_work, &g_lock, INFINITE);
+    if (g_quit)
+      break;
+
+    char *path = queue_pop();
+    g_active++;
+    LeaveCriticalSection(&g_lock);
+
+    LoudnessInfo info;
+    bool ok = analyse_file(path, buf, &info);
+
+    EnterCriticalSection(&g_lock);
+    g_active--;
+    RgEntry *e = table_find(path);
+    if (e) {
+      e->queued = false;
+      if (ok) {
+        e->info = info;
+        e->valid = true;
+        g_dirty = true;
+      }
+    }
+    if (!g_quit)
+      g_done++;
+    free(path);
+
+    if (g_queue_len == 0 && g_active == 0 && g_done > 0) {
+      LARGE_INTEGER freq, now;
+      QueryPerformanceFrequency(&freq);
+      QueryPerformanceCounter(&now);
+      double secs = (double)(now.QuadPart - g_burst_start.QuadPart) /
+                    (double)freq.QuadPart;
+      fprintf(stderr,
+              "[replaygain] analysed %d files in %.1f s (%.1f files/s)\n",
+              g_done, secs, secs > 0.0 ? g_done / secs : 0.0);
+      cache_save();
+    }
+  }
+  LeaveCriticalSection(&g_lock);
+
+  free(buf);
+  return 0;
+}
+
+// ---- public API ----
+
+bool replaygain_init(int workers, ReplayGainYieldFn should_yield, void *ctx) {
+  if (g_initialized)
+    return true;
+
+  InitializeCriticalSection(&g_lock);
+  InitializeConditionVariable(&g_work);
+  g_quit = false;
+  g_should_yield = should_yield;
+  g_yield_ctx = ctx;
+  g_initialized = true;
+
+  cache_locate();
+  EnterCriticalSection(&g_lock);
+  cache_load();
+  LeaveCriticalSection(&g_lock);
+
+  // Half the cores at most: analysis is a background nicety
+  if (workers <= 0) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    workers = (int)si.dwNumberOfProcessors / 2;
+  }
+  if (workers < 1)
+    workers = 1;
+  if (workers > RG_MAX_WORKERS)
+    workers = RG_MAX_WORKERS;
+
+  for (int i = 0; i < workers; ++i) {
+    HANDLE t = CreateThread(NULL, 0, worker_main, NULL, 0, NULL);
+    if (!t)
+      break;
+    SetThreadPriority(t, THREAD_PRIORITY_LOWEST);
+    g_workers[g_worker_count++] = t;
+  }
+  if (g_worker_count == 0)
+    fprintf(stderr, "[replaygain] no worker threads; analysis disabled\n");
+  return true;
+}
+
+void replaygain_shutdown(void) {
+  if (!g_initialized)
+    return;
+
+  EnterCriticalSection(&g_lock);
+  g_quit = true;
+  WakeAllConditionVariable(&g_work);
+  LeaveCriticalSection(&g_lock);
+
+  for (int i = 0; i < g_worker_count; ++i) {
+    WaitForSingleObject(g_workers[i], INFINITE);
+    CloseHandle(g_workers[i]);
+  }
+  g_worker_count = 0;
+
+  cache_save();
+
+  char *path;
+  while ((path = queue_pop()) != NULL)
+    free(path);
+  free(g_queue);
+  g_queue = NULL;
+  g_queue_cap = g_queue_head = 0;
+
+  for (size_t i = 0; i < g_table_cap; ++i) {
+    free(g_table[i].path);
+    free(g_table[i].album);
+  }
+  free(g_table);
+  g_table = NULL;
+  g_table_cap = g_table_count = 0;
+
+  DeleteCriticalSection(&g_lock);
+  g_initialized = false;
+}
+
+void replaygain_request(const char *filepath, const char *album) {
+  uint64_t size, mtime;
+  if (!g_initialized || g_worker_count == 0 ||
+      !file_stamp(filepath, &size, &mtime))
+    return;
+
+  EnterCriticalSection(&g_lock);
+  RgEntry *e = table_insert(filepath);
+  if (e) {
+    entry_set_album(e, album);
+    bool current = e->valid && e->size == size && e->mtime == mtime;
+    if (!current && !e->queued) {
+      char *copy = malloc(strlen(filepath) + 1);
+      if (copy) {
+        strcpy(copy, filepath);
+        if (queue_push(copy)) {
+          // a new burst of work starts the files/s clock again
+          if (g_queue_len == 1 && g_active == 0) {
+            g_done = 0;
+            QueryPerformanceCounter(&g_burst_start);
+          }
+          e->size = size;
+          e->mtime = mtime;
+          e->valid = false;
+          e->queued = true;
+          WakeConditionVariable(&g_work);
+        } else {
+          free(copy);
+        }
+      }
+    }
+  }
+  LeaveCriticalSection(&g_lock);
+}
+
+// Cached result, if the file has not changed since it was analysed
+static const RgEntry *current_entry(const char *filepath) {
+  uint64_t size, mtime;
+  if (!file_stamp(filepath, &size, &mtime))
+    return NULL;
+  const RgEntry *e = table_find(filepath);
+  if (!e || !e->valid || e->size != size || e->mtime != mtime)
+    return NULL;
+  return e;
+}
+
+bool replaygain_lookup(const char *filepath, LoudnessInfo *out) {
+  if (!g_initialized)
+    return false;
+
+  EnterCriticalSection(&g_lock);
+  const RgEntry *e = current_entry(filepath);
+  if (e)
+    *out = e->info;
+  LeaveCriticalSection(&g_lock);
+  return e != NULL;
+}
+
+// Length of the folder part of a path, separator included
+static size_t folder_len(const char *path) {
+  const char *a = strrchr(path, '\\');
+  const char *b = strrchr(path, '/');
+  const char *sep = a > b ? a : b;
+  return sep ? (size_t)(sep - path) + 1 : 0;
+}
+
+bool replaygain_lookup_album(const char *filepath, LoudnessInfo *out) {
+  if (!g_initialized)
+    return false;
+
+  EnterCriticalSection(&g_lock);
+  const RgEntry *self = current_entry(filepath);
+  bool complete = self != NULL;
+  size_t dir = folder_len(filepath);
+
+  // An album is every analysed track with the same tag in the same
+  // folder. Its loudness is the duration-weighted energy mean of the track
+  // loudness values, a close stand-in for gating all of its blocks at once.
+  double energy = 0.0, seconds = 0.0, peak = 0.0;
+  for (size_t i = 0; complete && i < g_table_cap; ++i) {
+    const RgEntry *e = &g_table[i];
+    if (!e->path || folder_len(e->path) != dir ||
+        strncmp(e->path, filepath, dir) != 0 ||
+        strcmp(e->album ? e->album : "", self->album ? self->album : "") != 0)
+      continue;
+    if (e->queued) {
+      complete = false; // wait for the rest of the album
+      break;
+    }
+    if (!e->valid || e->info.lufs <= LOUDNESS_SILENT)
+      continue;
+    energy += e->info.seconds * pow(10.0, e->info.lufs / 10.0);
+    seconds += e->info.seconds;
+    if (e->info.peak > peak)
+      peak = e->info.peak;
+  }
+  LeaveCriticalSection(&g_lock);
+
+  if (!complete || seconds <= 0.0)
+    return false;
+  out->lufs = 10.0 * log10(energy / seconds);
+  out->peak = peak;
+  out->seconds = seconds;
+  return true;
+}
+
+void replaygain_get_progress(ReplayGainProgress *out) {
+  memset(out, 0, sizeof(*out));
+  if (!g_initialized)
+    return;
+
+  EnterCriticalSection(&g_lock);
+  out->pending = (int)g_queue_len + g_active;
+  out->done = g_done;
+  LARGE_INTEGER start = g_burst_start;
+  LeaveCriticalSection(&g_lock);
+
+  if (out->done > 0) {
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    double secs =
+        (double)(now.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+    if (secs > 0.0)
+      out->files_per_sec = out->done / secs;
+  }
+}
+
+float replaygain_gain_for(const char *filepath, ReplayGainMode mode) {
+  LoudnessInfo info;
+  bool found = false;
+  if (mode == REPLAYGAIN_ALBUM)
+    found = replaygain_lookup_album(filepath, &info);
+  if (!found && mode != REPLAYGAIN_OFF)
+    found = replaygain_lookup(filepath, &info);
+  if (!found || info.lufs <= LOUDNESS_SILENT)
+    return 1.0f;
+
+  double gain = pow(10.0, (REPLAYGAIN_REFERENCE_LUFS - info.lufs) / 20.0);
+  // never push the true peak over full scale
+  if (info.peak > 0.0 && gain * info.peak > 1.0)
+    gain = 1.0 / info.peak;
+  return (float)gain;
+}
+
+const char *replaygain_mode_name(ReplayGainMode mode) {
+  switch (mode) {
+  case REPLAYGAIN_TRACK:
+    return "Track";
+  case REPLAYGAIN_ALBUM:
+    return "Album";
+  default:
+    return "OFF";
+  }
+}
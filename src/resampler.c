@@ -0,0 +1,236 @@
+#include "resampler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESAMPLER_MAX_PHASES 1024
+#define RESAMPLER_BLOCK_FRAMES 1024 // input frames appended per refill
+#define RESAMPLER_MAX_STRETCH 8     // tap multiplier cap when downsampling
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct {
+  const char *name;
+  unsigned taps;
+  double rolloff; // passband edge as a fraction of the lower Nyquist
+  double beta;    // Kaiser window shape
+} ResamplerTier;
+
+static const ResamplerTier g_tiers[RESAMPLER_QUALITY_COUNT] = {
+    {"fast", 16, 0.85, 6.0},
+    {"medium", 32, 0.90, 8.6},
+    {"best", 64, 0.94, 10.0},
+};
+
+static unsigned long gcd(unsigned long a, unsigned long b) {
+  while (b) {
+    unsigned long t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Zeroth-order modified Bessel function (series), for the Kaiser window
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+static void build_filter(Resampler *rs, const ResamplerTier *tier) {
+  double ratio = (double)rs->up / (double)rs->down;
+  // cycles per input sample; lowered below the output Nyquist when
+  // downsampling so nothing aliases
+  double fc = 0.5 * tier->rolloff * (ratio < 1.0 ? ratio : 1.0);
+  double half = (double)rs->taps / 2.0;
+  double center = half - 1.0;
+  double i0_beta = bessel_i0(tier->beta);
+
+  for (unsigned p = 0; p < rs->up; ++p) {
+    float *h = rs->coeffs + (size_t)p * rs->taps;
+    double frac = (double)p / (double)rs->up;
+    double sum = 0.0;
+
+    for (unsigned k = 0; k < rs->taps; ++k) {
+      double d = (double)k - center - frac; // input sample - output time
+      double x = 2.0 * fc * d;
+      double sinc = x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+      double w = d / half;
+      double win =
+          w * w < 1.0 ? bessel_i0(tier->beta * sqrt(1.0 - w * w)) / i0_beta
+                      : 0.0;
+      double v = 2.0 * fc * sinc * win;
+      h[k] = (float)v;
+      sum += v;
+    }
+
+    // unity DC gain for every phase, so there is no phase-dependent ripple
+    for (unsigned k = 0; k < rs->taps; ++k)
+      h[k] = (float)(h[k] / sum);
+  }
+}
+
+bool resampler_init(Resampler *rs, long in_rate, long out_rate,
+                    ResamplerQuality quality) {
+  memset(rs, 0, sizeof(*rs));
+  if (in_rate <= 0 || out_rate <= 0 || quality >= RESAMPLER_QUALITY_COUNT)
+    return false;
+
+  const ResamplerTier *tier = &g_tiers[quality];
+  unsigned long g = gcd((unsigned long)in_rate, (unsigned long)out_rate);
+  unsigned long up = (unsigned long)out_rate / g;
+  unsigned long down = (unsigned long)in_rate / g;
+
+  // Unusual rate pairs reduce to huge phase counts; round to the nearest
+  // ratio over a bounded table instead (well under 0.1% pitch error).
+  if (up > RESAMPLER_MAX_PHASES) {
+    down = (unsigned long)((double)down * RESAMPLER_MAX_PHASES / (double)up +
+                           0.5);
+    up = RESAMPLER_MAX_PHASES;
+    if (down == 0)
+      down = 1;
+    fprintf(stderr, "[resampler] %ld -> %ld Hz approximated as %lu/%lu\n",
+            in_rate, out_rate, up, down);
+  }
+
+  // Downsampling narrows the passband; stretch the filter to keep the
+  // same transition band relative to it
+  unsigned stretch = (unsigned)((down + up - 1) / up);
+  if (stretch < 1)
+    stretch = 1;
+  if (stretch > RESAMPLER_MAX_STRETCH)
+    stretch = RESAMPLER_MAX_STRETCH;
+
+  rs->in_rate = in_rate;
+  rs->out_rate = out_rate;
+  rs->quality = quality;
+  rs->up = (unsigned)up;
+  rs->down = (unsigned)down;
+  rs->taps = tier->taps * stretch;
+  rs->hist_cap = rs->taps + RESAMPLER_BLOCK_FRAMES;
+  rs->kernels = kernels_active();
+
+  rs->coeffs = malloc((size_t)rs->up * rs->taps * sizeof(float));
+  rs->hist[0] = malloc(rs->hist_cap * sizeof(float));
+  rs->hist[1] = malloc(rs->hist_cap * sizeof(float));
+  if (!rs->coeffs || !rs->hist[0] || !rs->hist[1]) {
+    resampler_free(rs);
+    return false;
+  }
+
+  build_filter(rs, tier);
+  resampler_reset(rs);
+  return true;
+}
+
+void resampler_free(Resampler *rs) {
+  free(rs->coeffs);
+  free(rs->hist[0]);
+  free(rs->hist[1]);
+  memset(rs, 0, sizeof(*rs));
+}
+
+void resampler_reset(Resampler *rs) {
+  // Prime with zeros so the first output is centered on input frame 0
+  size_t lead = rs->taps / 2 - 1;
+  memset(rs->hist[0], 0, lead * sizeof(float));
+  memset(rs->hist[1], 0, lead * sizeof(float));
+  rs->hist_len = lead;
+  rs->pos = 0;
+  rs->phase = 0;
+  rs->in_total = 0;
+  rs->out_total = 0;
+}
+
+// Move the unread part of the history to the front
+static void compact(Resampler *rs) {
+  if (rs->pos == 0)
+    return;
+  size_t keep = rs->hist_len - rs->pos;
+  memmove(rs->hist[0], rs->hist[0] + rs->pos, keep * sizeof(float));
+  memmove(rs->hist[1], rs->hist[1] + rs->pos, keep * sizeof(float));
+  rs->hist_len = keep;
+  rs->pos = 0;
+}
+
+static void emit(Resampler *rs, float *out) {
+  const float *h = rs->coeffs + (size_t)rs->phase * rs->taps;
+  out[0] = rs->kernels->dot(h, rs->hist[0] + rs->pos, rs->taps);
+  out[1] = rs->kernels->dot(h, rs->hist[1] + rs->pos, rs->taps);
+
+  rs->phase += rs->down;
+  rs->pos += rs->phase / rs->up;
+  rs->phase %= rs->up;
+  rs->out_total++;
+}
+
+size_t resampler_process(Resampler *rs, const float *in, size_t in_frames,
+                         size_t *in_used, float *out, size_t out_frames) {
+  size_t produced = 0, used = 0;
+
+  for (;;) {
+    while (produced < out_frames && rs->pos + rs->taps <= rs->hist_len)
+      emit(rs, out + 2 * produced++);
+
+    if (produced == out_frames || used == in_frames)
+      break;
+
+    // Refill: deinterleave as much input as the history can take
+    compact(rs);
+    size_t n = rs->hist_cap - rs->hist_len;
+    if (n > in_frames - used)
+      n = in_frames - used;
+    const float *src = in + 2 * used;
+    float *l = rs->hist[0] + rs->hist_len;
+    float *r = rs->hist[1] + rs->hist_len;
+    for (size_t i = 0; i < n; ++i) {
+      l[i] = src[2 * i];
+      r[i] = src[2 * i + 1];
+    }
+    rs->hist_len += n;
+    rs->in_total += n;
+    used += n;
+  }
+
+  *in_used = used;
+  return produced;
+}
+
+size_t resampler_drain(Resampler *rs, float *out, size_t out_frames) {
+  size_t produced = 0;
+
+  // Outputs centered before the end of the real input still belong to the
+  // track; pad with silence to complete their windows.
+  while (produced < out_frames &&
+         rs->out_total * rs->down < rs->in_total * rs->up) {
+    if (rs->pos + rs->taps > rs->hist_len) {
+      compact(rs);
+      size_t pad = rs->hist_cap - rs->hist_len;
+      memset(rs->hist[0] + rs->hist_len, 0, pad * sizeof(float));
+      memset(rs->hist[1] + rs->hist_len, 0, pad * sizeof(float));
+      rs->hist_len = rs->hist_cap;
+    }
+    emit(rs, out + 2 * produced++);
+  }
+  return produced;
+}
+
+size_t resampler_alloc_bytes(const Resampler *rs) {
+  if (!rs->coeffs)
+    return 0;
+  return ((size_t)rs->up * rs->taps + 2 * rs->hist_cap) * sizeof(float);
+}
+
+const char *resampler_quality_name(ResamplerQuality quality) {
+  return quality < RESAMPLER_QUALITY_COUNT ? g_tiers[quality].name : "?";
+}
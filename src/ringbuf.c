@@ -0,0 +1,138 @@
+#include "ringbuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool ringbuf_init(RingBuffer *rb, size_t min_capacity) {
+  size_t capacity = 1;
+  while (capacity < min_capacity)
+    capacity <<= 1;
+
+  rb->data = calloc(capacity, sizeof(float));
+  if (!rb->data) {
+    rb->capacity = 0;
+    rb->mask = 0;
+    return false;
+  }
+
+  rb->capacity = capacity;
+  rb->mask = capacity - 1;
+  atomic_init(&rb->read_pos, 0);
+  atomic_init(&rb->write_pos, 0);
+  return true;
+}
+
+void ringbuf_free(RingBuffer *rb) {
+  free(rb->data);
+  rb->data = NULL;
+  rb->capacity = 0;
+  rb->mask = 0;
+}
+
+void ringbuf_reset(RingBuffer *rb) {
+  atomic_store(&rb->read_pos, 0);
+  atomic_store(&rb->write_pos, 0);
+}
+
+size_t ringbuf_available(RingBuffer *rb) {
+  size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+  size_t r = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+  return w - r;
+}
+
+size_t ringbuf_space(RingBuffer *rb) {
+  return rb->capacity - ringbuf_available(rb);
+}
+
+size_t ringbuf_write(RingBuffer *rb, const float *src, size_t count) {
+  size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+  size_t r = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+  size_t space = rb->capacity - (w - r);
+  if (count > space)
+    count = space;
+  if (count == 0)
+    return 0;
+
+  // copy in at most two pieces (up to the end, then wrapped to the start)
+  size_t start = w & rb->mask;
+  size_t first = rb->capacity - start;
+  if (first > count)
+    first = count;
+  memcpy(rb->data + start, src, first * sizeof(float));
+  memcpy(rb->data, src + first, (count - first) * sizeof(float));
+
+  atomic_store_explicit(&rb->write_pos, w + count, memory_order_release);
+  return count;
+}
+
+size_t ringbuf_write_span(RingBuffer *rb, float **dst) {
+  size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+  size_t r = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+  size_t space = rb->capacity - (w - r);
+
+  // only the part up to the physical end of the buffer is contiguous
+  size_t start = w & rb->mask;
+  size_t contiguous = rb->capacity - start;
+  *dst = rb->data + start;
+  return space < contiguous ? space : contiguous;
+}
+
+void ringbuf_commit(RingBuffer *rb, size_t count) {
+  size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+  atomic_store_explicit(&rb->write_pos, w + count, memory_order_release);
+}
+
+size_t ringbuf_read_span(RingBuffer *rb, const float **src) {
+  size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+  size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+  size_t avail = w - r;
+
+  size_t start = r & rb->mask;
+  size_t contiguous = rb->capacity - start;
+  *src = rb->data + start;
+  return avail < contiguous ? avail : contiguous;
+}
+
+void ringbuf_consume(RingBuffer *rb, size_t count) {
+  size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+  atomic_store_explicit(&rb->read_pos, r + count, memory_order_release);
+}
+
+size_t ringbuf_read(RingBuffer *rb, float *dst, size_t count) {
+  size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+  size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+  size_t avail = w - r;
+  if (count > avail)
+    count = avail;
+  if (count == 0)
+    return 0;
+
+  size_t start = r & rb->mask;
+  size_t first = rb->capacity - start;
+  if (first > count)
+    first = count;
+  memcpy(dst, rb->data + start, first * sizeof(float));
+  memcpy(dst + first, rb->data, (count - first) * sizeof(float));
+
+  atomic_store_explicit(&rb->read_pos, r + count, memory_order_release);
+  return count;
+}
+
+size_t ringbuf_produced(RingBuffer *rb) {
+  return atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+}
+
+size_t ringbuf_consumed(RingBuffer *rb) {
+  return atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+}
+
+void ringbuf_discard_until(RingBuffer *rb, size_t pos) {
+  size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+  size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+  // never skip past what has been written, never move backwards
+  if (pos - r > w - r)
+    pos = w;
+  if (pos == r)
+    return;
+  atomic_store_explicit(&rb->read_pos, pos, memory_order_release);
+}
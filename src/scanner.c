@@ -0,0 +1,636 @@
+#include "scanner.h"
+#include "decoder.h"
+#include "library.h"
+#include "replaygain.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+typedef enum { SLOT_QUEUED, SLOT_READY, SLOT_SKIPPED } SlotState;
+
+typedef struct {
+  Track track; // walker fills path, size and mtime; a worker the rest
+  SlotState state;
+} ScanSlot;
+
+// A rescan's view of what the playlist holds under its folder
+typedef struct {
+  const char *path; // into `names`
+  size_t at;        // offset of the path while `names` still grows
+  uint64_t size, mtime;
+  bool seen; // the walk came across it
+} KnownFile;
+
+typedef struct {
+  char *names; // the paths, one after the other
+  size_t names_len, names_cap;
+  KnownFile *files; // sorted by path
+  int count, cap;
+  bool incomplete; // a folder could not be listed: report nothing gone
+} KnownFiles;
+
+typedef struct {
+  char *path;
+  KnownFiles *known; // rescans only
+} ScanRoot;
+
+// Everything below is guarded by g_lock. Slots form a ring indexed by
+// sequence number: [g_head, g_next) are with the workers or ready to take,
+// [g_next, g_tail) wait for a worker.
+static CRITICAL_SECTION g_lock;
+static CONDITION_VARIABLE g_work;  // files to read, or quit
+static CONDITION_VARIABLE g_space; // room in the window, or cancel/quit
+static CONDITION_VARIABLE g_walk;  // folders to walk, or quit
+static bool g_initialized = false;
+static bool g_quit = false;
+
+static ScanSlot *g_slots = NULL; // SCANNER_WINDOW of them
+static size_t g_head = 0, g_next = 0, g_tail = 0;
+static size_t g_cancel_seq = 0; // files below this are skipped unread
+static bool g_walk_cancel = false;
+
+static ScanRoot *g_roots = NULL; // FIFO of folders and files, ring indexed
+static size_t g_root_cap = 0, g_root_head = 0, g_root_count = 0;
+static char **g_gone = NULL; // FIFO of files rescans did not find
+static size_t g_gone_head = 0, g_gone_count = 0, g_gone_cap = 0;
+static bool g_walking = false;
+static int g_reading = 0; // files inside a worker right now
+
+static bool g_running = false; // a scan started and not reported yet
+static int g_found = 0, g_done = 0;
+static LARGE_INTEGER g_scan_start;
+static double g_scan_secs = 0.0; // of the last scan once it finished
+
+static HANDLE g_walker = NULL;
+static HANDLE g_workers[SCANNER_MAX_WORKERS];
+static int g_worker_count = 0;
+
+static bool utf8_to_wide(const char *src, wchar_t *dst, int dst_len) {
+  return MultiByteToWideChar(CP_UTF8, 0, src, -1, dst, dst_len) > 0;
+}
+
+static bool wide_to_utf8(const wchar_t *src, char *dst, int dst_len) {
+  return WideCharToMultiByte(CP_UTF8, 0, src, -1, dst, dst_len, NULL,
+                             NULL) > 0;
+}
+
+static double seconds_since(LARGE_INTEGER start) {
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (double)(now.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+}
+
+static bool scan_idle(void) {
+  return !g_walking && g_root_count == 0 && g_next == g_tail &&
+         g_reading == 0;
+}
+
+// Report a scan once nothing is left to walk or read
+static void scan_check_finished(void) {
+  if (!g_running || !scan_idle())
+    return;
+  g_running = false;
+  g_scan_secs = seconds_since(g_scan_start);
+  fprintf(stderr, "[scanner] read %d of %d files in %.1f s (%.1f files/s)\n",
+          g_done, g_found, g_scan_secs,
+          g_scan_secs > 0.0 ? g_done / g_scan_secs : 0.0);
+}
+
+// ---- walker ----
+
+static void known_free(KnownFiles *known) {
+  if (known) {
+    free(known->names);
+    free(known->files);
+    free(known);
+  }
+}
+
+static int compare_known(const void *a, const void *b) {
+  return strcmp(((const KnownFile *)a)->path, ((const KnownFile *)b)->path);
+}
+
+// Mark `path` as still there; true if the playlist has it with this size
+// and mtime, so its tags need no second read
+static bool known_unchanged(KnownFiles *known, const char *path,
+                            uint64_t size, uint64_t mtime) {
+  KnownFile key = {.path = path};
+  KnownFile *f =
+      bsearch(&key, known->files, known->count, sizeof(KnownFile),
+              compare_known);
+  if (!f)
+    return false;
+  f->seen = true;
+  return f->size == size && f->mtime == mtime;
+}
+
+static bool roots_push(char *path, KnownFiles *known) {
+  if (g_root_count == g_root_cap) {
+    size_t cap = g_root_cap ? g_root_cap * 2 : 16;
+    ScanRoot *grown = malloc(cap * sizeof(ScanRoot));
+    if (!grown)
+      return false;
+    for (size_t i = 0; i < g_root_count; ++i)
+      grown[i] = g_roots[(g_root_head + i) % g_root_cap];
+    free(g_roots);
+    g_roots = grown;
+    g_root_cap = cap;
+    g_root_head = 0;
+  }
+  ScanRoot *r = &g_roots[(g_root_head + g_root_count) % g_root_cap];
+  r->path = path;
+  r->known = known;
+  g_root_count++;
+  return true;
+}
+
+static bool roots_pop(ScanRoot *out) {
+  if (g_root_count == 0)
+    return false;
+  *out = g_roots[g_root_head];
+  g_root_head = (g_root_head + 1) % g_root_cap;
+  g_root_count--;
+  return true;
+}
+
+static void roots_clear(void) {
+  ScanRoot r;
+  while (roots_pop(&r)) {
+    free(r.path);
+    known_free(r.known);
+  }
+}
+
+static void push_gone(const char *path) {
+  char *copy = malloc(strlen(path) + 1);
+  if (!copy)
+    return;
+  strcpy(copy, path);
+  EnterCriticalSection(&g_lock);
+  if (g_gone_head + g_gone_count == g_gone_cap) {
+    if (g_gone_head > 0) {
+      memmove(g_gone, g_gone + g_gone_head, g_gone_count * sizeof(char *));
+      g_gone_head = 0;
+    } else {
+      size_t cap = g_gone_cap ? g_gone_cap * 2 : 64;
+      char **grown = realloc(g_gone, cap * sizeof(char *));
+      if (!grown) {
+        LeaveCriticalSection(&g_lock);
+        free(copy);
+        return; // the entry stays until the next check at startup
+      }
+      g_gone = grown;
+      g_gone_cap = cap;
+    }
+  }
+  g_gone[g_gone_head + g_gone_count++] = copy;
+  LeaveCriticalSection(&g_lock);
+}
+
+// Hand one file to the workers, waiting while the window is full; false
+// once the walk should stop
+static bool push_file(const char *path, uint64_t size, uint64_t mtime) {
+  EnterCriticalSection(&g_lock);
+  while (!g_quit && !g_walk_cancel && g_tail - g_head == SCANNER_WINDOW)
+    SleepConditionVariableCS(&g_space, &g_lock, INFINITE);
+  bool go_on = !g_quit && !g_walk_cancel;
+  if (go_on) {
+    ScanSlot *s = &g_slots[g_tail % SCANNER_WINDOW];
+    Track *t = &s->track;
+    strncpy(t->filepath, path, sizeof(t->filepath) - 1);
+    t->filepath[sizeof(t->filepath) - 1] = '\0';
+    t->size = size;
+    t->mtime = mtime;
+    s->state = SLOT_QUEUED;
+    g_tail++;
+    g_found++;
+    WakeConditionVariable(&g_work);
+  }
+  LeaveCriticalSection(&g_lock);
+  return go_on;
+}
+
+typedef struct {
+  wchar_t **names;
+  int count, cap;
+} NameList;
+
+static bool names_add(NameList *list, const wchar_t *name) {
+  if (list->count == list->cap) {
+    int cap = list->cap ? list->cap * 2 : 16;
+    wchar_t **grown = realloc(list->names, cap * sizeof(wchar_t *));
+    if (!grown)
+      return false;
+    list->names = grown;
+    list->cap = cap;
+  }
+  size_t len = wcslen(name) + 1;
+  wchar_t *copy = malloc(len * sizeof(wchar_t));
+  if (!copy)
+    return false;
+  memcpy(copy, name, len * sizeof(wchar_t));
+  list->names[list->count++] = copy;
+  return true;
+}
+
+// Files of a folder first, then its subfolders, in listing order. One
+// listing per folder: on a network share each one is a round trip.
+// A rescan passes what the playlist has, to skip the unchanged files.
+static bool walk_folder(const wchar_t *folder, KnownFiles *known) {
+  WIN32_FIND_DATAW ffd;
+  wchar_t search_w[MAX_PATH];
+  if (swprintf(search_w, MAX_PATH, L"%ls\\*", folder) < 0)
+    return true;
+
+  // basic info skips the 8.3 names; large fetch asks for bigger batches
+  HANDLE hFind =
+      FindFirstFileExW(search_w, FindExInfoBasic, &ffd, FindExSearchNameMatch,
+                       NULL, FIND_FIRST_EX_LARGE_FETCH);
+  if (hFind == INVALID_HANDLE_VALUE) {
+    if (known)
+      known->incomplete = true;
+    return true;
+  }
+
+  NameList subdirs = {0};
+  bool go_on = true;
+  do {
+    if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      if (wcscmp(ffd.cFileName, L".") != 0 && wcscmp(ffd.cFileName, L"..") != 0)
+        names_add(&subdirs, ffd.cFileName);
+      continue;
+    }
+
+    wchar_t full_w[MAX_PATH];
+    char full_utf8[DECODER_PATH_MAX];
+    if (swprintf(full_w, MAX_PATH, L"%ls\\%ls", folder, ffd.cFileName) < 0 ||
+        !wide_to_utf8(full_w, full_utf8, sizeof(full_utf8)))
+      continue;
+    uint64_t size = ((uint64_t)ffd.nFileSizeHigh << 32) | ffd.nFileSizeLow;
+    uint64_t mtime = ((uint64_t)ffd.ftLastWriteTime.dwHighDateTime << 32) |
+                     ffd.ftLastWriteTime.dwLowDateTime;
+    if (known && known_unchanged(known, full_utf8, size, mtime))
+      continue;
+    go_on = push_file(full_utf8, size, mtime);
+  } while (go_on && FindNextFileW(hFind, &ffd));
+  FindClose(hFind);
+
+  for (int i = 0; i < subdirs.count; ++i) {
+    wchar_t sub_w[MAX_PATH];
+    if (go_on &&
+        swprintf(sub_w, MAX_PATH, L"%ls\\%ls", folder, subdirs.names[i]) >= 0)
+      go_on = walk_folder(sub_w, known);
+    free(subdirs.names[i]);
+  }
+  free(subdirs.names);
+  return go_on;
+}
+
+static DWORD WINAPI walker_main(LPVOID arg) {
+  (void)arg;
+  EnterCriticalSection(&g_lock);
+  for (;;) {
+    while (!g_quit && g_root_count == 0)
+      SleepConditionVariableCS(&g_walk, &g_lock, INFINITE);
+    if (g_quit)
+      break;
+
+    ScanRoot root;
+    roots_pop(&root);
+    g_walk_cancel = false; // a cancel before this path was queued
+    g_walking = true;
+    LeaveCriticalSection(&g_lock);
+
+    wchar_t root_w[MAX_PATH];
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    bool walked = false;
+    if (utf8_to_wide(root.path, root_w, MAX_PATH) &&
+        GetFileAttributesExW(root_w, GetFileExInfoStandard, &fad)) {
+      if (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        walked = walk_folder(root_w, root.known);
+      else
+        push_file(root.path,
+                  ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow,
+                  ((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) |
+                      fad.ftLastWriteTime.dwLowDateTime);
+    }
+    // only a whole, uncancelled walk tells what is gone
+    if (walked && root.known && !root.known->incomplete) {
+      for (int i = 0; i < root.known->count; ++i)
+        if (!root.known->files[i].seen)
+          push_gone(root.known->files[i].path);
+    }
+    free(root.path);
+    known_free(root.known);
+
+    EnterCriticalSection(&g_lock);
+    g_walking = false;
+    scan_check_finished();
+  }
+  LeaveCriticalSection(&g_lock);
+  return 0;
+}
+
+// ---- tag readers ----
+
+// Playable files get their tags; anything else is left out
+static bool read_file(const char *path, uint64_t size, uint64_t mtime,
+                      Track *t) {
+  if (!decoder_supports_file(path))
+    return false;
+  library_read_track(path, size, mtime, t);
+  replaygain_request(t->filepath, t->album);
+  return true;
+}
+
+static DWORD WINAPI worker_main(LPVOID arg) {
+  (void)arg;
+  char path[DECODER_PATH_MAX];
+
+  EnterCriticalSection(&g_lock);
+  for (;;) {
+    while (!g_quit && g_next == g_tail)
+      SleepConditionVariableCS(&g_work, &g_lock, INFINITE);
+    if (g_quit)
+      break;
+
+    size_t seq = g_next++;
+    ScanSlot *s = &g_slots[seq % SCANNER_WINDOW];
+    bool skip = seq < g_cancel_seq;
+    uint64_t size = s->track.size, mtime = s->track.mtime;
+    strcpy(path, s->track.filepath);
+    g_reading++;
+    LeaveCriticalSection(&g_lock);
+
+    // the slot is ours until its state changes
+    bool ok = !skip && read_file(path, size, mtime, &s->track);
+
+    EnterCriticalSection(&g_lock);
+    g_reading--;
+    s->state = ok ? SLOT_READY : SLOT_SKIPPED;
+    if (!skip)
+      g_done++;
+    scan_check_finished();
+  }
+  LeaveCriticalSection(&g_lock);
+  return 0;
+}
+
+// ---- public API ----
+
+static bool scanner_init(int workers) {
+  g_slots = calloc(SCANNER_WINDOW, sizeof(ScanSlot));
+  if (!g_slots)
+    return false;
+  InitializeCriticalSection(&g_lock);
+  InitializeConditionVariable(&g_work);
+  InitializeConditionVariable(&g_space);
+  InitializeConditionVariable(&g_walk);
+  g_quit = false;
+  g_initialized = true;
+
+  // Reading tags is mostly waiting on the disk or the network, so more
+  // readers than cores still pay off
+  if (workers <= 0) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    workers = (int)si.dwNumberOfProcessors;
+  }
+  if (workers < 2)
+    workers = 2;
+  if (workers > SCANNER_MAX_WORKERS)
+    workers = SCANNER_MAX_WORKERS;
+
+  g_walker = CreateThread(NULL, 0, walker_main, NULL, 0, NULL);
+  if (!g_walker) {
+    scanner_shutdown();
+    return false;
+  }
+  SetThreadPriority(g_walker, THREAD_PRIORITY_BELOW_NORMAL);
+  for (int i = 0; i < workers; ++i) {
+    HANDLE t = CreateThread(NULL, 0, worker_main, NULL, 0, NULL);
+    if (!t)
+      break;
+    SetThreadPriority(t, THREAD_PRIORITY_BELOW_NORMAL);
+    g_workers[g_worker_count++] = t;
+  }
+  if (g_worker_count == 0) {
+    fprintf(stderr, "[scanner] no worker threads\n");
+    scanner_shutdown();
+    return false;
+  }
+  return true;
+}
+
+static bool queue_root(const char *path, KnownFiles *known, int workers) {
+  if (!g_initialized && !scanner_init(workers))
+    return false;
+
+  char *copy = malloc(strlen(path) + 1);
+  if (!copy)
+    return false;
+  strcpy(copy, path);
+
+  EnterCriticalSection(&g_lock);
+  bool queued = roots_push(copy, known);
+  if (queued) {
+    if (!g_running) {
+      g_running = true;
+      g_found = g_done = 0;
+      QueryPerformanceCounter(&g_scan_start);
+    }
+    WakeConditionVariable(&g_walk);
+  }
+  LeaveCriticalSection(&g_lock);
+
+  if (!queued)
+    free(copy);
+  return queued;
+}
+
+bool scanner_start(const char *path, int workers) {
+  return queue_root(path, NULL, workers);
+}
+
+static bool known_add(KnownFiles *known, const char *path,
+                      const TrackRecord *r) {
+  if (known->count == known->cap) {
+    int cap = known->cap ? known->cap * 2 : 256;
+    KnownFile *grown = realloc(known->files, cap * sizeof(KnownFile));
+    if (!grown)
+      return false;
+    known->files = grown;
+    known->cap = cap;
+  }
+  size_t n = strlen(path) + 1;
+  if (known->names_len + n > known->names_cap) {
+    size_t cap = known->names_cap ? known->names_cap * 2 : 1 << 16;
+    while (cap < known->names_len + n)
+      cap *= 2;
+    char *grown = realloc(known->names, cap);
+    if (!grown)
+      return false;
+    known->names = grown;
+    known->names_cap = cap;
+  }
+  memcpy(known->names + known->names_len, path, n);
+  KnownFile *f = &known->files[known->count++];
+  f->at = known->names_len;
+  f->size = r->size;
+  f->mtime = r->mtime;
+  f->seen = false;
+  known->names_len += n;
+  return true;
+}
+
+bool scanner_rescan(const char *folder, const TrackStore *tracks) {
+  KnownFiles *known = calloc(1, sizeof(KnownFiles));
+  if (!known)
+    return false;
+  size_t len = strlen(folder);
+  char path[DECODER_PATH_MAX];
+  bool ok = true;
+  for (int i = 0; ok && i < tracks->count; ++i) {
+    // entries inside the folder, the first of any duplicates only
+    if (trackstore_path(tracks, i, path, sizeof(path)) &&
+        strncmp(path, folder, len) == 0 && path[len] == '\\' &&
+        trackstore_find(tracks, path) == i)
+      ok = known_add(known, path, &tracks->records[i]);
+  }
+  if (!ok) {
+    known_free(known);
+    return false;
+  }
+  for (int i = 0; i < known->count; ++i)
+    known->files[i].path = known->names + known->files[i].at;
+  qsort(known->files, known->count, sizeof(KnownFile), compare_known);
+
+  if (!queue_root(folder, known, 0)) {
+    known_free(known);
+    return false;
+  }
+  return true;
+}
+
+bool scanner_poll_gone(char *path, size_t size) {
+  if (!g_initialized)
+    return false;
+  EnterCriticalSection(&g_lock);
+  char *gone = NULL;
+  if (g_gone_count > 0) {
+    gone = g_gone[g_gone_head++];
+    if (--g_gone_count == 0)
+      g_gone_head = 0;
+  }
+  LeaveCriticalSection(&g_lock);
+  if (!gone)
+    return false;
+  snprintf(path, size, "%s", gone);
+  free(gone);
+  return true;
+}
+
+int scanner_ready(void) {
+  if (!g_initialized)
+    return 0;
+  EnterCriticalSection(&g_lock);
+  int ready = 0;
+  for (size_t seq = g_head; seq != g_next; ++seq) {
+    SlotState state = g_slots[seq % SCANNER_WINDOW].state;
+    if (state == SLOT_QUEUED)
+      break;
+    if (state == SLOT_READY)
+      ready++;
+  }
+  LeaveCriticalSection(&g_lock);
+  return ready;
+}
+
+int scanner_take(Track *out, int max) {
+  if (!g_initialized)
+    return 0;
+  EnterCriticalSection(&g_lock);
+  int taken = 0;
+  size_t head = g_head;
+  while (taken < max && g_head != g_next) {
+    ScanSlot *s = &g_slots[g_head % SCANNER_WINDOW];
+    if (s->state == SLOT_QUEUED)
+      break;
+    if (s->state == SLOT_READY)
+      out[taken++] = s->track;
+    g_head++;
+  }
+  if (g_head != head)
+    WakeConditionVariable(&g_space);
+  LeaveCriticalSection(&g_lock);
+  return taken;
+}
+
+void scanner_cancel(void) {
+  if (!g_initialized)
+    return;
+  EnterCriticalSection(&g_lock);
+  roots_clear();
+  g_walk_cancel = true;
+  g_cancel_seq = g_tail;
+  WakeConditionVariable(&g_space);
+  scan_check_finished();
+  LeaveCriticalSection(&g_lock);
+}
+
+void scanner_get_progress(ScannerProgress *out) {
+  memset(out, 0, sizeof(*out));
+  if (!g_initialized)
+    return;
+  EnterCriticalSection(&g_lock);
+  out->active = g_running;
+  out->found = g_found;
+  out->done = g_done;
+  double secs = g_running ? seconds_since(g_scan_start) : g_scan_secs;
+  out->files_per_sec = secs > 0.0 ? g_done / secs : 0.0;
+  LeaveCriticalSection(&g_lock);
+}
+
+void scanner_shutdown(void) {
+  if (!g_initialized)
+    return;
+
+  EnterCriticalSection(&g_lock);
+  g_quit = true;
+  WakeAllConditionVariable(&g_work);
+  WakeAllConditionVariable(&g_space);
+  WakeAllConditionVariable(&g_walk);
+  LeaveCriticalSection(&g_lock);
+
+  if (g_walker) {
+    WaitForSingleObject(g_walker, INFINITE);
+    CloseHandle(g_walker);
+    g_walker = NULL;
+  }
+  for (int i = 0; i < g_worker_count; ++i) {
+    WaitForSingleObject(g_workers[i], INFINITE);
+    CloseHandle(g_workers[i]);
+  }
+  g_worker_count = 0;
+
+  roots_clear();
+  free(g_roots);
+  g_roots = NULL;
+  g_root_cap = g_root_head = 0;
+  for (size_t i = 0; i < g_gone_count; ++i)
+    free(g_gone[g_gone_head + i]);
+  free(g_gone);
+  g_gone = NULL;
+  g_gone_head = g_gone_count = g_gone_cap = 0;
+  free(g_slots);
+  g_slots = NULL;
+  g_head = g_next = g_tail = g_cancel_seq = 0;
+  g_walking = g_running = false;
+
+  DeleteCriticalSection(&g_lock);
+  g_initialized = false;
+}
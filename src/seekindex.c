@@ -0,0 +1,115 @@
+#include "seekindex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SEEKINDEX_CACHE_SIZE 32
+
+typedef struct {
+  char filepath[1024];
+  uint64_t size, mtime; // of the file the offsets point into
+  off_t *offsets; // byte offset of every `step`-th frame
+  off_t step;
+  size_t fill;
+  unsigned long last_used;
+} SeekIndexEntry;
+
+static SeekIndexEntry g_entries[SEEKINDEX_CACHE_SIZE];
+static unsigned long g_clock = 0;
+
+static SeekIndexEntry *find_entry(const char *filepath) {
+  for (int i = 0; i < SEEKINDEX_CACHE_SIZE; ++i) {
+    if (g_entries[i].offsets && strcmp(g_entries[i].filepath, filepath) == 0)
+      return &g_entries[i];
+  }
+  return NULL;
+}
+
+// Free slot, or the least recently used one
+static SeekIndexEntry *victim_entry(void) {
+  SeekIndexEntry *victim = &g_entries[0];
+  for (int i = 0; i < SEEKINDEX_CACHE_SIZE; ++i) {
+    if (!g_entries[i].offsets)
+      return &g_entries[i];
+    if (g_entries[i].last_used < victim->last_used)
+      victim = &g_entries[i];
+  }
+  return victim;
+}
+
+static void entry_drop(SeekIndexEntry *e) {
+  free(e->offsets);
+  memset(e, 0, sizeof(*e));
+}
+
+static bool entry_matches(const SeekIndexEntry *e, const MappedFile *map) {
+  return e->size == map->size && e->mtime == map->mtime;
+}
+
+void seekindex_store(const char *filepath, const MappedFile *map,
+                     mpg123_handle *mh) {
+  if (!filepath || !filepath[0] || !map || !mh)
+    return;
+
+  off_t *offsets = NULL;
+  off_t step = 0;
+  size_t fill = 0;
+  if (mpg123_index(mh, &offsets, &step, &fill) != MPG123_OK || fill == 0)
+    return;
+
+  // keep whichever index covers more of the file, unless the file changed
+  SeekIndexEntry *e = find_entry(filepath);
+  if (e && !entry_matches(e, map)) {
+    entry_drop(e);
+    e = NULL;
+  }
+  if (e && e->fill * (size_t)e->step >= fill * (size_t)step) {
+    e->last_used = ++g_clock;
+    return;
+  }
+
+  off_t *copy = malloc(fill * sizeof(off_t));
+  if (!copy)
+    return;
+  memcpy(copy, offsets, fill * sizeof(off_t));
+
+  if (!e) {
+    e = victim_entry();
+    strncpy(e->filepath, filepath, sizeof(e->filepath) - 1);
+    e->filepath[sizeof(e->filepath) - 1] = '\0';
+  }
+  free(e->offsets);
+  e->size = map->size;
+  e->mtime = map->mtime;
+  e->offsets = copy;
+  e->step = step;
+  e->fill = fill;
+  e->last_used = ++g_clock;
+}
+
+bool seekindex_apply(const char *filepath, const MappedFile *map,
+                     mpg123_handle *mh) {
+  if (!filepath || !map || !mh)
+    return false;
+
+  SeekIndexEntry *e = find_entry(filepath);
+  if (!e)
+    return false;
+  // Retagged or replaced: the offsets no longer land on frames
+  if (!entry_matches(e, map)) {
+    entry_drop(e);
+    return false;
+  }
+
+  // mpg123 copies the table
+  if (mpg123_set_index(mh, e->offsets, e->step, e->fill) != MPG123_OK)
+    return false;
+
+  e->last_used = ++g_clock;
+  return true;
+}
+
+void seekindex_clear(void) {
+  for (int i = 0; i < SEEKINDEX_CACHE_SIZE; ++i)
+    entry_drop(&g_entries[i]);
+}
@@ -0,0 +1,250 @@
+#include "sink.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+// Offline sinks: no device, so nothing paces them. A thread renders
+// fixed-size blocks back to back and only waits for the decoder, which
+// makes a run both faster than real time and independent of timing. The
+// clock is simulated: it is simply the number of frames rendered.
+
+#define OFFLINE_BLOCK_FRAMES 512 // a typical device buffer, unless asked
+#define OFFLINE_PATH_MAX 1024
+#define WAV_HEADER_BYTES 58 // RIFF, 18-byte fmt, fact and data chunks
+
+typedef enum { OFFLINE_NULL, OFFLINE_WAV, OFFLINE_RAW } OfflineKind;
+
+typedef struct {
+  AudioSink base;
+  OfflineKind kind;
+  AudioSinkCallbacks cb;
+  float *block;
+  FILE *file;
+  char path[OFFLINE_PATH_MAX];
+  bool write_failed;
+  uint64_t frames; // the simulated clock
+  HANDLE thread;
+  atomic_bool quit;
+} OfflineSink;
+
+static FILE *fopen_utf8_write(const char *path) {
+  wchar_t path_w[OFFLINE_PATH_MAX];
+  if (MultiByteToWideChar(CP_UTF8, 0, path, -1, path_w, OFFLINE_PATH_MAX) <=
+      0)
+    return NULL;
+  return _wfopen(path_w, L"wb");
+}
+
+static void put_u16(unsigned char *p, uint16_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// WAVE_FORMAT_IEEE_FLOAT. Sizes are patched in on close; past 4 GiB they
+// saturate, as most readers expect.
+static bool wav_write_header(OfflineSink *s) {
+  uint64_t data = s->frames * (uint64_t)s->base.channels * sizeof(float);
+  uint64_t max_data = 0xFFFFFFFFu - WAV_HEADER_BYTES;
+  uint32_t data32 = (uint32_t)(data < max_data ? data : max_data);
+  uint32_t frames32 =
+      (uint32_t)(s->frames < 0xFFFFFFFFu ? s->frames : 0xFFFFFFFFu);
+  uint16_t block_align = (uint16_t)(s->base.channels * sizeof(float));
+
+  unsigned char h[WAV_HEADER_BYTES];
+  memcpy(h, "RIFF", 4);
+  put_u32(h + 4, WAV_HEADER_BYTES - 8 + data32);
+  memcpy(h + 8, "WAVEfmt ", 8);
+  put_u32(h + 16, 18);
+  put_u16(h + 20, 3); // IEEE float
+  put_u16(h + 22, (uint16_t)s->base.channels);
+  put_u32(h + 24, (uint32_t)s->base.rate);
+  put_u32(h + 28, (uint32_t)s->base.rate * block_align);
+  put_u16(h + 32, block_align);
+  put_u16(h + 34, 32);
+  put_u16(h + 36, 0); // no extension
+  memcpy(h + 38, "fact", 4);
+  put_u32(h + 42, 4);
+  put_u32(h + 46, frames32);
+  memcpy(h + 50, "data", 4);
+  put_u32(h + 54, data32);
+
+  return fseek(s->file, 0, SEEK_SET) == 0 &&
+         fwrite(h, 1, sizeof(h), s->file) == sizeof(h);
+}
+
+static DWORD WINAPI offline_thread_main(LPVOID arg) {
+  OfflineSink *s = (OfflineSink *)arg;
+  unsigned block = s->base.frames;
+  size_t samples = block * (size_t)s->base.channels;
+  unsigned idle = 0;
+
+  while (!atomic_load(&s->quit)) {
+    if (!s->cb.ready(block, s->cb.user)) {
+      // The decoder is about to catch up, or nothing is playing: spin
+      // briefly, then stop burning the CPU
+      Sleep(idle++ < 64 ? 0 : 1);
+      continue;
+    }
+    idle = 0;
+
+    s->cb.render(s->block, block, 0, s->cb.user);
+    s->frames += block;
+
+    // Samples go out in host order, which is little-endian on every
+    // target we build for
+    if (s->file && !s->write_failed &&
+        fwrite(s->block, sizeof(float), samples, s->file) != samples) {
+      fprintf(stderr, "[sink] write failed; output is truncated\n");
+      s->write_failed = true;
+    }
+  }
+  return 0;
+}
+
+static long offline_native_rate(const char *target, long fallback) {
+  (void)target;
+  return fallback;
+}
+
+static AudioSink *offline_open(OfflineKind kind, const AudioSinkVTable *vt,
+                               const char *target, long rate, int channels,
+                               const AudioSinkBuffering *buffering,
+                               const AudioSinkCallbacks *cb) {
+  OfflineSink *s = calloc(1, sizeof(OfflineSink));
+  if (!s)
+    return NULL;
+  s->base.vt = vt;
+  s->base.rate = rate;
+  s->base.channels = channels;
+  s->base.frames = buffering->frames ? buffering->frames : OFFLINE_BLOCK_FRAMES;
+  s->kind = kind;
+  s->cb = *cb;
+  atomic_init(&s->quit, false);
+
+  s->block = malloc(s->base.frames * (size_t)channels * sizeof(float));
+  if (!s->block) {
+    free(s);
+    return NULL;
+  }
+
+  if (kind != OFFLINE_NULL) {
+    snprintf(s->path, sizeof(s->path), "%s", target ? target : "");
+    s->file = fopen_utf8_write(s->path);
+    if (!s->file) {
+      fprintf(stderr, "[sink] cannot create %s\n", s->path);
+      free(s->block);
+      free(s);
+      return NULL;
+    }
+    if (kind == OFFLINE_WAV && !wav_write_header(s)) {
+      fprintf(stderr, "[sink] cannot write %s\n", s->path);
+      fclose(s->file);
+      free(s->block);
+      free(s);
+      return NULL;
+    }
+  }
+
+  s->thread = CreateThread(NULL, 0, offline_thread_main, s, 0, NULL);
+  if (!s->thread) {
+    fprintf(stderr, "[sink] failed to start render thread\n");
+    if (s->file)
+      fclose(s->file);
+    free(s->block);
+    free(s);
+    return NULL;
+  }
+
+  fprintf(stderr, "[sink] %s: %ld Hz, %d channels%s%s\n", vt->name, rate,
+          channels, s->file ? " -> " : "", s->path);
+  return &s->base;
+}
+
+// A file sink keeps appending until it is pointed at another file
+static bool offline_is_current(AudioSink *sink, const char *target) {
+  OfflineSink *s = (OfflineSink *)sink;
+  return s->kind == OFFLINE_NULL || strcmp(s->path, target ? target : "") == 0;
+}
+
+static void offline_close(AudioSink *sink) {
+  OfflineSink *s = (OfflineSink *)sink;
+  atomic_store(&s->quit, true);
+  WaitForSingleObject(s->thread, INFINITE);
+  CloseHandle(s->thread);
+
+  if (s->file) {
+    if (s->kind == OFFLINE_WAV && !wav_write_header(s))
+      fprintf(stderr, "[sink] failed to finish the WAV header\n");
+    fclose(s->file);
+  }
+  fprintf(stderr, "[sink] %s: rendered %.2f s\n", sink->vt->name,
+          (double)s->frames / (double)sink->rate);
+  free(s->block);
+  free(s);
+}
+
+static AudioSink *null_open(const char *target, long rate, int channels,
+                            const AudioSinkBuffering *buffering,
+                            const AudioSinkCallbacks *cb) {
+  return offline_open(OFFLINE_NULL, &sink_null_vtable, target, rate, channels,
+                      buffering, cb);
+}
+
+static AudioSink *wav_open(const char *target, long rate, int channels,
+                           const AudioSinkBuffering *buffering,
+                           const AudioSinkCallbacks *cb) {
+  return offline_open(OFFLINE_WAV, &sink_wav_vtable, target, rate, channels,
+                      buffering, cb);
+}
+
+static AudioSink *raw_open(const char *target, long rate, int channels,
+                           const AudioSinkBuffering *buffering,
+                           const AudioSinkCallbacks *cb) {
+  return offline_open(OFFLINE_RAW, &sink_raw_vtable, target, rate, channels,
+                      buffering, cb);
+}
+
+const AudioSinkVTable sink_null_vtable = {
+    .name = "null",
+    .native_rate = offline_native_rate,
+    .open = null_open,
+    .is_current = offline_is_current,
+    .close = offline_close,
+};
+
+const AudioSinkVTable sink_wav_vtable = {
+    .name = "wav",
+    .native_rate = offline_native_rate,
+    .open = wav_open,
+    .is_current = offline_is_current,
+    .close = offline_close,
+};
+
+const AudioSinkVTable sink_raw_vtable = {
+    .name = "raw",
+    .native_rate = offline_native_rate,
+    .open = raw_open,
+    .is_current = offline_is_current,
+    .close = offline_close,
+};
+
+const AudioSinkVTable *sink_for_target(const char *target) {
+  if (!target || !target[0])
+    return &sink_portaudio_vtable;
+  if (strcmp(target, "null") == 0)
+    return &sink_null_vtable;
+
+  const char *dot = strrchr(target, '.');
+  if (dot && _stricmp(dot, ".wav") == 0)
+    return &sink_wav_vtable;
+  return &sink_raw_vtable;
+}
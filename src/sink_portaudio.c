@@ -0,0 +1,141 @@
+#include "sink.h"
+
+#include <portaudio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  AudioSink base;
+  PaStream *stream;
+  PaDeviceIndex device;
+  AudioSinkCallbacks cb;
+} PaSink;
+
+static bool g_pa_initialized = false;
+
+static bool pa_init_once(void) {
+  if (g_pa_initialized)
+    return true;
+  if (Pa_Initialize() != paNoError) {
+    fprintf(stderr, "PortAudio init failed\n");
+    return false;
+  }
+  g_pa_initialized = true;
+  return true;
+}
+
+static int pa_callback(const void *input, void *output,
+                       unsigned long frameCount,
+                       const PaStreamCallbackTimeInfo *timeInfo,
+                       PaStreamCallbackFlags statusFlags, void *userData) {
+  (void)input;
+  (void)timeInfo;
+
+  unsigned status = 0;
+  if (statusFlags & paOutputUnderflow)
+    status |= AUDIO_SINK_UNDERFLOW;
+  if (statusFlags & paOutputOverflow)
+    status |= AUDIO_SINK_OVERFLOW;
+
+  PaSink *s = (PaSink *)userData;
+  s->cb.render((float *)output, frameCount, status, s->cb.user);
+  return paContinue;
+}
+
+static long pa_native_rate(const char *target, long fallback) {
+  (void)target;
+  if (!pa_init_once())
+    return 0;
+
+  PaDeviceIndex device = Pa_GetDefaultOutputDevice();
+  if (device == paNoDevice) {
+    fprintf(stderr, "[audio] No default output device.\n");
+    return 0;
+  }
+  const PaDeviceInfo *info = Pa_GetDeviceInfo(device);
+  return info && info->defaultSampleRate > 0.0 ? (long)info->defaultSampleRate
+                                               : fallback;
+}
+
+static AudioSink *pa_open(const char *target, long rate, int channels,
+                          const AudioSinkBuffering *buffering,
+                          const AudioSinkCallbacks *cb) {
+  (void)target;
+  if (!pa_init_once())
+    return NULL;
+
+  PaSink *s = calloc(1, sizeof(PaSink));
+  if (!s)
+    return NULL;
+  s->base.vt = &sink_portaudio_vtable;
+  s->base.rate = rate;
+  s->base.channels = channels;
+  s->cb = *cb;
+  s->device = Pa_GetDefaultOutputDevice();
+
+  PaStreamParameters outParams;
+  memset(&outParams, 0, sizeof(outParams));
+  outParams.device = s->device;
+
+  const PaDeviceInfo *info = Pa_GetDeviceInfo(outParams.device);
+  if (!info) {
+    fprintf(stderr, "[audio] No default output device.\n");
+    free(s);
+    return NULL;
+  }
+  fprintf(stderr, "[audio] using device: %s\n", info->name);
+
+  outParams.channelCount = channels;
+  outParams.sampleFormat = paFloat32;
+  outParams.suggestedLatency = buffering->latency > 0.0
+                                    ? buffering->latency
+                                    : info->defaultLowOutputLatency;
+  outParams.hostApiSpecificStreamInfo = NULL;
+
+  unsigned long frames = buffering->frames ? buffering->frames
+                                           : paFramesPerBufferUnspecified;
+  PaError paErr = Pa_OpenStream(&s->stream, NULL, &outParams, (double)rate,
+                                frames, paClipOff, pa_callback, s);
+  if (paErr != paNoError) {
+    fprintf(stderr, "[audio] Pa_OpenStream failed: %s\n",
+            Pa_GetErrorText(paErr));
+    free(s);
+    return NULL;
+  }
+
+  paErr = Pa_StartStream(s->stream);
+  if (paErr != paNoError) {
+    fprintf(stderr, "[audio] Pa_StartStream failed: %s\n",
+            Pa_GetErrorText(paErr));
+    Pa_CloseStream(s->stream);
+    free(s);
+    return NULL;
+  }
+
+  const PaStreamInfo *si = Pa_GetStreamInfo(s->stream);
+  s->base.frames = buffering->frames;
+  s->base.latency = si ? si->outputLatency : outParams.suggestedLatency;
+  return &s->base;
+}
+
+static bool pa_is_current(AudioSink *sink, const char *target) {
+  (void)target;
+  return ((PaSink *)sink)->device == Pa_GetDefaultOutputDevice();
+}
+
+static void pa_close(AudioSink *sink) {
+  PaSink *s = (PaSink *)sink;
+  Pa_StopStream(s->stream);
+  Pa_CloseStream(s->stream);
+  free(s);
+}
+
+const AudioSinkVTable sink_portaudio_vtable = {
+    .name = "portaudio",
+    .native_rate = pa_native_rate,
+    .open = pa_open,
+    .is_current = pa_is_current,
+    .close = pa_close,
+};
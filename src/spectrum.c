@@ -0,0 +1,205 @@
+#include "spectrum.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define FFT_N SPECTRUM_FFT_SIZE
+#define FFT_HALF (FFT_N / 2) // the real FFT runs as a complex one of half size
+#define SPECTRUM_LOW_HZ 30.0
+#define SPECTRUM_HIGH_HZ 16000.0
+#define SPECTRUM_FLOOR_DB -90.0f
+
+struct Spectrum {
+  float window[FFT_N]; // Hann
+  // split-complex work buffers; each pass reads one pair, writes the other
+  float re[FFT_HALF], im[FFT_HALF];
+  float re2[FFT_HALF], im2[FFT_HALF];
+  float tw_re[FFT_HALF / 2], tw_im[FFT_HALF / 2]; // e^(-2 pi i k / HALF)
+  float post_re[FFT_HALF], post_im[FFT_HALF];     // e^(-2 pi i k / N)
+  float power[FFT_HALF + 1];
+
+  // band layout, rebuilt when the rate or the band count changes
+  long rate;
+  int bands;
+  int band_lo[SPECTRUM_MAX_BANDS]; // first bin
+  int band_hi[SPECTRUM_MAX_BANDS]; // past the last; == lo: interpolate
+  float band_at[SPECTRUM_MAX_BANDS]; // fractional bin of the band centre
+};
+
+Spectrum *spectrum_create(void) {
+  Spectrum *sp = calloc(1, sizeof(Spectrum));
+  if (!sp)
+    return NULL;
+
+  for (int n = 0; n < FFT_N; ++n)
+    sp->window[n] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * n / FFT_N));
+  for (int k = 0; k < FFT_HALF / 2; ++k) {
+    sp->tw_re[k] = (float)cos(2.0 * M_PI * k / FFT_HALF);
+    sp->tw_im[k] = (float)-sin(2.0 * M_PI * k / FFT_HALF);
+  }
+  for (int k = 0; k < FFT_HALF; ++k) {
+    sp->post_re[k] = (float)cos(2.0 * M_PI * k / FFT_N);
+    sp->post_im[k] = (float)-sin(2.0 * M_PI * k / FFT_N);
+  }
+  return sp;
+}
+
+void spectrum_free(Spectrum *sp) { free(sp); }
+
+// One radix-2 Stockham pass: sub-transforms of n points, s of them
+// interleaved. The inner loop runs over contiguous data, so every pass
+// after the first two is done four butterflies at a time.
+static void fft_pass(const Spectrum *sp, const float *xr, const float *xi,
+                     float *yr, float *yi, size_t n, size_t s) {
+  size_t m = n / 2;
+  size_t tw_step = FFT_HALF / n;
+  for (size_t p = 0; p < m; ++p) {
+    float wr = sp->tw_re[p * tw_step];
+    float wi = sp->tw_im[p * tw_step];
+    const float *ar = xr + s * p, *ai = xi + s * p;
+    const float *br = xr + s * (p + m), *bi = xi + s * (p + m);
+    float *sr = yr + s * 2 * p, *si = yi + s * 2 * p;
+    float *dr = sr + s, *di = si + s;
+
+    size_t q = 0;
+#ifdef __SSE2__
+    __m128 vwr = _mm_set1_ps(wr), vwi = _mm_set1_ps(wi);
+    for (; q + 4 <= s; q += 4) {
+      __m128 a_r = _mm_loadu_ps(ar + q), a_i = _mm_loadu_ps(ai + q);
+      __m128 b_r = _mm_loadu_ps(br + q), b_i = _mm_loadu_ps(bi + q);
+      __m128 d_r = _mm_sub_ps(a_r, b_r), d_i = _mm_sub_ps(a_i, b_i);
+      _mm_storeu_ps(sr + q, _mm_add_ps(a_r, b_r));
+      _mm_storeu_ps(si + q, _mm_add_ps(a_i, b_i));
+      _mm_storeu_ps(dr + q, _mm_sub_ps(_mm_mul_ps(d_r, vwr),
+                                       _mm_mul_ps(d_i, vwi)));
+      _mm_storeu_ps(di + q, _mm_add_ps(_mm_mul_ps(d_r, vwi),
+                                       _mm_mul_ps(d_i, vwr)));
+    }
+#endif
+    for (; q < s; ++q) {
+      float d_r = ar[q] - br[q], d_i = ai[q] - bi[q];
+      sr[q] = ar[q] + br[q];
+      si[q] = ai[q] + bi[q];
+      dr[q] = d_r * wr - d_i * wi;
+      di[q] = d_r * wi + d_i * wr;
+    }
+  }
+}
+
+// Complex FFT of re/im in place (natural order in and out)
+static void fft_half(Spectrum *sp) {
+  float *xr = sp->re, *xi = sp->im, *yr = sp->re2, *yi = sp->im2;
+  for (size_t n = FFT_HALF, s = 1; n > 1; n /= 2, s *= 2) {
+    fft_pass(sp, xr, xi, yr, yi, n, s);
+    float *t = xr;
+    xr = yr;
+    yr = t;
+    t = xi;
+    xi = yi;
+    yi = t;
+  }
+  if (xr != sp->re) {
+    memcpy(sp->re, xr, sizeof(sp->re));
+    memcpy(sp->im, xi, sizeof(sp->im));
+  }
+}
+
+// Power of the real FFT of the windowed mono mix, bins 0..FFT_HALF. The
+// samples go in as FFT_HALF complex pairs and are separated afterwards.
+static void real_power(Spectrum *sp, const float *stereo) {
+  for (int k = 0; k < FFT_HALF; ++k) {
+    const float *f = stereo + 4 * k;
+    sp->re[k] = (f[0] + f[1]) * 0.5f * sp->window[2 * k];
+    sp->im[k] = (f[2] + f[3]) * 0.5f * sp->window[2 * k + 1];
+  }
+  fft_half(sp);
+
+  for (int k = 0; k <= FFT_HALF; ++k) {
+    int j = k % FFT_HALF, c = (FFT_HALF - k) % FFT_HALF;
+    // even and odd halves from Z[k] and conj(Z[HALF - k])
+    float er = 0.5f * (sp->re[j] + sp->re[c]);
+    float ei = 0.5f * (sp->im[j] - sp->im[c]);
+    float or_ = 0.5f * (sp->im[j] + sp->im[c]);
+    float oi = -0.5f * (sp->re[j] - sp->re[c]);
+    float wr = k < FFT_HALF ? sp->post_re[k] : -1.0f;
+    float wi = k < FFT_HALF ? sp->post_im[k] : 0.0f;
+    float xr = er + or_ * wr - oi * wi;
+    float xi = ei + or_ * wi + oi * wr;
+    sp->power[k] = xr * xr + xi * xi;
+  }
+}
+
+// Log-spaced bands between SPECTRUM_LOW_HZ and SPECTRUM_HIGH_HZ (or
+// Nyquist). Low bands narrower than a bin read between bins instead.
+static void layout_bands(Spectrum *sp, long rate, int bands) {
+  double hz_per_bin = (double)rate / FFT_N;
+  double high = rate / 2.0 < SPECTRUM_HIGH_HZ ? rate / 2.0 : SPECTRUM_HIGH_HZ;
+  double ratio = pow(high / SPECTRUM_LOW_HZ, 1.0 / bands);
+  for (int b = 0; b < bands; ++b) {
+    double f0 = SPECTRUM_LOW_HZ * pow(ratio, b);
+    double f1 = f0 * ratio;
+    int lo = (int)ceil(f0 / hz_per_bin);
+    int hi = (int)ceil(f1 / hz_per_bin);
+    if (hi > FFT_HALF + 1)
+      hi = FFT_HALF + 1;
+    sp->band_lo[b] = lo;
+    sp->band_hi[b] = hi > lo ? hi : lo;
+    sp->band_at[b] = (float)(sqrt(f0 * f1) / hz_per_bin);
+  }
+  sp->rate = rate;
+  sp->bands = bands;
+}
+
+static float to_db(float power, float ref) {
+  float db = 10.0f * log10f(power * ref + 1e-12f);
+  return db < SPECTRUM_FLOOR_DB ? SPECTRUM_FLOOR_DB : db;
+}
+
+void spectrum_compute(Spectrum *sp, const float *stereo, long rate, int bands,
+                      SpectrumFrame *out) {
+  if (bands > SPECTRUM_MAX_BANDS)
+    bands = SPECTRUM_MAX_BANDS;
+  if (bands < 1)
+    bands = 1;
+  if (rate != sp->rate || bands != sp->bands)
+    layout_bands(sp, rate, bands);
+
+  float peak = 0.0f;
+  double sum = 0.0;
+  for (int i = 0; i < 2 * FFT_N; ++i) {
+    float a = fabsf(stereo[i]);
+    peak = a > peak ? a : peak;
+    sum += (double)stereo[i] * stereo[i];
+  }
+  out->peak_db = to_db(peak * peak, 1.0f);
+  out->rms_db = to_db((float)(sum / (2 * FFT_N)), 1.0f);
+
+  real_power(sp, stereo);
+
+  // A full-scale sine reads 0 dB: the Hann window halves its amplitude
+  float ref = 16.0f / ((float)FFT_N * (float)FFT_N);
+  out->bands = bands;
+  for (int b = 0; b < bands; ++b) {
+    float p = 0.0f;
+    if (sp->band_hi[b] > sp->band_lo[b]) {
+      for (int k = sp->band_lo[b]; k < sp->band_hi[b]; ++k)
+        p = sp->power[k] > p ? sp->power[k] : p;
+    } else {
+      float at = sp->band_at[b];
+      int k = (int)at;
+      float t = at - (float)k;
+      p = k < FFT_HALF ? sp->power[k] * (1.0f - t) + sp->power[k + 1] * t
+                       : sp->power[FFT_HALF];
+    }
+    out->band_db[b] = to_db(p, ref);
+  }
+}
@@ -0,0 +1,74 @@
+#include "tap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool tap_init(AudioTap *tap, size_t min_capacity) {
+  size_t capacity = 1;
+  while (capacity < min_capacity)
+    capacity <<= 1;
+
+  tap->data = calloc(capacity, sizeof(float));
+  if (!tap->data) {
+    tap->capacity = 0;
+    tap->mask = 0;
+    return false;
+  }
+
+  tap->capacity = capacity;
+  tap->mask = capacity - 1;
+  atomic_init(&tap->write_pos, 0);
+  atomic_init(&tap->claim_pos, 0);
+  return true;
+}
+
+void tap_free(AudioTap *tap) {
+  free(tap->data);
+  tap->data = NULL;
+  tap->capacity = 0;
+  tap->mask = 0;
+}
+
+void tap_write(AudioTap *tap, const float *src, size_t count) {
+  if (!tap->data)
+    return;
+  // only the newest capacity samples can ever be read
+  if (count > tap->capacity) {
+    src += count - tap->capacity;
+    count = tap->capacity;
+  }
+
+  // Announce the write first: a reader that overlaps it sees the claim
+  size_t w = atomic_load_explicit(&tap->write_pos, memory_order_relaxed);
+  atomic_store_explicit(&tap->claim_pos, w + count, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  size_t start = w & tap->mask;
+  size_t first = tap->capacity - start;
+  if (first > count)
+    first = count;
+  memcpy(tap->data + start, src, first * sizeof(float));
+  memcpy(tap->data, src + first, (count - first) * sizeof(float));
+  atomic_store_explicit(&tap->write_pos, w + count, memory_order_release);
+}
+
+bool tap_read_latest(AudioTap *tap, float *dst, size_t count) {
+  if (!tap->data || count > tap->capacity)
+    return false;
+  size_t end = atomic_load_explicit(&tap->write_pos, memory_order_acquire);
+  if (end < count)
+    return false;
+
+  size_t from = end - count;
+  size_t start = from & tap->mask;
+  size_t first = tap->capacity - start;
+  if (first > count)
+    first = count;
+  memcpy(dst, tap->data + start, first * sizeof(float));
+  memcpy(dst + first, tap->data, (count - first) * sizeof(float));
+
+  // Valid unless the writer has since started overwriting [from, end)
+  atomic_thread_fence(memory_order_acquire);
+  size_t claim = atomic_load_explicit(&tap->claim_pos, memory_order_relaxed);
+  return claim - from <= tap->capacity;
+}
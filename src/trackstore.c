@@ -0,0 +1,397 @@
+#include "trackstore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACKSTORE_INIT_RECORDS 1024
+#define TRACKSTORE_INIT_STRINGS (1 << 16) // bytes
+#define TRACKSTORE_INIT_SLOTS 1024        // per hash table, power of two
+
+static uint32_t hash_bytes(uint32_t h, const char *s, size_t n) {
+  for (size_t i = 0; i < n; ++i) // FNV-1a
+    h = (h ^ (uint8_t)s[i]) * 16777619u;
+  return h;
+}
+
+#define HASH_BASIS 2166136261u
+
+static uint32_t hash_group(const TrackGroup *g) {
+  uint32_t h = HASH_BASIS;
+  h = (h ^ g->folder) * 16777619u;
+  h = (h ^ g->artist) * 16777619u;
+  return (h ^ g->album) * 16777619u;
+}
+
+// Unlike strncpy, leaves the rest of `dst` alone
+static void copy_string(char *dst, size_t dst_size, const char *src) {
+  size_t n = strnlen(src, dst_size - 1);
+  memcpy(dst, src, n);
+  dst[n] = '\0';
+}
+
+// Length of the folder part of a path, its last separator included
+static size_t folder_length(const char *path) {
+  const char *sep = NULL;
+  for (const char *p = path; *p; ++p)
+    if (*p == '\\' || *p == '/')
+      sep = p;
+  return sep ? (size_t)(sep - path) + 1 : 0;
+}
+
+// ---- strings ----
+
+// Offset of a copy of the first `n` bytes of `str`; UINT32_MAX when out
+// of memory or past what an offset can address
+static uint32_t arena_add(TrackStore *s, const char *str, size_t n) {
+  if (n == 0)
+    return 0;
+  if (s->strings_len + n + 1 > UINT32_MAX)
+    return UINT32_MAX;
+  if (s->strings_len + n + 1 > s->strings_cap) {
+    size_t cap = s->strings_cap * 2;
+    while (cap < s->strings_len + n + 1)
+      cap *= 2;
+    char *grown = realloc(s->strings, cap);
+    if (!grown)
+      return UINT32_MAX;
+    s->strings = grown;
+    s->strings_cap = cap;
+  }
+  uint32_t off = (uint32_t)s->strings_len;
+  memcpy(s->strings + off, str, n);
+  s->strings[off + n] = '\0';
+  s->strings_len += n + 1;
+  return off;
+}
+
+static bool intern_grow(TrackStore *s) {
+  size_t cap = s->intern_cap ? s->intern_cap * 2 : TRACKSTORE_INIT_SLOTS;
+  uint32_t *slots = calloc(cap, sizeof(uint32_t));
+  if (!slots)
+    return false;
+  for (size_t i = 0; i < s->intern_cap; ++i) {
+    if (!s->intern[i])
+      continue;
+    const char *str = s->strings + s->intern[i] - 1;
+    size_t j = hash_bytes(HASH_BASIS, str, strlen(str)) & (cap - 1);
+    while (slots[j])
+      j = (j + 1) & (cap - 1);
+    slots[j] = s->intern[i];
+  }
+  free(s->intern);
+  s->intern = slots;
+  s->intern_cap = cap;
+  return true;
+}
+
+// Offset of the one stored copy of the first `n` bytes of `str`
+static uint32_t intern(TrackStore *s, const char *str, size_t n) {
+  if (n == 0)
+    return 0;
+  if ((s->intern_used + 1) * 2 > s->intern_cap && !intern_grow(s))
+    return UINT32_MAX;
+
+  size_t mask = s->intern_cap - 1;
+  size_t j = hash_bytes(HASH_BASIS, str, n) & mask;
+  for (; s->intern[j]; j = (j + 1) & mask) {
+    const char *x = s->strings + s->intern[j] - 1;
+    if (strncmp(x, str, n) == 0 && x[n] == '\0')
+      return s->intern[j] - 1;
+  }
+  uint32_t off = arena_add(s, str, n);
+  if (off == UINT32_MAX)
+    return UINT32_MAX;
+  s->intern[j] = off + 1;
+  s->intern_used++;
+  return off;
+}
+
+// ---- groups ----
+
+static bool group_slots_grow(TrackStore *s) {
+  size_t cap =
+      s->group_slot_cap ? s->group_slot_cap * 2 : TRACKSTORE_INIT_SLOTS;
+  uint32_t *slots = calloc(cap, sizeof(uint32_t));
+  if (!slots)
+    return false;
+  for (uint32_t g = 0; g < s->group_count; ++g) {
+    size_t j = hash_group(&s->groups[g]) & (cap - 1);
+    while (slots[j])
+      j = (j + 1) & (cap - 1);
+    slots[j] = g + 1;
+  }
+  free(s->group_slots);
+  s->group_slots = slots;
+  s->group_slot_cap = cap;
+  return true;
+}
+
+static uint32_t group_intern(TrackStore *s, const TrackGroup *g) {
+  if (g->folder == UINT32_MAX || g->artist == UINT32_MAX ||
+      g->album == UINT32_MAX)
+    return UINT32_MAX;
+  if ((s->group_count + 1) * 2 > s->group_slot_cap && !group_slots_grow(s))
+    return UINT32_MAX;
+
+  size_t mask = s->group_slot_cap - 1;
+  size_t j = hash_group(g) & mask;
+  for (; s->group_slots[j]; j = (j + 1) & mask) {
+    const TrackGroup *x = &s->groups[s->group_slots[j] - 1];
+    if (x->folder == g->folder && x->artist == g->artist &&
+        x->album == g->album)
+      return s->group_slots[j] - 1;
+  }
+  if (s->group_count == s->group_cap) {
+    uint32_t cap = s->group_cap ? s->group_cap * 2 : 256;
+    TrackGroup *grown = realloc(s->groups, cap * sizeof(TrackGroup));
+    if (!grown)
+      return UINT32_MAX;
+    s->groups = grown;
+    s->group_cap = cap;
+  }
+  s->groups[s->group_count] = *g;
+  s->group_slots[j] = ++s->group_count;
+  return s->group_count - 1;
+}
+
+// ---- path index ----
+
+static const char *record_folder(const TrackStore *s, const TrackRecord *r) {
+  return s->strings + s->groups[r->group].folder;
+}
+
+static uint32_t hash_record(const TrackStore *s, const TrackRecord *r) {
+  const char *folder = record_folder(s, r);
+  const char *name = s->strings + r->name;
+  return hash_bytes(hash_bytes(HASH_BASIS, folder, strlen(folder)), name,
+                    strlen(name));
+}
+
+static bool record_is(const TrackStore *s, const TrackRecord *r,
+                      const char *path) {
+  const char *folder = record_folder(s, r);
+  size_t n = strlen(folder);
+  return strncmp(path, folder, n) == 0 &&
+         strcmp(path + n, s->strings + r->name) == 0;
+}
+
+static bool same_file(const TrackStore *s, const TrackRecord *a,
+                      const TrackRecord *b) {
+  // interned, so equal folders have equal offsets
+  return s->groups[a->group].folder == s->groups[b->group].folder &&
+         strcmp(s->strings + a->name, s->strings + b->name) == 0;
+}
+
+// Index every record again into `cap` slots; the first of duplicate
+// entries is the one found
+static bool path_index_build(TrackStore *s, size_t cap) {
+  int *slots = calloc(cap, sizeof(int));
+  if (!slots)
+    return false;
+  for (int i = 0; i < s->count; ++i) {
+    const TrackRecord *r = &s->records[i];
+    size_t j = hash_record(s, r) & (cap - 1);
+    while (slots[j] && !same_file(s, &s->records[slots[j] - 1], r))
+      j = (j + 1) & (cap - 1);
+    if (!slots[j])
+      slots[j] = i + 1;
+  }
+  free(s->path_slots);
+  s->path_slots = slots;
+  s->path_cap = cap;
+  return true;
+}
+
+// Slot holding `path`, or the empty one where it would go
+static size_t path_slot(const TrackStore *s, const char *path) {
+  size_t mask = s->path_cap - 1;
+  size_t j = hash_bytes(HASH_BASIS, path, strlen(path)) & mask;
+  while (s->path_slots[j] &&
+         !record_is(s, &s->records[s->path_slots[j] - 1], path))
+    j = (j + 1) & mask;
+  return j;
+}
+
+// ---- public API ----
+
+void trackstore_free(TrackStore *s) {
+  free(s->records);
+  free(s->strings);
+  free(s->intern);
+  free(s->groups);
+  free(s->group_slots);
+  free(s->path_slots);
+  memset(s, 0, sizeof(*s));
+}
+
+bool trackstore_reserve(TrackStore *s, int count) {
+  if (!s->strings) {
+    s->strings = malloc(TRACKSTORE_INIT_STRINGS);
+    if (!s->strings)
+      return false;
+    s->strings[0] = '\0'; // what offset 0 stands for
+    s->strings_len = 1;
+    s->strings_cap = TRACKSTORE_INIT_STRINGS;
+  }
+  if (count <= s->cap)
+    return true;
+  int cap = s->cap ? s->cap : TRACKSTORE_INIT_RECORDS;
+  while (cap < count)
+    cap *= 2;
+  TrackRecord *grown = realloc(s->records, (size_t)cap * sizeof(TrackRecord));
+  if (!grown)
+    return false;
+  s->records = grown;
+  s->cap = cap;
+  return true;
+}
+
+int trackstore_add(TrackStore *s, const Track *t) {
+  if (!trackstore_reserve(s, s->count + 1))
+    return -1;
+  size_t need = s->path_cap ? s->path_cap : TRACKSTORE_INIT_SLOTS;
+  while ((size_t)(s->count + 1) * 4 > need * 3) // load factor under 3/4
+    need *= 2;
+  if (need != s->path_cap && !path_index_build(s, need))
+    return -1;
+
+  size_t folder_len = folder_length(t->filepath);
+  const char *name = t->filepath + folder_len;
+  TrackGroup g = {intern(s, t->filepath, folder_len),
+                  intern(s, t->artist, strlen(t->artist)),
+                  intern(s, t->album, strlen(t->album))};
+  TrackRecord r = {.size = t->size,
+                   .mtime = t->mtime,
+                   .name = arena_add(s, name, strlen(name)),
+                   .title = arena_add(s, t->title, strlen(t->title)),
+                   .group = group_intern(s, &g),
+                   .duration = (float)t->duration};
+  if (r.name == UINT32_MAX || r.title == UINT32_MAX ||
+      r.group == UINT32_MAX)
+    return -1;
+
+  int index = s->count++;
+  s->records[index] = r;
+  size_t j = path_slot(s, t->filepath);
+  if (!s->path_slots[j])
+    s->path_slots[j] = index + 1;
+  return index;
+}
+
+bool trackstore_set(TrackStore *s, int index, const Track *t) {
+  TrackRecord *r = &s->records[index];
+  TrackGroup g = {s->groups[r->group].folder,
+                  intern(s, t->artist, strlen(t->artist)),
+                  intern(s, t->album, strlen(t->album))};
+  uint32_t group = group_intern(s, &g);
+  if (group == UINT32_MAX)
+    return false;
+
+  const char *old_title = s->strings + r->title;
+  if (strcmp(old_title, t->title) != 0) {
+    size_t old_len = r->title ? strlen(old_title) + 1 : 0;
+    uint32_t title = arena_add(s, t->title, strlen(t->title));
+    if (title == UINT32_MAX)
+      return false;
+    s->strings_dead += old_len;
+    r->title = title;
+  }
+  r->group = group;
+  r->size = t->size;
+  r->mtime = t->mtime;
+  r->duration = (float)t->duration;
+  return true;
+}
+
+// Copy the live tracks into a fresh store once most of the arena is
+// strings nothing refers to any more
+static void compact(TrackStore *s) {
+  TrackStore fresh = {0};
+  bool ok = trackstore_reserve(&fresh, s->count);
+  Track t;
+  for (int i = 0; ok && i < s->count; ++i) {
+    trackstore_get(s, i, &t);
+    ok = trackstore_add(&fresh, &t) >= 0;
+  }
+  if (!ok) {
+    trackstore_free(&fresh);
+    return;
+  }
+  trackstore_free(s);
+  *s = fresh;
+}
+
+void trackstore_remove(TrackStore *s, const bool *remove, int count) {
+  int kept = 0;
+  for (int i = 0; i < s->count; ++i) {
+    const TrackRecord *r = &s->records[i];
+    if (i < count && remove[i]) {
+      if (r->name)
+        s->strings_dead += strlen(s->strings + r->name) + 1;
+      if (r->title)
+        s->strings_dead += strlen(s->strings + r->title) + 1;
+      continue;
+    }
+    s->records[kept++] = *r;
+  }
+  if (kept == s->count)
+    return;
+  s->count = kept;
+
+  if (s->strings_dead > s->strings_len / 2) {
+    size_t before = s->strings_len;
+    compact(s);
+    if (s->strings_len < before)
+      fprintf(stderr, "[trackstore] compacted strings: %zu -> %zu bytes\n",
+              before, s->strings_len);
+  }
+  // positions moved; on failure lookups just come up empty
+  if (!path_index_build(s, s->path_cap ? s->path_cap : TRACKSTORE_INIT_SLOTS) &&
+      s->path_slots)
+    memset(s->path_slots, 0, s->path_cap * sizeof(int));
+}
+
+int trackstore_find(const TrackStore *s, const char *path) {
+  if (!s->path_slots)
+    return -1;
+  return s->path_slots[path_slot(s, path)] - 1;
+}
+
+void trackstore_get(const TrackStore *s, int index, Track *out) {
+  const TrackRecord *r = &s->records[index];
+  if (!trackstore_path(s, index, out->filepath, sizeof(out->filepath)))
+    out->filepath[0] = '\0';
+  copy_string(out->title, sizeof(out->title), s->strings + r->title);
+  copy_string(out->artist, sizeof(out->artist), trackstore_artist(s, index));
+  copy_string(out->album, sizeof(out->album), trackstore_album(s, index));
+  out->duration = r->duration;
+  out->size = r->size;
+  out->mtime = r->mtime;
+}
+
+bool trackstore_path(const TrackStore *s, int index, char *out, size_t size) {
+  const TrackRecord *r = &s->records[index];
+  int n = snprintf(out, size, "%s%s", record_folder(s, r),
+                   s->strings + r->name);
+  return n >= 0 && (size_t)n < size;
+}
+
+const char *trackstore_title(const TrackStore *s, int index) {
+  return s->strings + s->records[index].title;
+}
+
+const char *trackstore_artist(const TrackStore *s, int index) {
+  return s->strings + s->groups[s->records[index].group].artist;
+}
+
+const char *trackstore_album(const TrackStore *s, int index) {
+  return s->strings + s->groups[s->records[index].group].album;
+}
+
+size_t trackstore_bytes(const TrackStore *s) {
+  return (size_t)s->cap * sizeof(TrackRecord) + s->strings_cap +
+         s->intern_cap * sizeof(uint32_t) +
+         (size_t)s->group_cap * sizeof(TrackGroup) +
+         s->group_slot_cap * sizeof(uint32_t) + s->path_cap * sizeof(int);
+}
@@ -1,8 +1,14 @@
 #include "ui.h"
 #include "ctype.h"
+#include "decoder.h"
 #include "direct.h"
+#include "library.h"
+#include "replaygain.h"
+#include "scanner.h"
+#include "spectrum.h"
 #include "string.h"
 #include "version.h"
+#include "watcher.h"
 #include <conio.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,10 +16,28 @@
 #include <windows.h>
 
 #define MAX_COMPONENTS 16
+#define UI_SEEK_STEP 5.0      // seconds per LEFT/RIGHT press
+#define UI_CROSSFADE_STEP 2.0 // seconds per X press, wraps after 12
+#define UI_VIS_CPU_BUDGET 0.01 // share of one core the visualizer may use
+#define UI_SCAN_BATCH 64       // tracks taken from the scanner at a time
 static int g_first_draw = 1;
+static bool g_scan_shown = false;       // scan progress is on screen
+static bool g_library_checking = false; // startup check may drop entries
 static UiComponent g_components[MAX_COMPONENTS];
 static int g_component_count = 0;
 
+// Spectrum visualizer state, owned by its component
+typedef struct {
+  Spectrum *spectrum;
+  float window[2 * SPECTRUM_FFT_SIZE];
+  SpectrumFrame frame;
+  bool valid;
+  double cost;    // seconds per analysis, smoothed
+  double next_at; // analyses are spaced out to stay within the budget
+} UiVisualizer;
+
+static UiVisualizer g_vis;
+
 typedef struct {
   char name_display[MAX_PATH];
   char path_utf8[MAX_PATH];
@@ -95,6 +119,23 @@ static void comp_progress_draw(UiComponent *, const Player *, const UIState *,
                                UiRect);
 static void comp_footer_controls_draw(UiComponent *, const Player *,
                                       const UIState *, UiRect);
+static void comp_audio_stats_draw(UiComponent *, const Player *,
+                                  const UIState *, UiRect);
+static void comp_spectrum_draw(UiComponent *, const Player *, const UIState *,
+                               UiRect);
+
+// "m:ss", or "h:mm:ss" from an hour on; "-" when unknown
+static void format_duration(double seconds, char *out, size_t size) {
+  if (seconds <= 0.0) {
+    snprintf(out, size, "-");
+    return;
+  }
+  long s = (long)(seconds + 0.5);
+  if (s >= 3600)
+    snprintf(out, size, "%ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+  else
+    snprintf(out, size, "%ld:%02ld", s / 60, s % 60);
+}
 
 static void comp_banner_draw(UiComponent *self, const Player *player,
                              const UIState *ui, UiRect area) {
@@ -126,11 +167,16 @@ static void comp_now_playing_draw(UiComponent *self, const Player *player,
 static void comp_navigation_draw(UiComponent *self, const Player *player,
                                  const UIState *ui, UiRect area) {
   (void)self;
-  (void)ui;
   (void)player;
   (void)area;
 
-  printf("Playlist\033[K\n");
+  if (ui->tracks.count == 0) {
+    printf("Playlist\033[K\n");
+    return;
+  }
+  char total[32];
+  format_duration(ui->total_duration, total, sizeof(total));
+  printf("Playlist: %d tracks, %s\033[K\n", ui->tracks.count, total);
 }
 
 static void comp_progress_draw(UiComponent *self, const Player *player,
@@ -163,6 +209,60 @@ static void comp_progress_draw(UiComponent *self, const Player *player,
          player->current_track.duration);
 }
 
+static double ui_now_s(void) {
+  LARGE_INTEGER freq, t;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart / (double)freq.QuadPart;
+}
+
+// Spectrum of what is playing plus peak/RMS level. The analysis runs here,
+// at the redraw cadence; the audio thread only copies into the tap.
+static void comp_spectrum_draw(UiComponent *self, const Player *player,
+                               const UIState *ui, UiRect area) {
+  (void)area;
+  UiVisualizer *vis = (UiVisualizer *)self->userdata;
+
+  int bands = ui->width - 40;
+  if (bands > SPECTRUM_MAX_BANDS)
+    bands = SPECTRUM_MAX_BANDS;
+  if (!vis || !vis->spectrum || bands < 8) {
+    printf("\033[K\n");
+    return;
+  }
+
+  double now = ui_now_s();
+  long rate = 0;
+  if (player->state != PLAYER_PLAYING) {
+    vis->valid = false;
+  } else if (now >= vis->next_at &&
+             player_tap_read(vis->window, SPECTRUM_FFT_SIZE, &rate)) {
+    spectrum_compute(vis->spectrum, vis->window, rate, bands, &vis->frame);
+    double cost = ui_now_s() - now;
+    vis->cost = vis->valid ? vis->cost * 0.9 + cost * 0.1 : cost;
+    vis->next_at = now + vis->cost / UI_VIS_CPU_BUDGET;
+    vis->valid = true;
+  }
+
+  static const char *levels[] = {" ", "▁", "▂", "▃", "▄",
+                                 "▅", "▆", "▇", "█"};
+  printf("Spectrum ");
+  for (int b = 0; b < bands; ++b) {
+    int level = 0;
+    if (vis->valid && b < vis->frame.bands) {
+      // -72 dB .. 0 dB over the eight block heights
+      level = (int)((vis->frame.band_db[b] + 72.0f) / 9.0f + 0.5f);
+      level = level < 0 ? 0 : level > 8 ? 8 : level;
+    }
+    fputs(levels[level], stdout);
+  }
+  if (vis->valid)
+    printf(" pk %4.0f rms %4.0f dB  %3.0f us\033[K\n", vis->frame.peak_db,
+           vis->frame.rms_db, vis->cost * 1e6);
+  else
+    printf("\033[K\n");
+}
+
 static void comp_volume_draw(UiComponent *self, const Player *player,
                              const UIState *ui, UiRect area) {
   (void)self;
@@ -172,6 +272,36 @@ static void comp_volume_draw(UiComponent *self, const Player *player,
   printf("Volume: %d%%\033[K\n", (int)(player->volume * 100));
 }
 
+// Output diagnostics overlay, toggled with D
+static void comp_audio_stats_draw(UiComponent *self, const Player *player,
+                                  const UIState *ui, UiRect area) {
+  (void)self;
+  (void)player;
+  (void)ui;
+  (void)area;
+
+  AudioStats st;
+  player_get_audio_stats(&st);
+
+  // upper bound of the histogram bucket holding the 99th percentile
+  uint64_t seen = 0;
+  unsigned long p99 = 0;
+  for (int i = 0; i < AUDIO_STATS_BUCKETS; ++i) {
+    seen += st.time_hist[i];
+    p99 = 1ul << i;
+    if (seen * 100 >= st.callbacks * 99)
+      break;
+  }
+  size_t cap = st.ring_capacity ? st.ring_capacity : 1;
+
+  printf("Audio: callback %.0f avg, <%lu p99, %.0f max of %.0f us  |  "
+         "xruns %llu  |  starved %llu  |  ring %zu%% (min %zu%%)\033[K\n",
+         st.time_mean_us, p99, st.time_max_us, st.budget_us,
+         (unsigned long long)(st.underflows + st.overflows),
+         (unsigned long long)st.starved, st.ring_fill * 100 / cap,
+         st.ring_fill_min * 100 / cap);
+}
+
 static void comp_playlist_draw(UiComponent *self, const Player *player,
                                const UIState *ui, UiRect area) {
   (void)self;
@@ -188,35 +318,39 @@ static void comp_playlist_draw(UiComponent *self, const Player *player,
   if (max_lines <= 0)
     return;
 
-  printf("   %-25.25s | %-25.25s | %-30.30s\033[K\n", "Title", "Artist",
-         "Album");
+  printf("   %-25.25s | %-25.25s | %-30.30s | %7s\033[K\n", "Title",
+         "Artist", "Album", "Length");
   max_lines--;
 
   if (max_lines <= 0)
     return;
 
-  printf("   %-25.25s-+-%-25.25s-+-%-30.30s\033[K\n",
+  printf("   %-25.25s-+-%-25.25s-+-%-30.30s-+-%7s\033[K\n",
          "------------------------", "------------------------",
-         "------------------------------");
+         "------------------------------", "-------");
   max_lines--;
 
   int start = ui->track_offset;
   for (int i = 0; i < max_lines; ++i) {
     int idx = start + i;
-    if (idx >= ui->track_count) {
+    if (idx >= ui->tracks.count) {
       printf("\033[K\n");
       continue;
     }
 
-    const Track *t = &ui->tracks[idx];
+    const char *title = trackstore_title(&ui->tracks, idx);
+    const char *artist = trackstore_artist(&ui->tracks, idx);
+    const char *album = trackstore_album(&ui->tracks, idx);
     char marker = (idx == ui->selected_index) ? '>' : ' ';
 
-    printf("%c %2d %-25.25s | %-25.25s | %-30.30s\033[K\n", marker, idx + 1,
-           t->title[0] ? t->title : "-", t->artist[0] ? t->artist : "-",
-           t->album[0] ? t->album : "-");
+    char length[32];
+    format_duration(ui->tracks.records[idx].duration, length, sizeof(length));
+    printf("%c %2d %-25.25s | %-25.25s | %-30.30s | %7s\033[K\n", marker,
+           idx + 1, title[0] ? title : "-", artist[0] ? artist : "-",
+           album[0] ? album : "-", length);
   }
 
-  if (ui->track_count == 0) {
+  if (ui->tracks.count == 0) {
     printf("  (no tracks loaded)\033[K\n");
   }
 }
@@ -239,13 +373,37 @@ static void comp_footer_controls_draw(UiComponent *self, const Player *player,
     break;
   }
 
-  printf("Repeat: %s  |  Shuffle: %s\033[K\n", repeat_str,
-         player->shuffle ? "ON" : "OFF");
-
-  printf("Controls: [P] Play/Pause  [S] Stop  [Q] Quit\033[K\n");
-  printf("          [+/-] Volume    [A] Add folder   [↑/↓] Select  [ENTER] "
-         "Play\033[K\n");
-  printf("          [R] Repeat mode  [F] Shuffle on/off\033");
+  // Every line stays under 80 columns, the narrowest full layout: a wider
+  // one wraps and scrolls the screen out from under later redraws
+  char crossfade[16] = "OFF";
+  if (player->crossfade > 0.0)
+    snprintf(crossfade, sizeof(crossfade), "%.0fs", player->crossfade);
+  printf("Repeat: %s | Shuffle: %s | Crossfade: %s | Gain: %s | EQ: %s"
+         "\033[K\n",
+         repeat_str, player->shuffle ? "ON" : "OFF", crossfade,
+         replaygain_mode_name(player->gain_mode),
+         eq_preset_name(player->eq_preset));
+
+  // Background work, while there is any
+  ReplayGainProgress rg;
+  replaygain_get_progress(&rg);
+  ScannerProgress scan;
+  scanner_get_progress(&scan);
+  if (rg.pending > 0)
+    printf("Gain scan: %d left (%.1f/s)", rg.pending, rg.files_per_sec);
+  if (rg.pending > 0 && scan.active)
+    printf(" | ");
+  if (scan.active)
+    printf("Adding: %d/%d files (%.0f/s)", scan.done, scan.found,
+           scan.files_per_sec);
+  printf("\033[K\n");
+
+  printf("Controls: [P] Play/Pause  [S] Stop  [A] Add folder  [C] Cancel add  "
+         "[Q] Quit\033[K\n");
+  printf("          [+/-] Volume  [←/→] Seek 5s  [↑/↓] Select  [ENTER] Play"
+         "\033[K\n");
+  printf("          [R] Repeat  [F] Shuffle  [X] Crossfade  [G] Gain  [E] EQ  "
+         "[D] Stats\033[K");
 }
 
 static void draw_main_screen_components(const Player *player, UIState *ui) {
@@ -490,107 +648,354 @@ static int list_subdirs2(const char *base_utf8, FolderItem *items,
   return count;
 }
 
+// Index of the playing track in the playlist, or -1
+static int find_current_index(const Player *player, const UIState *ui_state) {
+  return trackstore_find(&ui_state->tracks, player->current_track.filepath);
+}
+
+// Which track follows `current` under the repeat/shuffle settings, or -1
+static int pick_next_index(const Player *player, const UIState *ui_state,
+                           int current) {
+  if (ui_state->tracks.count == 0)
+    return -1;
+
+  if (player->repeat_mode == REPEAT_ONE)
+    return current;
+
+  int next = current;
+  if (player->shuffle && ui_state->tracks.count > 1) {
+    // random next (different from current)
+    do {
+      next = rand() % ui_state->tracks.count;
+    } while (next == current);
+  } else {
+    // sequential
+    next = current + 1;
+  }
+
+  // end-of-playlist behavior
+  if (next >= ui_state->tracks.count) {
+    if (player->repeat_mode == REPEAT_ALL)
+      return 0; // loop playlist
+    return -1;  // REPEAT_NONE and no more tracks
+  }
+  return next;
+}
+
+// Prime the decoder for whatever plays after the current track, so the
+// engine can switch to it without a gap.
+static void ui_queue_next_track(Player *player, UIState *ui_state) {
+  ui_state->next_index = -1;
+  if (player->current_track.filepath[0] == '\0') {
+    player_clear_next(player);
+    return;
+  }
+
+  int current = find_current_index(player, ui_state);
+  if (current < 0)
+    current = ui_state->selected_index;
+
+  int next = pick_next_index(player, ui_state, current);
+  if (next < 0) {
+    player_clear_next(player);
+    return;
+  }
+
+  char path[DECODER_PATH_MAX];
+  if (trackstore_path(&ui_state->tracks, next, path, sizeof(path)) &&
+      player_queue_next(player, path))
+    ui_state->next_index = next;
+}
+
+static double sum_durations(const TrackStore *tracks) {
+  double total = 0.0;
+  for (int i = 0; i < tracks->count; ++i)
+    total += tracks->records[i].duration;
+  return total;
+}
+
+// New tags for playlist entry `index`, keeping the running total right
+static void update_track(UIState *ui_state, int index, const Track *t) {
+  double before = ui_state->tracks.records[index].duration;
+  if (trackstore_set(&ui_state->tracks, index, t))
+    ui_state->total_duration += ui_state->tracks.records[index].duration -
+                                before;
+}
+
+// Take the player's view of a track (tags, duration) into the playlist,
+// keeping the file identity the library index checks against
+static void refresh_track(UIState *ui_state, int index, const Track *from) {
+  Track t = *from;
+  t.size = ui_state->tracks.records[index].size;
+  t.mtime = ui_state->tracks.records[index].mtime;
+  update_track(ui_state, index, &t);
+}
+
 static void play_track_at_index(Player *player, UIState *ui_state, int index) {
-  if (index < 0 || index >= ui_state->track_count)
+  if (index < 0 || index >= ui_state->tracks.count)
     return;
 
   ui_state->selected_index = index;
 
-  Track *t = &ui_state->tracks[index];
-  if (player_load_track(player, t->filepath)) {
+  char path[DECODER_PATH_MAX];
+  if (trackstore_path(&ui_state->tracks, index, path, sizeof(path)) &&
+      player_load_track(player, path)) {
     // refresh metadata & duration in playlist from player
-    *t = player->current_track;
+    refresh_track(ui_state, index, &player->current_track);
     player_play(player);
+    ui_queue_next_track(player, ui_state);
   }
 }
 
-// Load all *.mp3 files from a folder into ui_state->tracks
-static void add_folder_mp3s_recursive(UIState *ui_state,
-                                      const char *folder_utf8) {
-  WIN32_FIND_DATAW ffd;
-  HANDLE hFind;
-  wchar_t folder_w[MAX_PATH];
-  wchar_t search_w[MAX_PATH];
+// Queue a folder for the background scanner; its playable files (any
+// format a decoder backend recognizes) reach the playlist through
+// ui_scan_update, and later changes to it through ui_watch_update
+static void add_folder_mp3s(const char *folder_utf8) {
+  library_add_root(folder_utf8);
+  if (!scanner_start(folder_utf8, 0))
+    fprintf(stderr, "[ui] could not queue %s for scanning\n", folder_utf8);
+  if (!watcher_add_root(folder_utf8))
+    fprintf(stderr, "[ui] cannot watch %s for changes\n", folder_utf8);
+}
 
-  if (!utf8_to_utf16(folder_utf8, folder_w, MAX_PATH)) {
-    return;
+// A scanned track into the playlist: in place if its file is listed
+// already (a folder added again, or a file that changed), else appended
+static bool merge_track(UIState *ui_state, const Track *t) {
+  int at = trackstore_find(&ui_state->tracks, t->filepath);
+  if (at >= 0) {
+    update_track(ui_state, at, t);
+    return true;
   }
+  at = trackstore_add(&ui_state->tracks, t);
+  if (at < 0)
+    return false;
+  ui_state->total_duration += ui_state->tracks.records[at].duration;
+  return true;
+}
 
-  // 1) Add all *.mp3 in this folder
-  swprintf(search_w, MAX_PATH, L"%ls\\*.mp3", folder_w);
-  hFind = FindFirstFileW(search_w, &ffd);
-  if (hFind != INVALID_HANDLE_VALUE) {
-    do {
-      if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-        continue;
+void ui_scan_update(Player *player, UIState *ui_state) {
+  ScannerProgress progress;
+  scanner_get_progress(&progress);
+
+  int ready = scanner_ready();
+  if (ready > 0) {
+    static Track batch[UI_SCAN_BATCH]; // full Tracks only while merging
+    bool ok = trackstore_reserve(&ui_state->tracks,
+                                 ui_state->tracks.count + ready);
+    int taken;
+    while (ok && (taken = scanner_take(batch, UI_SCAN_BATCH)) > 0) {
+      for (int i = 0; ok && i < taken; ++i)
+        ok = merge_track(ui_state, &batch[i]);
+    }
+    if (!ok) {
+      printf("\nOut of memory while adding tracks.\n");
+      scanner_cancel();
+      return;
+    }
+    // the end of the playlist may have something to follow it now
+    if (ui_state->next_index < 0)
+      ui_queue_next_track(player, ui_state);
+  }
 
-      int idx = ui_state->track_count;
-      Track *new_arr = realloc(ui_state->tracks, (idx + 1) * sizeof(Track));
-      if (!new_arr) {
-        printf("\nOut of memory while adding tracks.\n");
-        break;
-      }
-      ui_state->tracks = new_arr;
+  // redraw for progress at the usual rate, and once more when done
+  DWORD now = GetTickCount();
+  if ((progress.active && now - ui_state->last_prog_tick >= 100) ||
+      progress.active != g_scan_shown) {
+    ui_state->dirty = true;
+    ui_state->last_prog_tick = now;
+  }
+  g_scan_shown = progress.active;
+}
 
-      Track *t = &ui_state->tracks[idx];
-      memset(t, 0, sizeof(Track));
+void ui_library_open(UIState *ui_state) {
+  trackstore_free(&ui_state->tracks);
+  if (!library_load(&ui_state->tracks))
+    return;
+  ui_state->total_duration = sum_durations(&ui_state->tracks);
+  ui_state->selected_index = 0;
+  ui_state->track_offset = 0;
+  g_library_checking = library_validate_start();
+  for (int i = 0; i < library_root_count(); ++i)
+    watcher_add_root(library_root(i));
+}
 
-      // full path in UTF-16
-      wchar_t full_w[MAX_PATH];
-      swprintf(full_w, MAX_PATH, L"%ls\\%ls", folder_w, ffd.cFileName);
+// Drop the tracks flagged in `missing` (the first `count` of the list)
+static void remove_missing_tracks(Player *player, UIState *ui_state,
+                                  const bool *missing, int count) {
+  int kept = 0, selected = 0;
+  for (int i = 0; i < ui_state->tracks.count; ++i) {
+    if (i == ui_state->selected_index)
+      selected = kept;
+    if (i < count && missing[i])
+      ui_state->total_duration -= ui_state->tracks.records[i].duration;
+    else
+      kept++;
+  }
+  if (kept == ui_state->tracks.count)
+    return;
 
-      // convert full path to UTF-8 for Track.filepath
-      utf16_to_utf8(full_w, t->filepath, sizeof(t->filepath));
+  trackstore_remove(&ui_state->tracks, missing, count);
+  ui_state->selected_index = kept > 0 && selected >= kept ? kept - 1 : selected;
+  if (ui_state->track_offset > ui_state->selected_index)
+    ui_state->track_offset = ui_state->selected_index;
+  // indices moved; prime the follower again
+  ui_queue_next_track(player, ui_state);
+  ui_state->dirty = true;
+}
 
-      // default title from filename (UTF-8)
-      utf16_to_utf8(ffd.cFileName, t->title, sizeof(t->title));
+void ui_library_update(Player *player, UIState *ui_state) {
+  LibraryChange change;
+  while (library_poll_change(&change)) {
+    if (change.index >= ui_state->tracks.count ||
+        trackstore_find(&ui_state->tracks, change.track.filepath) !=
+            change.index)
+      continue;
+    if (change.track.duration <= 0.0)
+      change.track.duration = ui_state->tracks.records[change.index].duration;
+    update_track(ui_state, change.index, &change.track);
+    ui_state->dirty = true;
+  }
 
-      strcpy(t->artist, "Unknown Artist");
-      strcpy(t->album, "Unknown Album");
-      t->duration = 0.0;
+  bool *missing;
+  int count;
+  if (library_take_missing(&missing, &count)) {
+    remove_missing_tracks(player, ui_state, missing, count);
+    free(missing);
+    g_library_checking = false;
+  }
+}
 
-      // your existing metadata loader (still char*)
-      player_fill_metadata_from_file(t->filepath, t);
+// Tracks to drop after one drain of the watcher. Files are flagged by
+// position as they come; folders are collected and matched against the
+// whole playlist once, when the batch is applied.
+typedef struct {
+  bool *missing; // per track, allocated on first use
+  int count;
+  char **folders;
+  int folder_count, folder_cap;
+} GoneBatch;
+
+static bool gone_flag(GoneBatch *b, int index) {
+  if (!b->missing && !(b->missing = calloc(b->count, sizeof(bool))))
+    return false;
+  b->missing[index] = true;
+  return true;
+}
 
-      ui_state->track_count++;
-    } while (FindNextFileW(hFind, &ffd));
-    FindClose(hFind);
+static void gone_add(GoneBatch *b, const UIState *ui_state,
+                     const char *path, bool may_be_folder) {
+  int at = trackstore_find(&ui_state->tracks, path);
+  if (at >= 0) {
+    gone_flag(b, at);
+    return;
   }
-
-  // 2) Recurse into subdirectories
-  swprintf(search_w, MAX_PATH, L"%ls\\*", folder_w);
-  hFind = FindFirstFileW(search_w, &ffd);
-  if (hFind == INVALID_HANDLE_VALUE)
+  if (!may_be_folder)
     return;
+  // not a track: maybe a folder that had some
+  if (b->folder_count == b->folder_cap) {
+    int cap = b->folder_cap ? b->folder_cap * 2 : 16;
+    char **grown = realloc(b->folders, cap * sizeof(char *));
+    if (!grown)
+      return;
+    b->folders = grown;
+    b->folder_cap = cap;
+  }
+  char *copy = malloc(strlen(path) + 1);
+  if (!copy)
+    return;
+  strcpy(copy, path);
+  b->folders[b->folder_count++] = copy;
+}
 
-  do {
-    if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-      if (wcscmp(ffd.cFileName, L".") == 0 || wcscmp(ffd.cFileName, L"..") == 0)
-        continue;
-
-      wchar_t sub_w[MAX_PATH];
-      swprintf(sub_w, MAX_PATH, L"%ls\\%ls", folder_w, ffd.cFileName);
+static int compare_folders(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
 
-      char sub_utf8[MAX_PATH];
-      utf16_to_utf8(sub_w, sub_utf8, sizeof(sub_utf8));
+// Whether a folder above `path` is among the sorted `folders`
+static bool under_gone_folder(const char *path, char **folders, int count) {
+  for (const char *sep = strchr(path, '\\'); sep; sep = strchr(sep + 1, '\\')) {
+    size_t len = (size_t)(sep - path);
+    int lo = 0, hi = count;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      int c = strncmp(folders[mid], path, len);
+      if (c == 0 && folders[mid][len] != '\0')
+        c = 1;
+      if (c == 0)
+        return true;
+      if (c < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  }
+  return false;
+}
 
-      add_folder_mp3s_recursive(ui_state, sub_utf8);
+static void gone_apply(GoneBatch *b, Player *player, UIState *ui_state) {
+  if (b->folder_count > 0) {
+    qsort(b->folders, b->folder_count, sizeof(char *), compare_folders);
+    char path[DECODER_PATH_MAX];
+    for (int i = 0; i < b->count; ++i) {
+      if ((!b->missing || !b->missing[i]) &&
+          trackstore_path(&ui_state->tracks, i, path, sizeof(path)) &&
+          under_gone_folder(path, b->folders, b->folder_count) &&
+          !gone_flag(b, i))
+        break;
     }
-  } while (FindNextFileW(hFind, &ffd));
+  }
+  if (b->missing)
+    remove_missing_tracks(player, ui_state, b->missing, b->count);
 
-  FindClose(hFind);
+  free(b->missing);
+  for (int i = 0; i < b->folder_count; ++i)
+    free(b->folders[i]);
+  free(b->folders);
 }
 
-static void add_folder_mp3s(UIState *ui_state, const char *folder_utf8) {
-  add_folder_mp3s_recursive(ui_state, folder_utf8);
+void ui_watch_update(Player *player, UIState *ui_state) {
+  // the startup check reports by position; keep positions still till then
+  if (g_library_checking)
+    return;
 
-  if (ui_state->track_count > 0 &&
-      ui_state->selected_index >= ui_state->track_count) {
-    ui_state->selected_index = ui_state->track_count - 1;
+  GoneBatch gone = {.count = ui_state->tracks.count};
+  WatchEvent e;
+  while (watcher_poll(&e)) {
+    switch (e.kind) {
+    case WATCH_FILE: {
+      // only read again what actually changed
+      int at = trackstore_find(&ui_state->tracks, e.path);
+      if (at >= 0 && ui_state->tracks.records[at].size == e.size &&
+          ui_state->tracks.records[at].mtime == e.mtime)
+        break;
+      scanner_start(e.path, 0);
+      break;
+    }
+    case WATCH_GONE:
+      gone_add(&gone, ui_state, e.path, true);
+      break;
+    case WATCH_FOLDER:
+      scanner_start(e.path, 0);
+      break;
+    case WATCH_RESCAN:
+      // lost track of what happened: diff the folder against the playlist
+      if (!scanner_rescan(e.path, &ui_state->tracks))
+        fprintf(stderr, "[ui] could not queue %s for a rescan\n", e.path);
+      break;
+    }
   }
+  char path[DECODER_PATH_MAX];
+  while (scanner_poll_gone(path, sizeof(path)))
+    gone_add(&gone, ui_state, path, false);
+  gone_apply(&gone, player, ui_state);
 }
 
-// Prompt user for folder and add mp3s from there
+void ui_library_close(const UIState *ui_state) {
+  library_save(&ui_state->tracks);
+  library_shutdown();
+}
+
+// Prompt user for folder and add music files from there
 static void prompt_add_folder(UIState *ui_state) {
   char current[MAX_PATH] = "";
   int selected = 0;
@@ -630,7 +1035,7 @@ static void prompt_add_folder(UIState *ui_state) {
 
     // draw picker
     printf("\033[H"); // home only, no full clear
-    printf("=== Select folder with MP3 files ===\033[K\n\n");
+    printf("=== Select folder with music files ===\033[K\n\n");
     if (current[0] == '\0')
       printf("Location: [drives]\033[K\n\n");
     else {
@@ -677,7 +1082,7 @@ static void prompt_add_folder(UIState *ui_state) {
 
     if (ch == 's' || ch == 'S') {
       if (current[0] != '\0') {
-        add_folder_mp3s(ui_state, current); // current = UTF-8 path
+        add_folder_mp3s(current); // current = UTF-8 path
       }
       ui_state->screen = SCREEN_MAIN;
       ui_state->dirty = true;
@@ -754,7 +1159,7 @@ static void draw_folder_picker(UIState *ui) {
 
   // draw
   printf("\033[H"); // go to top-left
-  printf("=== Select folder with MP3 files ===\033[K\n\n");
+  printf("=== Select folder with music files ===\033[K\n\n");
 
   if (ui->folder_current[0] == '\0')
     printf("Location: [drives]\033[K\n\n");
@@ -804,6 +1209,9 @@ void ui_init(void) {
 }
 
 void ui_cleanup(void) {
+  spectrum_free(g_vis.spectrum);
+  g_vis.spectrum = NULL;
+
   // Show cursor
   printf("\x1b[?25h");
 
@@ -874,7 +1282,8 @@ void ui_handle_input(Player *player, UIState *ui_state) {
     case 's':
     case 'S':
       if (ui_state->folder_current[0] != '\0') {
-        add_folder_mp3s(ui_state, ui_state->folder_current);
+        add_folder_mp3s(ui_state->folder_current);
+        ui_queue_next_track(player, ui_state);
       }
       ui_state->screen = SCREEN_MAIN;
       ui_state->dirty = true;
@@ -928,7 +1337,7 @@ void ui_handle_input(Player *player, UIState *ui_state) {
     int code = _getch();
     switch (code) {
     case 72: // UP
-      if (ui_state->track_count > 0 && ui_state->selected_index > 0) {
+      if (ui_state->tracks.count > 0 && ui_state->selected_index > 0) {
         ui_state->selected_index--;
 
         // keep selection within window; scroll up if needed
@@ -940,8 +1349,8 @@ void ui_handle_input(Player *player, UIState *ui_state) {
       }
       break;
     case 80: // DOWN
-      if (ui_state->track_count > 0 &&
-          ui_state->selected_index < ui_state->track_count - 1) {
+      if (ui_state->tracks.count > 0 &&
+          ui_state->selected_index < ui_state->tracks.count - 1) {
 
         ui_state->selected_index++;
 
@@ -957,6 +1366,14 @@ void ui_handle_input(Player *player, UIState *ui_state) {
         ui_state->dirty = true;
       }
       break;
+    case 75: // LEFT
+      player_seek(player, player->position - UI_SEEK_STEP);
+      ui_state->dirty = true;
+      break;
+    case 77: // RIGHT
+      player_seek(player, player->position + UI_SEEK_STEP);
+      ui_state->dirty = true;
+      break;
     }
     return;
   }
@@ -990,14 +1407,42 @@ void ui_handle_input(Player *player, UIState *ui_state) {
       player->repeat_mode = REPEAT_ALL;
     else
       player->repeat_mode = REPEAT_NONE;
+    ui_queue_next_track(player, ui_state);
     ui_state->dirty = true;
     break;
 
   case 'f':
   case 'F': // F like "shuffle"
     player->shuffle = !player->shuffle;
+    ui_queue_next_track(player, ui_state);
+    ui_state->dirty = true;
+    break;
+  case 'x':
+  case 'X': {
+    double next = player->crossfade + UI_CROSSFADE_STEP;
+    player_set_crossfade(player, next > 12.0 ? 0.0 : next);
+    ui_state->dirty = true;
+    break;
+  }
+  case 'g':
+  case 'G':
+    player_set_gain_mode(player, (player->gain_mode + 1) %
+                                     REPLAYGAIN_MODE_COUNT);
+    ui_state->dirty = true;
+    break;
+  case 'e':
+  case 'E':
+    player_set_eq_preset(player, player->eq_preset + 1);
     ui_state->dirty = true;
     break;
+  case 'd':
+  case 'D': {
+    UiComponent *stats = find_component("audio_stats");
+    if (stats)
+      stats->enabled = !stats->enabled;
+    ui_state->dirty = true;
+    break;
+  }
   case '+':
     player_set_volume(player, player->volume + 0.1);
     ui_state->dirty = true;
@@ -1007,6 +1452,12 @@ void ui_handle_input(Player *player, UIState *ui_state) {
     ui_state->dirty = true;
     break;
 
+  case 'c':
+  case 'C':
+    scanner_cancel();
+    ui_state->dirty = true;
+    break;
+
   // NEW: add folder
   case 'a':
   case 'A':
@@ -1017,14 +1468,8 @@ void ui_handle_input(Player *player, UIState *ui_state) {
 
   // NEW: ENTER = play selected track
   case '\r': // Enter
-    if (ui_state->track_count > 0) {
-      Track *t = &ui_state->tracks[ui_state->selected_index];
-
-      if (player_load_track(player, t->filepath)) {
-        // update playlist track with duration & cleaned title
-        *t = player->current_track;
-        player_play(player);
-      }
+    if (ui_state->tracks.count > 0) {
+      play_track_at_index(player, ui_state, ui_state->selected_index);
       ui_state->dirty = true;
     }
     break;
@@ -1032,55 +1477,36 @@ void ui_handle_input(Player *player, UIState *ui_state) {
 }
 
 void ui_handle_track_end(Player *player, UIState *ui_state) {
-  if (ui_state->track_count == 0)
+  if (ui_state->tracks.count == 0)
     return;
 
   // find current index in playlist (by filepath)
-  int current = ui_state->selected_index;
-  for (int i = 0; i < ui_state->track_count; ++i) {
-    if (strcmp(ui_state->tracks[i].filepath, player->current_track.filepath) ==
-        0) {
-      current = i;
-      break;
-    }
-  }
-
-  switch (player->repeat_mode) {
-  case REPEAT_ONE:
-    // simply restart current track
-    play_track_at_index(player, ui_state, current);
-    ui_state->dirty = true;
-    break;
-
-  case REPEAT_ALL:
-  case REPEAT_NONE: {
-    int next = current;
-
-    if (player->shuffle && ui_state->track_count > 1) {
-      // random next (different from current)
-      do {
-        next = rand() % ui_state->track_count;
-      } while (next == current);
-    } else {
-      // sequential
-      next = current + 1;
-    }
-
-    // end-of-playlist behavior
-    if (next >= ui_state->track_count) {
-      if (player->repeat_mode == REPEAT_ALL) {
-        next = 0; // loop playlist
-      } else {
-        // REPEAT_NONE and no more tracks -> just stop
-        return;
-      }
-    }
+  int current = find_current_index(player, ui_state);
+  if (current < 0)
+    current = ui_state->selected_index;
+
+  // the primed track could not be spliced (e.g. different sample rate):
+  // keep the order that was already chosen for it
+  int next = ui_state->next_index;
+  if (next < 0 || next >= ui_state->tracks.count)
+    next = pick_next_index(player, ui_state, current);
+  if (next < 0)
+    return; // REPEAT_NONE and no more tracks -> just stop
+
+  play_track_at_index(player, ui_state, next);
+  ui_state->dirty = true;
+}
 
-    play_track_at_index(player, ui_state, next);
-    ui_state->dirty = true;
-    break;
-  }
+void ui_handle_track_advanced(Player *player, UIState *ui_state) {
+  int current = find_current_index(player, ui_state);
+  if (current >= 0) {
+    ui_state->selected_index = current;
+    // refresh metadata in playlist from player
+    refresh_track(ui_state, current, &player->current_track);
   }
+
+  ui_queue_next_track(player, ui_state);
+  ui_state->dirty = true;
 }
 
 void ui_compute_layout(UIState *ui) {
@@ -1120,9 +1546,9 @@ void ui_compute_layout(UIState *ui) {
   }
 
   UiRect banner = (UiRect){0, 0, w, 1};
-  UiRect header = (UiRect){0, 2, w, 3};
-  UiRect nav = (UiRect){0, 6, w, 1};
-  UiRect footer = (UiRect){0, h - 4, w, 4};
+  UiRect header = (UiRect){0, 2, w, 4};
+  UiRect nav = (UiRect){0, 7, w, 1};
+  UiRect footer = (UiRect){0, h - 5, w, 5};
   UiRect main = (UiRect){0, banner.h + header.h + nav.h + 3, w,
                          h - banner.h - header.h - nav.h - footer.h - 4};
 
@@ -1167,6 +1593,12 @@ void ui_init_state(UIState *ui, UiMode mode) {
   UiComponent *header_progress = register_component(
       UI_SECTION_HEADER, "header_progress", comp_progress_draw, NULL, NULL, 1);
 
+  UiComponent *spectrum = register_component(
+      UI_SECTION_HEADER, "spectrum", comp_spectrum_draw, NULL, NULL, 1);
+  if (!g_vis.spectrum)
+    g_vis.spectrum = spectrum_create();
+  spectrum->userdata = &g_vis;
+
   UiComponent *volume = register_component(UI_SECTION_HEADER, "volume",
                                            comp_volume_draw, NULL, NULL, 1);
 
@@ -1175,6 +1607,11 @@ void ui_init_state(UIState *ui, UiMode mode) {
       UI_SECTION_NAV, "navigation", comp_navigation_draw, NULL, NULL, 1);
 
   // main components
+  UiComponent *audio_stats =
+      register_component(UI_SECTION_MAIN, "audio_stats",
+                         comp_audio_stats_draw, NULL, NULL, 1);
+  audio_stats->enabled = false;
+
   UiComponent *playlist = register_component(UI_SECTION_MAIN, "playlist",
                                              comp_playlist_draw, NULL, NULL, 0);
 
@@ -1198,6 +1635,7 @@ void ui_init_state(UIState *ui, UiMode mode) {
   // mode-specific toggles
   if (ui->mode == UI_MODE_COMPACT) {
     header_progress->enabled = false;
+    spectrum->enabled = false;
     footer_controls->enabled = false;
     // maybe disable volume or footer_controls if you want extreme compact
   }
@@ -0,0 +1,405 @@
+#include "watcher.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#define WATCHER_MAX_ROOTS (MAXIMUM_WAIT_OBJECTS - 1) // one wait is the wake
+#define WATCHER_BUFFER (64 * 1024) // the most a network share will return
+
+typedef struct {
+  char *path; // UTF-8, as added
+  wchar_t path_w[MAX_PATH];
+  HANDLE dir;
+  OVERLAPPED ov; // its event is signalled when a read completes
+  DWORD *buffer; // WATCHER_BUFFER bytes, DWORD-aligned as the API wants
+  bool armed;    // a read is outstanding
+  bool rescan;   // lost track of this root since the last report
+} WatchRoot;
+
+typedef struct {
+  char *path;
+  bool rescan; // a root to read again rather than a path to check
+} Pending;
+
+typedef struct {
+  Pending *items;
+  int count, cap;
+} PendingList;
+
+// Folders asked for, written by the control thread only; the watcher
+// thread opens the first g_published. Entries never change once added.
+static char *g_added[WATCHER_MAX_ROOTS];
+static int g_added_count = 0;
+
+// Guarded by g_lock
+static CRITICAL_SECTION g_lock;
+static bool g_initialized = false;
+static bool g_quit = false;
+static int g_published = 0; // of g_added, visible to the thread
+static WatchEvent *g_events; // FIFO
+static size_t g_event_head, g_event_count, g_event_cap;
+
+static HANDLE g_wake = NULL; // new roots, or quit
+static HANDLE g_thread = NULL;
+
+static bool utf8_to_wide(const char *src, wchar_t *dst, int dst_len) {
+  return MultiByteToWideChar(CP_UTF8, 0, src, -1, dst, dst_len) > 0;
+}
+
+static bool wide_to_utf8(const wchar_t *src, char *dst, int dst_len) {
+  return WideCharToMultiByte(CP_UTF8, 0, src, -1, dst, dst_len, NULL,
+                             NULL) > 0;
+}
+
+static void push_event(const WatchEvent *e) {
+  EnterCriticalSection(&g_lock);
+  if (g_event_head + g_event_count == g_event_cap) {
+    if (g_event_head > 0) {
+      memmove(g_events, g_events + g_event_head,
+              g_event_count * sizeof(WatchEvent));
+      g_event_head = 0;
+    } else {
+      size_t cap = g_event_cap ? g_event_cap * 2 : 16;
+      WatchEvent *grown = realloc(g_events, cap * sizeof(WatchEvent));
+      if (!grown) {
+        LeaveCriticalSection(&g_lock);
+        return; // the change is picked up by the next check at startup
+      }
+      g_events = grown;
+      g_event_cap = cap;
+    }
+  }
+  g_events[g_event_head + g_event_count++] = *e;
+  LeaveCriticalSection(&g_lock);
+}
+
+// ---- batching ----
+
+static bool pending_add(PendingList *list, const char *path, bool rescan) {
+  if (list->count == list->cap) {
+    int cap = list->cap ? list->cap * 2 : 64;
+    Pending *grown = realloc(list->items, cap * sizeof(Pending));
+    if (!grown)
+      return false;
+    list->items = grown;
+    list->cap = cap;
+  }
+  char *copy = malloc(strlen(path) + 1);
+  if (!copy)
+    return false;
+  strcpy(copy, path);
+  list->items[list->count].path = copy;
+  list->items[list->count].rescan = rescan;
+  list->count++;
+  return true;
+}
+
+// Path order with the separator first, so that everything inside a folder
+// directly follows it ("a", "a\x", "a b" rather than "a", "a b", "a\x")
+static int compare_pending(const void *pa, const void *pb) {
+  const unsigned char *a = (const unsigned char *)((const Pending *)pa)->path;
+  const unsigned char *b = (const unsigned char *)((const Pending *)pb)->path;
+  for (;; ++a, ++b) {
+    int ca = *a == '\\' ? 1 : *a;
+    int cb = *b == '\\' ? 1 : *b;
+    if (ca != cb || ca == 0)
+      return ca - cb;
+  }
+}
+
+static bool inside(const char *path, const char *folder, size_t folder_len) {
+  return strncmp(path, folder, folder_len) == 0 && path[folder_len] == '\\';
+}
+
+// What a path is now, as one event
+static void check_path(const char *path, WatchEvent *e) {
+  strncpy(e->path, path, sizeof(e->path) - 1);
+  e->path[sizeof(e->path) - 1] = '\0';
+  e->size = e->mtime = 0;
+
+  wchar_t path_w[MAX_PATH];
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  if (!utf8_to_wide(path, path_w, MAX_PATH) ||
+      !GetFileAttributesExW(path_w, GetFileExInfoStandard, &fad)) {
+    e->kind = WATCH_GONE;
+  } else if (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+    e->kind = WATCH_FOLDER;
+  } else {
+    e->kind = WATCH_FILE;
+    e->size = ((uint64_t)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    e->mtime = ((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) |
+               fad.ftLastWriteTime.dwLowDateTime;
+  }
+}
+
+// Report a batch: each path once, and nothing inside a folder that is
+// reported as a whole (new, gone, or read again)
+static void flush(PendingList *list, WatchRoot *roots, int root_count) {
+  for (int i = 0; i < root_count; ++i) {
+    if (roots[i].rescan && pending_add(list, roots[i].path, true))
+      roots[i].rescan = false;
+  }
+  qsort(list->items, list->count, sizeof(Pending), compare_pending);
+
+  const char *last = NULL, *cover = NULL;
+  size_t cover_len = 0;
+  int reported = 0;
+  for (int i = 0; i < list->count; ++i) {
+    const Pending *p = &list->items[i];
+    if ((last && strcmp(p->path, last) == 0) ||
+        (cover && inside(p->path, cover, cover_len)))
+      continue;
+    last = p->path;
+
+    WatchEvent e;
+    if (p->rescan) {
+      memset(&e, 0, sizeof(e));
+      e.kind = WATCH_RESCAN;
+      strncpy(e.path, p->path, sizeof(e.path) - 1);
+    } else {
+      check_path(p->path, &e);
+    }
+    if (e.kind != WATCH_FILE) {
+      cover = p->path;
+      cover_len = strlen(cover);
+    }
+    push_event(&e);
+    reported++;
+  }
+  if (reported > 0)
+    fprintf(stderr, "[watcher] %d changes from %d notifications\n", reported,
+            list->count);
+
+  for (int i = 0; i < list->count; ++i)
+    free(list->items[i].path);
+  list->count = 0;
+}
+
+// ---- notifications ----
+
+static bool arm_root(WatchRoot *r) {
+  ResetEvent(r->ov.hEvent);
+  r->armed = ReadDirectoryChangesW(
+      r->dir, r->buffer, WATCHER_BUFFER, TRUE,
+      FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+          FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+      NULL, &r->ov, NULL);
+  return r->armed;
+}
+
+static void close_root(WatchRoot *r) {
+  if (r->dir != INVALID_HANDLE_VALUE) {
+    if (r->armed) { // the buffer must outlive the cancelled read
+      DWORD bytes;
+      CancelIoEx(r->dir, &r->ov);
+      GetOverlappedResult(r->dir, &r->ov, &bytes, TRUE);
+    }
+    CloseHandle(r->dir);
+    r->dir = INVALID_HANDLE_VALUE;
+  }
+  if (r->ov.hEvent)
+    CloseHandle(r->ov.hEvent);
+  free(r->buffer);
+  r->buffer = NULL;
+}
+
+static bool open_root(WatchRoot *r, char *path) {
+  memset(r, 0, sizeof(*r));
+  r->path = path;
+  r->dir = INVALID_HANDLE_VALUE;
+  if (!utf8_to_wide(path, r->path_w, MAX_PATH))
+    return false;
+  r->dir = CreateFileW(r->path_w, FILE_LIST_DIRECTORY,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING,
+                       FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+  r->ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  r->buffer = malloc(WATCHER_BUFFER);
+  if (r->dir == INVALID_HANDLE_VALUE || !r->ov.hEvent || !r->buffer ||
+      !arm_root(r)) {
+    close_root(r);
+    return false;
+  }
+  return true;
+}
+
+// Collect the paths of a completed read and start the next one; false if
+// the root can no longer be watched
+static bool read_root(WatchRoot *r, PendingList *list) {
+  DWORD bytes = 0;
+  r->armed = false;
+  if (!GetOverlappedResult(r->dir, &r->ov, &bytes, FALSE) || bytes == 0) {
+    r->rescan = true; // the buffer overflowed, or the share hiccupped
+  } else {
+    const BYTE *at = (const BYTE *)r->buffer;
+    for (;;) {
+      const FILE_NOTIFY_INFORMATION *fni = (const FILE_NOTIFY_INFORMATION *)at;
+      wchar_t full_w[MAX_PATH];
+      char full[DECODER_PATH_MAX];
+      int name_len = (int)(fni->FileNameLength / sizeof(wchar_t));
+      if (!r->rescan &&
+          swprintf(full_w, MAX_PATH, L"%ls\\%.*ls", r->path_w, name_len,
+                   fni->FileName) >= 0 &&
+          wide_to_utf8(full_w, full, sizeof(full)) &&
+          (list->count >= WATCHER_MAX_PENDING ||
+           !pending_add(list, full, false)))
+        r->rescan = true;
+      if (fni->NextEntryOffset == 0)
+        break;
+      at += fni->NextEntryOffset;
+    }
+  }
+  return arm_root(r);
+}
+
+static DWORD WINAPI watch_main(LPVOID arg) {
+  (void)arg;
+  WatchRoot roots[WATCHER_MAX_ROOTS];
+  int root_count = 0, taken = 0;
+  PendingList pending = {0};
+  DWORD first = 0, last = 0; // ticks of the batch's first and last change
+
+  for (;;) {
+    EnterCriticalSection(&g_lock);
+    bool quit = g_quit;
+    int published = g_published;
+    LeaveCriticalSection(&g_lock);
+    if (quit)
+      break;
+    for (; taken < published; ++taken) {
+      if (open_root(&roots[root_count], g_added[taken]))
+        root_count++;
+      else
+        fprintf(stderr, "[watcher] cannot watch %s\n", g_added[taken]);
+    }
+
+    HANDLE waits[MAXIMUM_WAIT_OBJECTS];
+    waits[0] = g_wake;
+    for (int i = 0; i < root_count; ++i)
+      waits[i + 1] = roots[i].ov.hEvent;
+
+    DWORD timeout = INFINITE;
+    bool batch = pending.count > 0;
+    for (int i = 0; i < root_count; ++i)
+      batch = batch || roots[i].rescan;
+    if (batch) {
+      DWORD now = GetTickCount();
+      DWORD quiet = now - last, age = now - first;
+      timeout = quiet >= WATCHER_QUIET_MS || age >= WATCHER_MAX_DELAY_MS
+                    ? 0
+                    : WATCHER_QUIET_MS - quiet;
+      if (timeout > 0 && WATCHER_MAX_DELAY_MS - age < timeout)
+        timeout = WATCHER_MAX_DELAY_MS - age;
+    }
+
+    DWORD w = WaitForMultipleObjects((DWORD)root_count + 1, waits, FALSE,
+                                     timeout);
+    if (w == WAIT_TIMEOUT) {
+      flush(&pending, roots, root_count);
+    } else if (w > WAIT_OBJECT_0 && w <= WAIT_OBJECT_0 + (DWORD)root_count) {
+      int i = (int)(w - WAIT_OBJECT_0) - 1;
+      if (!batch)
+        first = GetTickCount();
+      last = GetTickCount();
+      if (!read_root(&roots[i], &pending)) {
+        fprintf(stderr, "[watcher] stopped watching %s\n", roots[i].path);
+        close_root(&roots[i]);
+        roots[i] = roots[--root_count];
+      }
+    }
+  }
+
+  for (int i = 0; i < root_count; ++i)
+    close_root(&roots[i]);
+  for (int i = 0; i < pending.count; ++i)
+    free(pending.items[i].path);
+  free(pending.items);
+  return 0;
+}
+
+// ---- public API ----
+
+static bool watcher_init(void) {
+  g_wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!g_wake)
+    return false;
+  InitializeCriticalSection(&g_lock);
+  g_quit = false;
+  g_initialized = true;
+
+  g_thread = CreateThread(NULL, 0, watch_main, NULL, 0, NULL);
+  if (!g_thread) {
+    watcher_shutdown();
+    return false;
+  }
+  SetThreadPriority(g_thread, THREAD_PRIORITY_BELOW_NORMAL);
+  return true;
+}
+
+bool watcher_add_root(const char *folder) {
+  for (int i = 0; i < g_added_count; ++i) {
+    size_t len = strlen(g_added[i]);
+    if (strcmp(folder, g_added[i]) == 0 || inside(folder, g_added[i], len))
+      return true;
+  }
+  if (g_added_count == WATCHER_MAX_ROOTS)
+    return false;
+  if (!g_initialized && !watcher_init())
+    return false;
+
+  char *copy = malloc(strlen(folder) + 1);
+  if (!copy)
+    return false;
+  strcpy(copy, folder);
+  g_added[g_added_count++] = copy;
+
+  EnterCriticalSection(&g_lock);
+  g_published = g_added_count;
+  LeaveCriticalSection(&g_lock);
+  SetEvent(g_wake);
+  return true;
+}
+
+bool watcher_poll(WatchEvent *out) {
+  if (!g_initialized)
+    return false;
+  EnterCriticalSection(&g_lock);
+  bool got = g_event_count > 0;
+  if (got) {
+    *out = g_events[g_event_head++];
+    if (--g_event_count == 0)
+      g_event_head = 0;
+  }
+  LeaveCriticalSection(&g_lock);
+  return got;
+}
+
+void watcher_shutdown(void) {
+  if (!g_initialized)
+    return;
+
+  EnterCriticalSection(&g_lock);
+  g_quit = true;
+  LeaveCriticalSection(&g_lock);
+  SetEvent(g_wake);
+  if (g_thread) {
+    WaitForSingleObject(g_thread, INFINITE);
+    CloseHandle(g_thread);
+    g_thread = NULL;
+  }
+  CloseHandle(g_wake);
+  g_wake = NULL;
+
+  for (int i = 0; i < g_added_count; ++i)
+    free(g_added[i]);
+  g_added_count = g_published = 0;
+  free(g_events);
+  g_events = NULL;
+  g_event_head = g_event_count = g_event_cap = 0;
+
+  DeleteCriticalSection(&g_lock);
+  g_initialized = false;
+}